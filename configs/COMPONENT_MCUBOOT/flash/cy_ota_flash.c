@@ -48,11 +48,16 @@
 #include "cyhal.h"
 #include "cybsp.h"
 #include "cy_ota_flash.h"
+#include "cy_ota_flash_ext.h"
 
 #if !(defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
 #include <cycfg_pins.h>
 #endif
 
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
 /**********************************************************************************************************************************
  * local defines
  **********************************************************************************************************************************/
@@ -68,6 +73,51 @@
 #define CY_FLASH_BASE                       0x10000000UL
 #endif /* XMC7200 */
 
+/* Number of partially written rows held in RAM by the write-combining buffer.
+ * Partial rows are programmed once they are complete, when the slot is needed
+ * for another row, or on cy_ota_mem_flush(). Set to 0 to program partial rows
+ * immediately with a read-modify-write.
+ */
+#ifndef OTA_MEM_COMBINE_ROWS
+#define OTA_MEM_COMBINE_ROWS                        (2u)
+#endif
+
+/* Number of erased ranges remembered while erase on demand is enabled, see
+ * cy_ota_mem_set_erase_on_demand(). When all are in use an erase is done
+ * immediately.
+ */
+#ifndef OTA_MEM_ERASE_ON_DEMAND_RANGES
+#define OTA_MEM_ERASE_ON_DEMAND_RANGES              (4u)
+#endif
+
+/* Start internal flash program/erase operations without blocking and let the
+ * other tasks run until they complete. On XMC7200 the scheduler runs from code
+ * flash, so only enable it there when the image executes from a flash bank
+ * other than the one written.
+ */
+#ifndef OTA_FLASH_YIELD_WHILE_BUSY
+#if defined (XMC7200)
+#define OTA_FLASH_YIELD_WHILE_BUSY                  (0)
+#else
+#define OTA_FLASH_YIELD_WHILE_BUSY                  (1)
+#endif
+#endif
+
+
+/* Time the writer sleeps between two checks of an internal flash operation */
+#ifndef OTA_FLASH_BUSY_POLL_MS
+#define OTA_FLASH_BUSY_POLL_MS                      (1u)
+#endif
+
+/* Longest time the external flash is kept out of XIP mode while a flash session
+ * groups the row operations of a write, see cy_ota_mem_session_begin(). The
+ * window is closed at the first row boundary after it, so the interrupts
+ * executing from the external flash are serviced.
+ */
+#ifndef OTA_MEM_SESSION_MAX_XIP_OFF_US
+#define OTA_MEM_SESSION_MAX_XIP_OFF_US              (1000u)
+#endif
+
 #if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
 /* UN-comment to test the write functionality */
 //#define READBACK_SMIF_WRITE_TEST
@@ -78,6 +128,51 @@
 
 /* Set it high enough for the sector erase operation to complete */
 #define MEMORY_BUSY_CHECK_RETRIES                   (750ul)
+#define MEMORY_BUSY_CHECK_DELAY_MS                  (5ul)
+
+/* Chip erase takes minutes on large devices */
+#define MEMORY_CHIP_ERASE_TIMEOUT_MS                (600000ul)
+
+/* Optional block erase of the external flash, used instead of the sector erase
+ * where a whole block of a region with smaller sectors is erased, e.g. 0xD8 for
+ * 64 KB on devices with 4 KB sectors. Only enable it when the device supports
+ * the command, 0 disables it.
+ */
+#ifndef OTA_SMIF_BLOCK_ERASE_SIZE
+#define OTA_SMIF_BLOCK_ERASE_SIZE                   (0u)
+#endif
+#ifndef OTA_SMIF_BLOCK_ERASE_CMD
+#define OTA_SMIF_BLOCK_ERASE_CMD                    (0xD8u)
+#endif
+
+/* Serve external flash reads from the memory-mapped (XIP) window through the
+ * SMIF cache, instead of command mode reads with XIP off. Reads of a range
+ * that is being programmed or erased still use command mode.
+ */
+#ifndef OTA_SMIF_MEMORY_MAPPED_READ
+#define OTA_SMIF_MEMORY_MAPPED_READ                 (1)
+#endif
+
+/* Let the other tasks run while the external flash is busy with an erase.
+ * Not possible when the code executes from the external flash, as it can not
+ * be read until the erase is done.
+ */
+#ifndef OTA_SMIF_YIELD_WHILE_BUSY
+#ifdef CY_XIP_SMIF_MODE_CHANGE
+#define OTA_SMIF_YIELD_WHILE_BUSY                   (0)
+#else
+#define OTA_SMIF_YIELD_WHILE_BUSY                   (1)
+#endif
+#endif
+
+/* Time the status of the external flash is polled after a page program before
+ * the task blocks for a tick, about the typical page program time of the
+ * S25HS-T. Most pages are done within it, without losing the rest of a tick.
+ */
+#ifndef OTA_SMIF_PROGRAM_POLL_US
+#define OTA_SMIF_PROGRAM_POLL_US                    (400u)
+#endif
+#define OTA_SMIF_PROGRAM_POLL_STEP_US               (20u)
 #define _CYHAL_QSPI_DESELECT_DELAY                  (7UL)
 
 /* cyhal_qspi_init() succeeded */
@@ -104,15 +199,31 @@
 
 #define PRE_SMIF_ACCESS_TURN_OFF_XIP \
                     uint32_t interruptState;                            \
+                    uint32_t xipOffCycles;                              \
                     interruptState = Cy_SysLib_EnterCriticalSection();  \
                     while(Cy_SMIF_BusyCheck(SMIF0));    \
-                    (void)Cy_SMIF_SetMode(SMIF0, CY_SMIF_NORMAL);
+                    (void)Cy_SMIF_SetMode(SMIF0, CY_SMIF_NORMAL);   \
+                    xipOffCycles = DWT->CYCCNT;
 
 #define POST_SMIF_ACCESS_TURN_ON_XIP \
                     while(Cy_SMIF_BusyCheck(SMIF0));    \
                     (void)Cy_SMIF_SetMode(SMIF0, CY_SMIF_MEMORY);   \
+                    ota_xip_off_record(DWT->CYCCNT - xipOffCycles); \
                     Cy_SysLib_ExitCriticalSection(interruptState);
 
+/* Erase suspend/resume commands of the external flash (S25HS/S25HL-T, most SPI NOR devices) */
+#ifndef OTA_SMIF_ERASE_SUSPEND_CMD
+#define OTA_SMIF_ERASE_SUSPEND_CMD                  (0x75u)
+#endif
+#ifndef OTA_SMIF_ERASE_RESUME_CMD
+#define OTA_SMIF_ERASE_RESUME_CMD                   (0x7Au)
+#endif
+
+/* Longest time a sector erase runs with XIP off before it is suspended */
+#ifndef OTA_SMIF_ERASE_SLICE_US
+#define OTA_SMIF_ERASE_SLICE_US                     (2000u)
+#endif
+
 
 #else
 #define PRE_SMIF_ACCESS_TURN_OFF_XIP
@@ -126,6 +237,19 @@
 static cy_stc_smif_context_t ota_QSPI_context;
 static volatile uint32_t     status_flags;
 
+#ifdef CY_XIP_SMIF_MODE_CHANGE
+/* Longest time XIP was off during the erase or write in progress, in CPU cycles */
+static uint32_t xip_op_max_cycles;
+
+/* Time XIP was off since the last reset, in CPU cycles */
+static uint64_t xip_off_total_cycles;
+
+/* XIP-off window shared by the row operations of a flash session */
+static bool     xip_window_open;
+static uint32_t xip_window_interrupt_state;
+static uint32_t xip_window_start;
+#endif
+
 /* Default QSPI configuration */
 const cy_stc_smif_config_t ota_SMIF_config =
 {
@@ -146,704 +270,2231 @@ extern const cy_stc_smif_block_config_t smifBlockConfig;
 /* Used for testing the write functionality */
 static uint8_t read_back_test[1024];
 #endif
+
+/* External flash row read back to check if a sector is blank */
+static uint32_t smif_compare_buffer[CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)];
+
+/* Range of the external flash with a program or erase in flight, [start, end) */
+static uint32_t smif_busy_start;
+static uint32_t smif_busy_end;
+
+/* The SMIF cache may hold external flash data from before the last program or erase */
+static bool smif_cache_stale;
 #endif /* CY_IP_MXSMIF & !XMC7200 */
 
+#if defined (XMC7200)
+/* Erase sectors of the XMC7200 flash regions, see flashmap/xmc7200_platform.json */
+typedef struct
+{
+    uint32_t    address;
+    uint32_t    size;
+    uint32_t    erase_size;
+} xmc_flash_region_t;
+
+static const xmc_flash_region_t xmc_flash_regions[] =
+{
+    { 0x10000000u, 0x7F0000u, 0x8000u },    /* INTERNAL_FLASH_CODE_LARGE */
+    { 0x107F0000u, 0x040000u, 0x2000u },    /* INTERNAL_FLASH_CODE_SMALL */
+    { 0x14000000u, 0x030000u, 0x0800u },    /* INTERNAL_FLASH_WORK_LARGE */
+    { 0x14030000u, 0x010000u, 0x0080u },    /* INTERNAL_FLASH_WORK_SMALL */
+};
+#endif
+
+/* Times the external flash was taken out of XIP mode */
+static cy_ota_mem_xip_blackout_t xip_blackout;
+
+/* Count, bytes and latency of each operation on each memory type */
+static cy_ota_mem_op_stats_table_t op_stats;
+
+/* Called for each sector erased, see cy_ota_mem_set_erase_hook() */
+static cy_ota_mem_erase_hook_t erase_hook;
+
+/* Region erased ahead of time by cy_ota_mem_pre_erase_step(), [start, start + blank_len) is known to be blank */
+typedef struct
+{
+    bool                valid;
+    cy_ota_mem_type_t   mem_type;
+    uint32_t            start;          /* Normalized address of the region */
+    uint32_t            len;
+    uint32_t            blank_len;      /* Watermark, always ends on an erase sector boundary */
+} ota_mem_blank_region_t;
+
+static ota_mem_blank_region_t blank_region;
+
+/* Range that cy_ota_mem_erase() was asked to erase and that is erased sector by sector when written */
+typedef struct
+{
+    bool                in_use;
+    cy_ota_mem_type_t   mem_type;
+    uint32_t            start;          /* Normalized address, on an erase sector boundary */
+    uint32_t            end;            /* First byte after the range, on an erase sector boundary */
+} ota_mem_pending_erase_t;
+
+static bool erase_on_demand;
+static ota_mem_pending_erase_t pending_erase[OTA_MEM_ERASE_ON_DEMAND_RANGES];
+
+/* Counters of the cy_ota_mem_write() call in progress and the accumulated totals */
+static cy_ota_mem_write_counters_t write_call_counters;
+static cy_ota_mem_write_counters_t write_total_counters;
+
+/**
+ * This is used if a block is < Block size to satisfy requirements
+ * of flash_area_write(). "static" so it is not on the stack.
+ */
+static uint8_t block_buffer[CY_FLASH_SIZEOF_ROW];
+
+#if (OTA_MEM_COMBINE_ROWS > 0)
+/* Partially written flash row waiting to be programmed */
+typedef struct
+{
+    bool                in_use;
+    cy_ota_mem_type_t   mem_type;
+    uint32_t            row_base;                           /* Row address, SMIF offset for external flash */
+    uint32_t            last_use;                           /* Used to evict the least recently used row   */
+    uint32_t            bytes_valid;                        /* Number of bytes set in valid[]              */
+    uint8_t             valid[CY_FLASH_SIZEOF_ROW / 8u];    /* One bit per byte written in data[]          */
+    uint8_t             data[CY_FLASH_SIZEOF_ROW];
+} ota_mem_combine_row_t;
+
+static ota_mem_combine_row_t combine_rows[OTA_MEM_COMBINE_ROWS];
+static uint32_t combine_use_count;
+#endif
+
+/* Serializes the flash operations of the tasks, held for the whole of a flash session */
+static SemaphoreHandle_t session_mutex;
+/* Nesting depth of the flash session of the task holding session_mutex */
+static uint32_t session_depth;
+
 
 /**********************************************************************************************************************************
  * Internal Functions
  **********************************************************************************************************************************/
-#if defined(CY_IP_MXSMIF) && !defined(PSOC_062_1M) && !defined(XMC7200)
-#if defined(OTA_USE_EXTERNAL_FLASH)
-/*******************************************************************************
-* Function Name: IsMemoryReady
-****************************************************************************//**
-*
-* Polls the memory device to check whether it is ready to accept new commands or
-* not until either it is ready or the retries have exceeded the limit.
-*
-* \param memConfig
-* memory device configuration
-*
-* \return Status of the operation.
-* CY_SMIF_SUCCESS        - Memory is ready to accept new commands.
-* CY_SMIF_EXCEED_TIMEOUT - Memory is busy.
-*
-*******************************************************************************/
-static cy_en_smif_status_t IsMemoryReady(cy_stc_smif_mem_config_t const *memConfig)
+#ifdef CY_XIP_SMIF_MODE_CHANGE
+/* Counts a switch of the external flash out of XIP mode that lasted the given number of CPU cycles */
+CY_SECTION_RAMFUNC_BEGIN
+static void ota_xip_off_record(uint32_t cycles)
 {
-    uint32_t retries = 0;
-    bool isBusy;
-
-    do
+    if (cycles > xip_op_max_cycles)
     {
-        isBusy = Cy_SMIF_Memslot_IsBusy(SMIF0, (cy_stc_smif_mem_config_t* )memConfig, &ota_QSPI_context);
-        Cy_SysLib_Delay(5);
-        retries++;
-    }while(isBusy && (retries < MEMORY_BUSY_CHECK_RETRIES));
-
-    return (isBusy ? CY_SMIF_EXCEED_TIMEOUT : CY_SMIF_SUCCESS);
+        xip_op_max_cycles = cycles;
+    }
+    xip_off_total_cycles += cycles;
+    xip_blackout.blackouts++;
 }
+CY_SECTION_RAMFUNC_END
+#endif
 
 /*******************************************************************************
-* Function Name: IsQuadEnabled
+* Function Name: ota_xip_window_enter
 ****************************************************************************//**
 *
-* Checks whether QE (Quad Enable) bit is set or not in the configuration
-* register of the memory.
-*
-* \param memConfig
-* Memory device configuration
-*
-* \param isQuadEnabled
-* This parameter is updated to indicate whether Quad mode is enabled (true) or
-* not (false). The value is valid only when the function returns
-* CY_SMIF_SUCCESS.
-*
-* \return Status of the operation. See cy_en_smif_status_t.
+* Turns XIP off for a row operation on the external flash, unless the window
+* of the previous row is still open. Only RAM resident code may run until
+* ota_xip_window_leave() closes the window. Does nothing when the code does
+* not execute from the external flash.
 *
 *******************************************************************************/
-static cy_en_smif_status_t IsQuadEnabled(cy_stc_smif_mem_config_t const *memConfig, bool *isQuadEnabled)
+CY_SECTION_RAMFUNC_BEGIN
+static void ota_xip_window_enter(void)
 {
-    cy_en_smif_status_t status;
-    uint8_t readStatus = 0;
-    uint32_t statusCmd = memConfig->deviceCfg->readStsRegQeCmd->command;
-    uint8_t maskQE = (uint8_t) memConfig->deviceCfg->stsRegQuadEnableMask;
-
-    status = Cy_SMIF_Memslot_CmdReadSts(SMIF0, memConfig, &readStatus, statusCmd, &ota_QSPI_context);
-
-    *isQuadEnabled = false;
-    if(CY_SMIF_SUCCESS == status)
+#ifdef CY_XIP_SMIF_MODE_CHANGE
+    if (!xip_window_open)
     {
-        /* Check whether Quad mode is already enabled or not */
-        *isQuadEnabled = (maskQE == (readStatus & maskQE));
+        xip_window_interrupt_state = Cy_SysLib_EnterCriticalSection();
+        while(Cy_SMIF_BusyCheck(SMIF0));
+        (void)Cy_SMIF_SetMode(SMIF0, CY_SMIF_NORMAL);
+        xip_window_start = DWT->CYCCNT;
+        xip_window_open = true;
     }
-
-    return status;
+#endif
 }
+CY_SECTION_RAMFUNC_END
 
 /*******************************************************************************
-* Function Name: EnableQuadMode
+* Function Name: ota_xip_window_leave
 ****************************************************************************//**
 *
-* This function sets the QE (QUAD Enable) bit in the external memory
-* configuration register to enable Quad SPI mode.
-*
-* \param memConfig
-* Memory device configuration
+* Turns XIP back on after a row operation on the external flash. Within a flash
+* session the window is left open for the next row until it has lasted
+* OTA_MEM_SESSION_MAX_XIP_OFF_US, outside of a session it is always closed.
 *
-* \return Status of the operation. See cy_en_smif_status_t.
+* \param force
+* true to close the window regardless, before returning to code executing
+* from the external flash.
 *
 *******************************************************************************/
-static cy_en_smif_status_t EnableQuadMode(cy_stc_smif_mem_config_t const *memConfig)
+CY_SECTION_RAMFUNC_BEGIN
+static void ota_xip_window_leave(bool force)
 {
-    cy_en_smif_status_t status;
-
-    /* Send Write Enable to external memory */
-    status = Cy_SMIF_Memslot_CmdWriteEnable(SMIF0, smifMemConfigs[0], &ota_QSPI_context);
+#ifdef CY_XIP_SMIF_MODE_CHANGE
+    uint32_t elapsed = DWT->CYCCNT - xip_window_start;
 
-    if(CY_SMIF_SUCCESS == status)
+    if (xip_window_open &&
+        (force || (session_depth == 0u) ||
+         (elapsed >= ((SystemCoreClock / 1000000u) * OTA_MEM_SESSION_MAX_XIP_OFF_US))))
     {
-        status = Cy_SMIF_Memslot_QuadEnable(SMIF0, (cy_stc_smif_mem_config_t* )memConfig, &ota_QSPI_context);
-
-        if(CY_SMIF_SUCCESS == status)
-        {
-            /* Poll memory for the completion of operation */
-            status = IsMemoryReady(memConfig);
-        }
+        while(Cy_SMIF_BusyCheck(SMIF0));
+        (void)Cy_SMIF_SetMode(SMIF0, CY_SMIF_MEMORY);
+        ota_xip_off_record(DWT->CYCCNT - xip_window_start);
+        xip_window_open = false;
+        Cy_SysLib_ExitCriticalSection(xip_window_interrupt_state);
     }
+#else
+    (void)force;
+#endif
+}
+CY_SECTION_RAMFUNC_END
 
-    return status;
+/* Waits for the other tasks to finish their flash operations or session */
+static void ota_mem_lock( void )
+{
+    if ((session_mutex != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING))
+    {
+        (void)xSemaphoreTakeRecursive(session_mutex, portMAX_DELAY);
+    }
 }
-#endif /* OTA_USE_EXTERNAL_FLASH */
-#endif /* CY_IP_MXSMIF & !PSOC_062_1M & !XMC7200 */
 
-#if !(defined (CYW20829A0LKML) || defined (CYW20829B0LKML) || defined (XMC7200))
-static int psoc6_internal_flash_write(uint8_t data[], uint32_t address, size_t len)
+static void ota_mem_unlock( void )
 {
-    int retCode;
-    cy_en_flashdrv_status_t rc = CY_FLASH_DRV_SUCCESS;
+    if ((session_mutex != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING))
+    {
+        (void)xSemaphoreGiveRecursive(session_mutex);
+    }
+}
 
-    uint32_t writeBuffer[CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)];
-    uint32_t rowId;
-    uint32_t dstIndex;
-    uint32_t srcIndex = 0u;
-    uint32_t eeOffset;
-    uint32_t byteOffset;
-    uint32_t rowsNotEqual;
-    uint8_t *writeBufferPointer;
+/* Adds an operation on the flash that started at the given DWT cycle count to the statistics */
+static void ota_mem_op_record( cy_ota_mem_type_t mem_type, cy_ota_mem_op_t op, uint32_t bytes, uint32_t start_cycles )
+{
+    uint32_t cycles_per_us = SystemCoreClock / 1000000u;
+    uint32_t us = (cycles_per_us != 0u) ? ((DWT->CYCCNT - start_cycles) / cycles_per_us) : 0u;
+    uint32_t bucket = (us > 1u) ? (31u - __CLZ(us)) : 0u;
+    cy_ota_mem_op_stats_t *stats;
 
-    eeOffset = (uint32_t)address;
-    writeBufferPointer = (uint8_t*)writeBuffer;
+    stats = &op_stats.op[(mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH) ? CY_OTA_MEM_STATS_INTERNAL : CY_OTA_MEM_STATS_EXTERNAL][op];
+    if (bucket >= OTA_MEM_LATENCY_BUCKETS)
+    {
+        bucket = OTA_MEM_LATENCY_BUCKETS - 1u;
+    }
 
-    bool cond1;
+    stats->count++;
+    stats->bytes += bytes;
+    stats->total_us += us;
+    stats->histogram[bucket]++;
+    if (us > stats->max_us)
+    {
+        stats->max_us = us;
+    }
+}
 
-    /* Make sure, that varFlash[] points to Flash */
-    cond1 = ((eeOffset >= CY_FLASH_BASE) && ((eeOffset + len) <= (CY_FLASH_BASE + CY_FLASH_SIZE)));
+/* Returns the address as used for the row bookkeeping of the write-combining buffer */
+static uint32_t ota_mem_normalize_addr( cy_ota_mem_type_t mem_type, uint32_t addr )
+{
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+    if ((mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH) && (addr >= CY_SMIF_BASE_MEM_OFFSET))
+    {
+        addr -= CY_SMIF_BASE_MEM_OFFSET;
+    }
+#else
+    (void)mem_type;
+#endif
+    return addr;
+}
 
-    if(cond1)
+/* Returns the erase sector size at the address and the bounds of the flash region
+ * with that sector size, 0 if the address can not be erased.
+ */
+static uint32_t ota_mem_erase_region( cy_ota_mem_type_t mem_type, uint32_t addr,
+                                      uint32_t *region_start, uint32_t *region_end )
+{
+    if (mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH)
     {
-        eeOffset -= CY_FLASH_BASE;
-        rowId = eeOffset / CY_FLASH_SIZEOF_ROW;
-        byteOffset = CY_FLASH_SIZEOF_ROW * rowId;
+#if defined (XMC7200)
+        uint32_t i;
 
-        while((srcIndex < len) && (rc == CY_FLASH_DRV_SUCCESS))
+        /* Offsets from CY_FLASH_BASE, as used by flash_area_*() */
+        for (i = 0; i < (sizeof(xmc_flash_regions) / sizeof(xmc_flash_regions[0])); i++)
         {
-            rowsNotEqual = 0u;
-            /* Copy data to the write buffer either from the source buffer or from the flash */
-            for(dstIndex = 0u; dstIndex < CY_FLASH_SIZEOF_ROW; dstIndex++)
-            {
-                if((byteOffset >= eeOffset) && (srcIndex < len))
-                {
-                    writeBufferPointer[dstIndex] = data[srcIndex];
-                    /* Detect that row programming is required */
-                    if((rowsNotEqual == 0u) && ( (CY_GET_REG8(CY_FLASH_BASE + byteOffset) != data[srcIndex]) ) )
-                    {
-                        rowsNotEqual = 1u;
-                    }
-                    srcIndex++;
-                }
-                else
-                {
-                    writeBufferPointer[dstIndex] = CY_GET_REG8(CY_FLASH_BASE + byteOffset);
-                }
-                byteOffset++;
-            }
+            uint32_t start = xmc_flash_regions[i].address - CY_FLASH_BASE;
 
-            if(rowsNotEqual != 0u)
+            if ((addr >= start) && (addr < (start + xmc_flash_regions[i].size)))
             {
-                /* Write flash row */
-                rc = Cy_Flash_WriteRow((rowId * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE, writeBuffer);
+                *region_start = start;
+                *region_end   = start + xmc_flash_regions[i].size;
+                return xmc_flash_regions[i].erase_size;
             }
-
-            /* Go to the next row */
-            rowId++;
         }
+#elif !(defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
+        *region_start = 0;
+        *region_end   = CY_FLASH_SIZE;
+        return CY_FLASH_SIZEOF_ROW;
+#endif
     }
-    else
-    {
-        rc = CY_FLASH_DRV_INVALID_INPUT_PARAMETERS;
-    }
-
-    /* Return error code */
-    switch(rc)
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+    else if ((mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH) && IS_FLAG_SET(FLAG_HAL_INIT_DONE))
     {
-        case CY_FLASH_DRV_SUCCESS:
-            retCode = 0;
-            break;
+        cy_stc_smif_mem_config_t const *memConfig = smifBlockConfig.memConfig[MEM_SLOT];
+        cy_stc_smif_hybrid_region_info_t *hybrid_info = NULL;
 
-        case CY_FLASH_DRV_INVALID_INPUT_PARAMETERS:
-        case CY_FLASH_DRV_INVALID_FLASH_ADDR:
-            retCode = 1;
-            break;
+        addr = ota_mem_normalize_addr(mem_type, addr);
 
-        default:
-            retCode = 2;
-            break;
+        /* Cy_SMIF_MemLocateHybridRegion() does not access the external flash, just data tables from RAM  */
+        if (Cy_SMIF_MemLocateHybridRegion(memConfig, &hybrid_info, addr) == CY_SMIF_SUCCESS)
+        {
+            *region_start = hybrid_info->regionAddress;
+            *region_end   = hybrid_info->regionAddress + (hybrid_info->sectorsCount * hybrid_info->eraseSize);
+            return hybrid_info->eraseSize;
+        }
+        *region_start = 0;
+        *region_end   = memConfig->deviceCfg->memSize;
+        return memConfig->deviceCfg->eraseSize;
     }
-    return(retCode);
+#endif /* CY_IP_MXSMIF & !XMC7200 */
+
+    return 0;
 }
 
-static int psoc6_internal_flash_erase(uint32_t addr, size_t size)
+/* Returns the size of the sector erased by cy_ota_mem_erase() at the address */
+static uint32_t ota_mem_erase_sector_size( cy_ota_mem_type_t mem_type, uint32_t addr )
 {
-    int rc = 0;
+    uint32_t region_start, region_end;
 
-    uint32_t addrStart, addrEnd, address;
-    uint32_t remStart, remEnd;
-    uint32_t rowIdxStart, rowIdxEnd, rowNum;
-    uint8_t  buff[CY_FLASH_SIZEOF_ROW];
+    return ota_mem_erase_region(mem_type, addr, &region_start, &region_end);
+}
 
-    /* flash_area_write() uses offsets, we need absolute address here */
-    addr += CY_FLASH_BASE;
+/* Plans the next erase command of the range [*addr, end): aligns *addr down to the
+ * start of the command and returns the size it erases, 0 if the address can not be
+ * erased. Takes the largest erase unit that lies within the flash region and does
+ * not erase more than the sectors covering the range, so small sectors are only
+ * used where the region or the range ends.
+ */
+static uint32_t ota_mem_erase_plan( cy_ota_mem_type_t mem_type, uint32_t *addr, uint32_t end )
+{
+    uint32_t region_start, region_end;
+    uint32_t sector_size = ota_mem_erase_region(mem_type, *addr, &region_start, &region_end);
 
-    addrStart = addr;
-    addrEnd   = addrStart + size;
+    if (sector_size == 0u)
+    {
+        return 0;
+    }
+    *addr &= ~(sector_size - 1u);
 
-    /* find if area bounds are aligned to rows */
-    remStart = addrStart%CY_FLASH_SIZEOF_ROW;
-    remEnd   = addrEnd%CY_FLASH_SIZEOF_ROW;
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200) && (OTA_SMIF_BLOCK_ERASE_SIZE > 0))
+    if ((mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH) && (sector_size < OTA_SMIF_BLOCK_ERASE_SIZE) &&
+        ((*addr & (OTA_SMIF_BLOCK_ERASE_SIZE - 1u)) == 0u))
+    {
+        uint32_t block_end = *addr + OTA_SMIF_BLOCK_ERASE_SIZE;
+        uint32_t range_end = (end < region_end) ? end : region_end;
 
-    /* find which row numbers are affected for full Erase */
-    rowIdxStart = addrStart/CY_FLASH_SIZEOF_ROW;
-    rowIdxEnd   = addrEnd/CY_FLASH_SIZEOF_ROW;
-
-    if(remStart != 0)
-    {/* first row is fragmented, move to next */
-        rowIdxStart++;
+        /* The sectors covering the range within the region end on a sector boundary */
+        range_end = ((range_end - 1u) & ~(sector_size - 1u)) + sector_size;
+        if ((block_end <= region_end) && (block_end <= range_end))
+        {
+            return OTA_SMIF_BLOCK_ERASE_SIZE;
+        }
     }
+#else
+    (void)end;
+#endif
 
-    /* total number of rows for full erase */
-    rowNum = rowIdxEnd - rowIdxStart;
-    address = rowIdxStart*CY_FLASH_SIZEOF_ROW;
+    return sector_size;
+}
 
-    while(rowNum>0)
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+/*******************************************************************************
+* Function Name: ota_smif_wait_ready
+****************************************************************************//**
+*
+* Polls the memory device until it is ready to accept new commands or the
+* timeout expires. While the scheduler runs, the calling task sleeps between
+* the polls so the other tasks keep running during long erase operations.
+*
+* \param memConfig
+* memory device configuration
+*
+* \param timeout_ms
+* maximum time to wait in milliseconds
+*
+* \return Status of the operation.
+* CY_SMIF_SUCCESS        - Memory is ready to accept new commands.
+* CY_SMIF_EXCEED_TIMEOUT - Memory is busy.
+*
+*******************************************************************************/
+static cy_en_smif_status_t ota_smif_wait_ready(cy_stc_smif_mem_config_t const *memConfig, uint32_t timeout_ms)
+{
+    uint32_t waited_ms = 0;
+
+    while (Cy_SMIF_Memslot_IsBusy(SMIF0, (cy_stc_smif_mem_config_t* )memConfig, &ota_QSPI_context))
     {
-        rc = Cy_Flash_EraseRow(address);
-        assert(rc == 0);
-        address += CY_FLASH_SIZEOF_ROW;
-        rowNum--;
+        if (waited_ms >= timeout_ms)
+        {
+            return CY_SMIF_EXCEED_TIMEOUT;
+        }
+
+#if (OTA_SMIF_YIELD_WHILE_BUSY != 0)
+        if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+        {
+            vTaskDelay(pdMS_TO_TICKS(MEMORY_BUSY_CHECK_DELAY_MS));
+        }
+        else
+#endif
+        {
+            Cy_SysLib_Delay(MEMORY_BUSY_CHECK_DELAY_MS);
+        }
+        waited_ms += MEMORY_BUSY_CHECK_DELAY_MS;
     }
 
-    /* if Start of erase area is unaligned */
-    if(remStart != 0)
-    {
-        /* first row is fragmented, shift left by one*/
-        rowIdxStart--;
+    return CY_SMIF_SUCCESS;
+}
 
-        /* find start address of fragmented row */
-        address = rowIdxStart*CY_FLASH_SIZEOF_ROW;
+/* Stores the address as the device expects it, MSB first, returns the number of address bytes */
+CY_SECTION_RAMFUNC_BEGIN
+static uint32_t ota_smif_addr_bytes(cy_stc_smif_mem_config_t const *memConfig, uint32_t addr, uint8_t addr_buf[4])
+{
+    uint32_t num_addr_bytes = memConfig->deviceCfg->numOfAddrBytes;
+    uint32_t i;
 
-        /* store fragmented row contents first */
-        memcpy((void *)buff, (const void*)address, remStart);
+    for (i = 0; i < num_addr_bytes; i++)
+    {
+        addr_buf[i] = (uint8_t)(addr >> (8u * (num_addr_bytes - 1u - i)));
+    }
 
-        /* erase fragmented row */
-        rc = Cy_Flash_EraseRow(address);
-        assert(rc == 0);
+    return num_addr_bytes;
+}
+CY_SECTION_RAMFUNC_END
 
-        /* write stored back */
-        rc = psoc6_internal_flash_write(buff, address, remStart);
-        assert(rc == 0);
+#ifndef CY_XIP_SMIF_MODE_CHANGE
+/*******************************************************************************
+* Function Name: ota_smif_program
+****************************************************************************//**
+*
+* Programs len bytes at addr one page at a time. The data of a page is pushed
+* through the SMIF TX FIFO. The status is polled for OTA_SMIF_PROGRAM_POLL_US,
+* yielding to the tasks of the same priority between polls, then the task
+* sleeps one tick at a time until the device has programmed the page, instead
+* of spinning in Cy_SMIF_MemWrite(). The OTA download continues while the
+* flash service task waits for a slow page. Program commands
+* with a mode byte or dummy cycles, and writes before the scheduler is started,
+* use Cy_SMIF_MemWrite().
+*
+* \return Status of the operation. See cy_en_smif_status_t.
+*
+*******************************************************************************/
+static cy_en_smif_status_t ota_smif_program(cy_stc_smif_mem_config_t const *memConfig, uint32_t addr,
+                                            const uint8_t *data, uint32_t len)
+{
+    cy_stc_smif_mem_cmd_t const *programCmd = memConfig->deviceCfg->programCmd;
+    uint32_t page_size = memConfig->deviceCfg->programSize;
+    /* Twice the page program time of the device, at least one tick */
+    TickType_t timeout = pdMS_TO_TICKS((2u * memConfig->deviceCfg->programTime) / 1000u) + 1u;
+    cy_en_smif_status_t status = CY_SMIF_SUCCESS;
+
+    if ((programCmd->mode != CY_SMIF_NO_COMMAND_OR_MODE) || (programCmd->dummyCycles != 0u) ||
+        (page_size == 0u) || (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING))
+    {
+        return Cy_SMIF_MemWrite(SMIF0, memConfig, addr, data, len, &ota_QSPI_context);
     }
-    /* if End of erase area is unaligned */
-    if(remEnd != 0)
+
+    while ((status == CY_SMIF_SUCCESS) && (len > 0u))
     {
-        /* find start address of fragmented row */
-        address = rowIdxEnd*CY_FLASH_SIZEOF_ROW;
+        /* A page program wraps around at the end of the page */
+        uint32_t count = page_size - (addr % page_size);
+        uint8_t addr_buf[4];
+        uint32_t num_addr_bytes = ota_smif_addr_bytes(memConfig, addr, addr_buf);
+        TickType_t start;
+        uint32_t polled_us = 0;
+
+        if (count > len)
+        {
+            count = len;
+        }
 
-        /* store fragmented row contents first */
-        memcpy((void *)buff, (const void*)addrEnd, CY_FLASH_SIZEOF_ROW-remEnd);
+        status = Cy_SMIF_Memslot_CmdWriteEnable(SMIF0, memConfig, &ota_QSPI_context);
+        if (status == CY_SMIF_SUCCESS)
+        {
+            status = Cy_SMIF_TransmitCommand(SMIF0, (uint8_t)programCmd->command, programCmd->cmdWidth,
+                                             addr_buf, num_addr_bytes, programCmd->addrWidth,
+                                             memConfig->slaveSelect, CY_SMIF_TX_NOT_LAST_BYTE, &ota_QSPI_context);
+        }
+        if (status == CY_SMIF_SUCCESS)
+        {
+            status = Cy_SMIF_TransmitDataBlocking(SMIF0, data, count, programCmd->dataWidth, &ota_QSPI_context);
+        }
 
-        /* erase fragmented row */
-        rc = Cy_Flash_EraseRow(address);
-        assert(rc == 0);
+        start = xTaskGetTickCount();
+        while ((status == CY_SMIF_SUCCESS) &&
+               Cy_SMIF_Memslot_IsBusy(SMIF0, (cy_stc_smif_mem_config_t* )memConfig, &ota_QSPI_context))
+        {
+            if ((xTaskGetTickCount() - start) > timeout)
+            {
+                status = CY_SMIF_EXCEED_TIMEOUT;
+            }
+            else if (polled_us < OTA_SMIF_PROGRAM_POLL_US)
+            {
+                /* The page is usually programmed well within a tick */
+                taskYIELD();
+                Cy_SysLib_DelayUs(OTA_SMIF_PROGRAM_POLL_STEP_US);
+                polled_us += OTA_SMIF_PROGRAM_POLL_STEP_US;
+            }
+            else
+            {
+                /* Block, polling on would keep this task spinning when no other task is ready */
+                vTaskDelay(1u);
+            }
+        }
 
-        /* write stored back */
-        rc = psoc6_internal_flash_write(buff, addrEnd, CY_FLASH_SIZEOF_ROW-remEnd);
-        assert(rc == 0);
+        addr += count;
+        data += count;
+        len -= count;
     }
-    return rc;
+
+    return status;
 }
-#endif
+#endif /* !CY_XIP_SMIF_MODE_CHANGE */
 
-#if defined (XMC7200)
+/*******************************************************************************
+* Function Name: ota_smif_erase_start
+****************************************************************************//**
+*
+* Starts the erase of erase_size bytes at addr, with the sector erase command
+* of the region or with the block erase command OTA_SMIF_BLOCK_ERASE_CMD when
+* ota_mem_erase_plan() picked a block. Does not wait for the erase. Runs from
+* RAM, it is called with XIP off.
+*
+* \return Status of the operation. See cy_en_smif_status_t.
+*
+*******************************************************************************/
 CY_SECTION_RAMFUNC_BEGIN
-static int xmc_internal_flash_erase(uint32_t addr, size_t size)
+static cy_en_smif_status_t ota_smif_erase_start(cy_stc_smif_mem_config_t const *memConfig, uint32_t addr,
+                                                uint32_t erase_size, uint32_t sector_size)
 {
-    int rc                   = 0;
-    uint32_t row_addr        = 0u;
-    uint32_t erase_sz        = 0x8000U; //32KB
-    cy_en_flashdrv_status_t flashEraseStatus;
-
-    /* flash_area_write() uses offsets, we need absolute address here */
-    addr += CY_FLASH_BASE;
+    cy_en_smif_status_t status;
+    uint8_t addr_buf[4];
+    uint32_t num_addr_bytes = ota_smif_addr_bytes(memConfig, addr, addr_buf);
 
-    uintptr_t erase_end_addr = addr + size;
-    uint32_t row_start_addr  = (addr / erase_sz) * erase_sz;
-    uint32_t row_end_addr    = (erase_end_addr / erase_sz) * erase_sz;
-    uint32_t row_number      = (row_end_addr - row_start_addr) / erase_sz;
+    status = Cy_SMIF_Memslot_CmdWriteEnable(SMIF0, memConfig, &ota_QSPI_context);
+    if (status == CY_SMIF_SUCCESS)
+    {
+        if (erase_size == sector_size)
+        {
+            status = Cy_SMIF_Memslot_CmdSectorErase(SMIF0, memConfig, addr_buf, &ota_QSPI_context);
+        }
+        else
+        {
+            cy_stc_smif_mem_cmd_t const *eraseCmd = memConfig->deviceCfg->eraseCmd;
 
-    /* assume single row needs to be erased */
-    if (row_start_addr == row_end_addr) {
-        row_number = 1U;
+            status = Cy_SMIF_TransmitCommand(SMIF0, OTA_SMIF_BLOCK_ERASE_CMD, eraseCmd->cmdWidth,
+                                             addr_buf, num_addr_bytes, eraseCmd->addrWidth,
+                                             memConfig->slaveSelect, CY_SMIF_TX_LAST_BYTE, &ota_QSPI_context);
+        }
     }
 
-    Cy_Flash_Init();
-    Cy_Flashc_MainWriteEnable();
+    return status;
+}
+CY_SECTION_RAMFUNC_END
 
-    while (row_number != 0u) {
-        row_number--;
-        row_addr = row_start_addr + row_number * (uint32_t)erase_sz;
+#ifndef CY_XIP_SMIF_MODE_CHANGE
+/*******************************************************************************
+* Function Name: ota_smif_erase_wait
+****************************************************************************//**
+*
+* Erases the sectors covering [addr, addr + len), or the whole chip when
+* sector_erase is false. The commands are planned by ota_mem_erase_plan().
+* Each erase command is started and then waited for with ota_smif_wait_ready(),
+* instead of spinning inside the PDL.
+*
+* \return Status of the operation. See cy_en_smif_status_t.
+*
+*******************************************************************************/
+static cy_en_smif_status_t ota_smif_erase_wait(bool sector_erase, uint32_t addr, uint32_t len)
+{
+    cy_stc_smif_mem_config_t const *memConfig = smifBlockConfig.memConfig[MEM_SLOT];
+    cy_en_smif_status_t status = CY_SMIF_SUCCESS;
+    uint32_t end = addr + len;
 
-        flashEraseStatus = Cy_Flash_EraseSector((uint32_t) row_addr);
-        // Wait for completion with counting
-        while(Cy_Flash_IsOperationComplete() != CY_FLASH_DRV_SUCCESS)
+    if (!sector_erase)
+    {
+        status = Cy_SMIF_Memslot_CmdWriteEnable(SMIF0, memConfig, &ota_QSPI_context);
+        if (status == CY_SMIF_SUCCESS)
         {
+            status = Cy_SMIF_Memslot_CmdChipErase(SMIF0, memConfig, &ota_QSPI_context);
         }
-        if (flashEraseStatus != CY_FLASH_DRV_SUCCESS)
+        if (status == CY_SMIF_SUCCESS)
         {
-            rc = 1; /* BOOT_EFLASH */
-            break;
-        } else {
-            rc = 0;
+            status = ota_smif_wait_ready(memConfig, MEMORY_CHIP_ERASE_TIMEOUT_MS);
         }
+        return status;
     }
 
-    return rc;
-}
-CY_SECTION_RAMFUNC_END
-
-/*
- * Writes `len` bytes of flash memory at `off` from the buffer at `src`
- */
-CY_SECTION_RAMFUNC_BEGIN
-static int xmc_internal_flash_write(uint8_t data[], uint32_t address, size_t len)
-{
-    int retCode;
-    cy_en_flashdrv_status_t rc = CY_FLASH_DRV_SUCCESS;
+    do
+    {
+        uint32_t sector_size = ota_mem_erase_sector_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, addr);
+        uint32_t erase_size = ota_mem_erase_plan(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, &addr, end);
 
-    uint32_t writeBuffer[CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)];
-    uint32_t rowId;
-    uint32_t dstIndex;
-    uint32_t srcIndex = 0u;
-    uint32_t eeOffset;
-    uint32_t byteOffset;
-    uint32_t rowsNotEqual;
-    uint8_t *writeBufferPointer;
+        if (erase_size == 0u)
+        {
+            return CY_SMIF_BAD_PARAM;
+        }
 
-    eeOffset = (uint32_t)address;
-    writeBufferPointer = (uint8_t*)writeBuffer;
+        status = ota_smif_erase_start(memConfig, addr, erase_size, sector_size);
+        if (status == CY_SMIF_SUCCESS)
+        {
+            status = ota_smif_wait_ready(memConfig, MEMORY_BUSY_CHECK_RETRIES * MEMORY_BUSY_CHECK_DELAY_MS);
+        }
 
-    bool cond1;
+        addr += erase_size;
+    } while ((status == CY_SMIF_SUCCESS) && (addr < end));
 
-    /* Make sure, that varFlash[] points to Flash */
-    cond1 = ((eeOffset >= CY_FLASH_BASE) && ((eeOffset + len) <= (CY_FLASH_BASE + CY_FLASH_SIZE)));
+    return status;
+}
+#else
+/*******************************************************************************
+* Function Name: ota_smif_erase_sliced
+****************************************************************************//**
+*
+* Erases the sectors covering [addr, addr + len) while the code executes from
+* the same external flash. Each sector erase runs for at most
+* OTA_SMIF_ERASE_SLICE_US with XIP off, then it is suspended and XIP is turned
+* back on for a tick so interrupts and the other tasks are serviced, then the
+* erase is resumed. Runs from RAM, the external flash can not be read while
+* XIP is off.
+*
+* \return Status of the operation. See cy_en_smif_status_t.
+*
+*******************************************************************************/
+CY_SECTION_RAMFUNC_BEGIN
+static cy_en_smif_status_t ota_smif_erase_sliced(uint32_t addr, uint32_t len)
+{
+    cy_stc_smif_mem_config_t const *memConfig = smifBlockConfig.memConfig[MEM_SLOT];
+    cy_en_smif_status_t status = CY_SMIF_SUCCESS;
+    uint32_t slice_cycles = (SystemCoreClock / 1000000u) * OTA_SMIF_ERASE_SLICE_US;
+    uint32_t end = addr + len;
 
-    if(cond1)
+    while ((status == CY_SMIF_SUCCESS) && (addr < end))
     {
-        eeOffset -= CY_FLASH_BASE;
-        rowId = eeOffset / CY_FLASH_SIZEOF_ROW;
-        byteOffset = CY_FLASH_SIZEOF_ROW * rowId;
+        uint32_t sector_size = ota_mem_erase_sector_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, addr);
+        uint32_t erase_size = ota_mem_erase_plan(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, &addr, end);
+        bool started = false;
+        bool busy = true;
 
-        while((srcIndex < len) && (rc == CY_FLASH_DRV_SUCCESS))
+        if (erase_size == 0u)
         {
-            rowsNotEqual = 0u;
-            /* Copy data to the write buffer either from the source buffer or from the flash */
-            for(dstIndex = 0u; dstIndex < CY_FLASH_SIZEOF_ROW; dstIndex++)
+            return CY_SMIF_BAD_PARAM;
+        }
+
+        while ((status == CY_SMIF_SUCCESS) && busy)
+        {
+            /* Without the scheduler there is nothing to hand the time to, finish in one go */
+            bool suspend = (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+
             {
-                if((byteOffset >= eeOffset) && (srcIndex < len))
+                /* pre-access to SMIF */
+                PRE_SMIF_ACCESS_TURN_OFF_XIP;
+
+                if (!started)
                 {
-                    writeBufferPointer[dstIndex] = data[srcIndex];
-                    /* Detect that row programming is required */
-                    if((rowsNotEqual == 0u) && ( (CY_GET_REG8(CY_FLASH_BASE + byteOffset) != data[srcIndex]) ) )
-                    {
-                        rowsNotEqual = 1u;
-                    }
-                    srcIndex++;
+                    status = ota_smif_erase_start(memConfig, addr, erase_size, sector_size);
+                    started = true;
                 }
                 else
                 {
-                    writeBufferPointer[dstIndex] = CY_GET_REG8(CY_FLASH_BASE + byteOffset);
+                    status = Cy_SMIF_TransmitCommand(SMIF0, OTA_SMIF_ERASE_RESUME_CMD, CY_SMIF_WIDTH_SINGLE,
+                                                     NULL, CY_SMIF_CMD_WITHOUT_PARAM, CY_SMIF_WIDTH_SINGLE,
+                                                     memConfig->slaveSelect, CY_SMIF_TX_LAST_BYTE, &ota_QSPI_context);
                 }
-                byteOffset++;
-            }
 
-            if(rowsNotEqual != 0u)
-            {
-                rc = Cy_Flash_ProgramRow((rowId * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE, writeBuffer);
-                if(rc == CY_FLASH_DRV_SUCCESS)
+                if (status == CY_SMIF_SUCCESS)
                 {
-                    while(Cy_Flash_IsOperationComplete() != CY_FLASH_DRV_SUCCESS)
+                    uint32_t slice_start = DWT->CYCCNT;
+
+                    do
+                    {
+                        busy = Cy_SMIF_Memslot_IsBusy(SMIF0, (cy_stc_smif_mem_config_t* )memConfig, &ota_QSPI_context);
+                    } while (busy && (!suspend || ((DWT->CYCCNT - slice_start) < slice_cycles)));
+
+                    if (busy)
                     {
+                        /* An erase that completes meanwhile ignores the suspend, the next resume is ignored as well */
+                        status = Cy_SMIF_TransmitCommand(SMIF0, OTA_SMIF_ERASE_SUSPEND_CMD, CY_SMIF_WIDTH_SINGLE,
+                                                         NULL, CY_SMIF_CMD_WITHOUT_PARAM, CY_SMIF_WIDTH_SINGLE,
+                                                         memConfig->slaveSelect, CY_SMIF_TX_LAST_BYTE, &ota_QSPI_context);
+                        /* Suspend latency, the device accepts reads once it is no longer busy */
+                        while ((status == CY_SMIF_SUCCESS) &&
+                               Cy_SMIF_Memslot_IsBusy(SMIF0, (cy_stc_smif_mem_config_t* )memConfig, &ota_QSPI_context))
+                        {
+                        }
                     }
                 }
+
+                /* post-access to SMIF */
+                POST_SMIF_ACCESS_TURN_ON_XIP;
             }
 
-            /* Go to the next row */
-            rowId++;
+            if (busy && (status == CY_SMIF_SUCCESS))
+            {
+                /* XIP is back on, let the other tasks run before resuming */
+                vTaskDelay(1);
+            }
         }
-    }
-    else
-    {
-        rc = CY_FLASH_DRV_INVALID_INPUT_PARAMETERS;
-    }
-
-    /* Return error code */
-    switch(rc)
-    {
-        case CY_FLASH_DRV_SUCCESS:
-            retCode = 0;
-            break;
-
-        case CY_FLASH_DRV_INVALID_INPUT_PARAMETERS:
-        case CY_FLASH_DRV_INVALID_FLASH_ADDR:
-            retCode = 1;
-            break;
 
-        default:
-            retCode = 2;
-            break;
+        addr += erase_size;
     }
-    return(retCode);
+
+    return status;
 }
 CY_SECTION_RAMFUNC_END
-#endif /* XMC7200 */
+#endif /* CY_XIP_SMIF_MODE_CHANGE */
+#endif /* CY_IP_MXSMIF & !XMC7200 */
 
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
-static uint32_t ota_smif_get_memory_size(void)
+/* Starts measuring the longest XIP blackout of an erase or write */
+static void ota_xip_blackout_op_begin(void)
 {
-    uint32_t size = 0;
+#ifdef CY_XIP_SMIF_MODE_CHANGE
+    xip_op_max_cycles = 0;
+#endif
+}
 
-    if (SMIF0 != NULL)
+/* Records the longest XIP blackout of the erase or write that just finished */
+static void ota_xip_blackout_op_end(void)
+{
+#ifdef CY_XIP_SMIF_MODE_CHANGE
+    uint32_t cycles_per_us = SystemCoreClock / 1000000u;
+
+    xip_blackout.last_op_max_us = (cycles_per_us != 0u) ? (xip_op_max_cycles / cycles_per_us) : 0u;
+    if (xip_blackout.last_op_max_us > xip_blackout.max_us)
     {
-        size = smifBlockConfig.memConfig[MEM_SLOT]->deviceCfg->memSize;
+        xip_blackout.max_us = xip_blackout.last_op_max_us;
     }
-
-    return size;
+#endif
 }
-#endif /* CY_IP_MXSMIF & !XMC7200 */
-
-/**********************************************************************************************************************************
- * External Functions
- **********************************************************************************************************************************/
-/**
- * @brief Initializes flash, QSPI flash, or any other external memory type
- *
- * @return  CY_RSLT_SUCCESS on success
- *          CY_RSLT_TYPE_ERROR on failure
- */
-cy_rslt_t cy_ota_mem_init( void )
-{
-    cy_rslt_t result = CY_RSLT_SUCCESS;
 
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+#if defined(CY_IP_MXSMIF) && !defined(PSOC_062_1M) && !defined(XMC7200)
 #if defined(OTA_USE_EXTERNAL_FLASH)
-    cy_rslt_t smif_status = CY_SMIF_BAD_PARAM;    /* Does not return error if SMIF Quad fails */
-    bool QE_status = false;
-
+/*******************************************************************************
+* Function Name: IsMemoryReady
+****************************************************************************//**
+*
+* Polls the memory device to check whether it is ready to accept new commands or
+* not until either it is ready or the retries have exceeded the limit.
+*
+* \param memConfig
+* memory device configuration
+*
+* \return Status of the operation.
+* CY_SMIF_SUCCESS        - Memory is ready to accept new commands.
+* CY_SMIF_EXCEED_TIMEOUT - Memory is busy.
+*
+*******************************************************************************/
+static cy_en_smif_status_t IsMemoryReady(cy_stc_smif_mem_config_t const *memConfig)
+{
+    return ota_smif_wait_ready(memConfig, MEMORY_BUSY_CHECK_RETRIES * MEMORY_BUSY_CHECK_DELAY_MS);
+}
+
+/*******************************************************************************
+* Function Name: IsQuadEnabled
+****************************************************************************//**
+*
+* Checks whether QE (Quad Enable) bit is set or not in the configuration
+* register of the memory.
+*
+* \param memConfig
+* Memory device configuration
+*
+* \param isQuadEnabled
+* This parameter is updated to indicate whether Quad mode is enabled (true) or
+* not (false). The value is valid only when the function returns
+* CY_SMIF_SUCCESS.
+*
+* \return Status of the operation. See cy_en_smif_status_t.
+*
+*******************************************************************************/
+static cy_en_smif_status_t IsQuadEnabled(cy_stc_smif_mem_config_t const *memConfig, bool *isQuadEnabled)
+{
+    cy_en_smif_status_t status;
+    uint8_t readStatus = 0;
+    uint32_t statusCmd = memConfig->deviceCfg->readStsRegQeCmd->command;
+    uint8_t maskQE = (uint8_t) memConfig->deviceCfg->stsRegQuadEnableMask;
+
+    status = Cy_SMIF_Memslot_CmdReadSts(SMIF0, memConfig, &readStatus, statusCmd, &ota_QSPI_context);
+
+    *isQuadEnabled = false;
+    if(CY_SMIF_SUCCESS == status)
+    {
+        /* Check whether Quad mode is already enabled or not */
+        *isQuadEnabled = (maskQE == (readStatus & maskQE));
+    }
+
+    return status;
+}
+
+/*******************************************************************************
+* Function Name: EnableQuadMode
+****************************************************************************//**
+*
+* This function sets the QE (QUAD Enable) bit in the external memory
+* configuration register to enable Quad SPI mode.
+*
+* \param memConfig
+* Memory device configuration
+*
+* \return Status of the operation. See cy_en_smif_status_t.
+*
+*******************************************************************************/
+static cy_en_smif_status_t EnableQuadMode(cy_stc_smif_mem_config_t const *memConfig)
+{
+    cy_en_smif_status_t status;
+
+    /* Send Write Enable to external memory */
+    status = Cy_SMIF_Memslot_CmdWriteEnable(SMIF0, smifMemConfigs[0], &ota_QSPI_context);
+
+    if(CY_SMIF_SUCCESS == status)
+    {
+        status = Cy_SMIF_Memslot_QuadEnable(SMIF0, (cy_stc_smif_mem_config_t* )memConfig, &ota_QSPI_context);
+
+        if(CY_SMIF_SUCCESS == status)
+        {
+            /* Poll memory for the completion of operation */
+            status = IsMemoryReady(memConfig);
+        }
+    }
+
+    return status;
+}
+#endif /* OTA_USE_EXTERNAL_FLASH */
+#endif /* CY_IP_MXSMIF & !PSOC_062_1M & !XMC7200 */
+
+#if !(defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
+/*
+ * Waits for the internal flash operation in progress to complete. While the
+ * scheduler runs the calling task sleeps between the checks, so the network
+ * tasks keep running during a program or erase.
+ */
+#if defined (XMC7200)
+CY_SECTION_RAMFUNC_BEGIN
+#endif
+static cy_en_flashdrv_status_t internal_flash_wait_complete(void)
+{
+    cy_en_flashdrv_status_t status;
+
+    while ((status = Cy_Flash_IsOperationComplete()) == CY_FLASH_DRV_OPCODE_BUSY)
+    {
+#if (OTA_FLASH_YIELD_WHILE_BUSY != 0)
+        if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+        {
+            vTaskDelay((pdMS_TO_TICKS(OTA_FLASH_BUSY_POLL_MS) > 0u) ? pdMS_TO_TICKS(OTA_FLASH_BUSY_POLL_MS) : 1u);
+        }
+#endif
+    }
+
+    return status;
+}
+#if defined (XMC7200)
+CY_SECTION_RAMFUNC_END
+#endif
+
+/*
+ * Builds the row image to program at `row_addr`: `count` bytes from `src` at
+ * offset `first`, the rest of the row from the current flash content.
+ * Copies and compares in 32-bit words. Returns the row to program, or NULL
+ * if the flash holds it already and programming can be skipped. A whole row
+ * of word-aligned data in RAM is compared and programmed in place, without
+ * a copy to `row_buf`.
+ */
+#if defined (XMC7200)
+CY_SECTION_RAMFUNC_BEGIN
+#endif
+static const uint32_t *internal_flash_prepare_row(uint32_t row_buf[], uint32_t row_addr, uint32_t first,
+                                                  const uint8_t src[], uint32_t count)
+{
+    const volatile uint32_t *flash_words = (const volatile uint32_t *)row_addr;
+    uint8_t *row_bytes = (uint8_t *)row_buf;
+    uint32_t src_addr = (uint32_t)(uintptr_t)src;
+    uint32_t i;
+
+    if ((count == CY_FLASH_SIZEOF_ROW) && ((src_addr & (sizeof(uint32_t) - 1u)) == 0u) &&
+        ((src_addr < CY_FLASH_BASE) || (src_addr >= (CY_FLASH_BASE + CY_FLASH_SIZE))))
+    {
+        const uint32_t *src_words = (const uint32_t *)(const void *)src;
+
+        for (i = 0u; i < (CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)); i++)
+        {
+            if (src_words[i] != flash_words[i])
+            {
+                return src_words;
+            }
+        }
+        return NULL;
+    }
+
+    /* Only a partial row needs the flash content around the new data */
+    if (count != CY_FLASH_SIZEOF_ROW)
+    {
+        for (i = 0u; i < (CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)); i++)
+        {
+            row_buf[i] = flash_words[i];
+        }
+    }
+
+    if ((((uint32_t)(uintptr_t)src | first | count) & (sizeof(uint32_t) - 1u)) == 0u)
+    {
+        const uint32_t *src_words = (const uint32_t *)(const void *)src;
+
+        for (i = 0u; i < (count / sizeof(uint32_t)); i++)
+        {
+            row_buf[(first / sizeof(uint32_t)) + i] = src_words[i];
+        }
+    }
+    else
+    {
+        for (i = 0u; i < count; i++)
+        {
+            row_bytes[first + i] = src[i];
+        }
+    }
+
+    for (i = 0u; i < (CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)); i++)
+    {
+        if (row_buf[i] != flash_words[i])
+        {
+            return row_buf;
+        }
+    }
+
+    return NULL;
+}
+#if defined (XMC7200)
+CY_SECTION_RAMFUNC_END
+#endif
+#endif /* !CYW20829 */
+
+#if !(defined (CYW20829A0LKML) || defined (CYW20829B0LKML) || defined (XMC7200))
+static int psoc6_internal_flash_write(uint8_t data[], uint32_t address, size_t len)
+{
+    int retCode;
+    cy_en_flashdrv_status_t rc = CY_FLASH_DRV_SUCCESS;
+
+    uint32_t writeBuffer[CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)];
+    uint32_t rowId;
+    uint32_t srcIndex = 0u;
+    uint32_t eeOffset;
+    uint32_t rowOffset;
+    uint32_t rowBytes;
+    const uint32_t *rowData;
+
+    eeOffset = (uint32_t)address;
+
+    bool cond1;
+
+    /* Make sure, that varFlash[] points to Flash */
+    cond1 = ((eeOffset >= CY_FLASH_BASE) && ((eeOffset + len) <= (CY_FLASH_BASE + CY_FLASH_SIZE)));
+
+    if(cond1)
+    {
+        eeOffset -= CY_FLASH_BASE;
+        rowId = eeOffset / CY_FLASH_SIZEOF_ROW;
+        rowOffset = eeOffset % CY_FLASH_SIZEOF_ROW;
+
+        while((srcIndex < len) && (rc == CY_FLASH_DRV_SUCCESS))
+        {
+            rowBytes = CY_FLASH_SIZEOF_ROW - rowOffset;
+            if(rowBytes > (len - srcIndex))
+            {
+                rowBytes = len - srcIndex;
+            }
+
+            /* Build the row from the source buffer and the flash, detect that row programming is required */
+            rowData = internal_flash_prepare_row(writeBuffer, (rowId * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE,
+                                                 rowOffset, &data[srcIndex], rowBytes);
+            srcIndex += rowBytes;
+            rowOffset = 0u;
+
+            if(rowData != NULL)
+            {
+                /* Write flash row */
+#if (OTA_FLASH_YIELD_WHILE_BUSY != 0)
+                rc = Cy_Flash_StartWrite((rowId * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE, rowData);
+                if(rc == CY_FLASH_DRV_OPERATION_STARTED)
+                {
+                    rc = internal_flash_wait_complete();
+                }
+#else
+                rc = Cy_Flash_WriteRow((rowId * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE, rowData);
+#endif
+                write_call_counters.rows_programmed++;
+                write_call_counters.bytes_programmed += CY_FLASH_SIZEOF_ROW;
+            }
+            else
+            {
+                write_call_counters.rows_skipped++;
+            }
+
+            /* Go to the next row */
+            rowId++;
+        }
+    }
+    else
+    {
+        rc = CY_FLASH_DRV_INVALID_INPUT_PARAMETERS;
+    }
+
+    /* Return error code */
+    switch(rc)
+    {
+        case CY_FLASH_DRV_SUCCESS:
+            retCode = 0;
+            break;
+
+        case CY_FLASH_DRV_INVALID_INPUT_PARAMETERS:
+        case CY_FLASH_DRV_INVALID_FLASH_ADDR:
+            retCode = 1;
+            break;
+
+        default:
+            retCode = 2;
+            break;
+    }
+    return(retCode);
+}
+
+static cy_en_flashdrv_status_t psoc6_internal_flash_erase_row(uint32_t address)
+{
+#if (OTA_FLASH_YIELD_WHILE_BUSY != 0)
+    cy_en_flashdrv_status_t rc = Cy_Flash_StartEraseRow(address);
+
+    if(rc == CY_FLASH_DRV_OPERATION_STARTED)
+    {
+        rc = internal_flash_wait_complete();
+    }
+    return rc;
+#else
+    return Cy_Flash_EraseRow(address);
+#endif
+}
+
+static int psoc6_internal_flash_erase(uint32_t addr, size_t size)
+{
+    int rc = 0;
+
+    uint32_t addrStart, addrEnd, address;
+    uint32_t remStart, remEnd;
+    uint32_t rowIdxStart, rowIdxEnd, rowNum;
+    uint8_t  buff[CY_FLASH_SIZEOF_ROW];
+
+    /* flash_area_write() uses offsets, we need absolute address here */
+    addr += CY_FLASH_BASE;
+
+    addrStart = addr;
+    addrEnd   = addrStart + size;
+
+    /* find if area bounds are aligned to rows */
+    remStart = addrStart%CY_FLASH_SIZEOF_ROW;
+    remEnd   = addrEnd%CY_FLASH_SIZEOF_ROW;
+
+    /* find which row numbers are affected for full Erase */
+    rowIdxStart = addrStart/CY_FLASH_SIZEOF_ROW;
+    rowIdxEnd   = addrEnd/CY_FLASH_SIZEOF_ROW;
+
+    if(remStart != 0)
+    {/* first row is fragmented, move to next */
+        rowIdxStart++;
+    }
+
+    /* total number of rows for full erase */
+    rowNum = rowIdxEnd - rowIdxStart;
+    address = rowIdxStart*CY_FLASH_SIZEOF_ROW;
+
+    while(rowNum>0)
+    {
+        rc = psoc6_internal_flash_erase_row(address);
+        assert(rc == 0);
+        address += CY_FLASH_SIZEOF_ROW;
+        rowNum--;
+    }
+
+    /* if Start of erase area is unaligned */
+    if(remStart != 0)
+    {
+        /* first row is fragmented, shift left by one*/
+        rowIdxStart--;
+
+        /* find start address of fragmented row */
+        address = rowIdxStart*CY_FLASH_SIZEOF_ROW;
+
+        /* store fragmented row contents first */
+        memcpy((void *)buff, (const void*)address, remStart);
+
+        /* erase fragmented row */
+        rc = psoc6_internal_flash_erase_row(address);
+        assert(rc == 0);
+
+        /* write stored back */
+        rc = psoc6_internal_flash_write(buff, address, remStart);
+        assert(rc == 0);
+    }
+    /* if End of erase area is unaligned */
+    if(remEnd != 0)
+    {
+        /* find start address of fragmented row */
+        address = rowIdxEnd*CY_FLASH_SIZEOF_ROW;
+
+        /* store fragmented row contents first */
+        memcpy((void *)buff, (const void*)addrEnd, CY_FLASH_SIZEOF_ROW-remEnd);
+
+        /* erase fragmented row */
+        rc = psoc6_internal_flash_erase_row(address);
+        assert(rc == 0);
+
+        /* write stored back */
+        rc = psoc6_internal_flash_write(buff, addrEnd, CY_FLASH_SIZEOF_ROW-remEnd);
+        assert(rc == 0);
+    }
+    return rc;
+}
+#endif
+
+#if defined (XMC7200)
+CY_SECTION_RAMFUNC_BEGIN
+static int xmc_internal_flash_erase(uint32_t addr)
+{
+    cy_en_flashdrv_status_t flashEraseStatus;
+
+    Cy_Flash_Init();
+    Cy_Flashc_MainWriteEnable();
+    Cy_Flashc_WorkWriteEnable();
+
+    /* flash_area_write() uses offsets, we need absolute address here */
+    flashEraseStatus = Cy_Flash_EraseSector(CY_FLASH_BASE + addr);
+    if (flashEraseStatus == CY_FLASH_DRV_SUCCESS)
+    {
+        flashEraseStatus = internal_flash_wait_complete();
+    }
+
+    return (flashEraseStatus == CY_FLASH_DRV_SUCCESS) ? 0 : 1; /* BOOT_EFLASH */
+}
+CY_SECTION_RAMFUNC_END
+
+/*
+ * Writes `len` bytes of flash memory at `off` from the buffer at `src`
+ */
+CY_SECTION_RAMFUNC_BEGIN
+static int xmc_internal_flash_write(uint8_t data[], uint32_t address, size_t len)
+{
+    int retCode;
+    cy_en_flashdrv_status_t rc = CY_FLASH_DRV_SUCCESS;
+
+    uint32_t writeBuffer[CY_FLASH_SIZEOF_ROW / sizeof(uint32_t)];
+    uint32_t rowId;
+    uint32_t srcIndex = 0u;
+    uint32_t eeOffset;
+    uint32_t rowOffset;
+    uint32_t rowBytes;
+    const uint32_t *rowData;
+
+    eeOffset = (uint32_t)address;
+
+    bool cond1;
+
+    /* Make sure, that varFlash[] points to Flash */
+    cond1 = ((eeOffset >= CY_FLASH_BASE) && ((eeOffset + len) <= (CY_FLASH_BASE + CY_FLASH_SIZE)));
+
+    if(cond1)
+    {
+        eeOffset -= CY_FLASH_BASE;
+        rowId = eeOffset / CY_FLASH_SIZEOF_ROW;
+        rowOffset = eeOffset % CY_FLASH_SIZEOF_ROW;
+
+        while((srcIndex < len) && (rc == CY_FLASH_DRV_SUCCESS))
+        {
+            rowBytes = CY_FLASH_SIZEOF_ROW - rowOffset;
+            if(rowBytes > (len - srcIndex))
+            {
+                rowBytes = len - srcIndex;
+            }
+
+            /* Build the row from the source buffer and the flash, detect that row programming is required */
+            rowData = internal_flash_prepare_row(writeBuffer, (rowId * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE,
+                                                 rowOffset, &data[srcIndex], rowBytes);
+            srcIndex += rowBytes;
+            rowOffset = 0u;
+
+            if(rowData != NULL)
+            {
+                rc = Cy_Flash_ProgramRow((rowId * CY_FLASH_SIZEOF_ROW) + CY_FLASH_BASE, rowData);
+                if(rc == CY_FLASH_DRV_SUCCESS)
+                {
+                    rc = internal_flash_wait_complete();
+                }
+                write_call_counters.rows_programmed++;
+                write_call_counters.bytes_programmed += CY_FLASH_SIZEOF_ROW;
+            }
+            else
+            {
+                write_call_counters.rows_skipped++;
+            }
+
+            /* Go to the next row */
+            rowId++;
+        }
+    }
+    else
+    {
+        rc = CY_FLASH_DRV_INVALID_INPUT_PARAMETERS;
+    }
+
+    /* Return error code */
+    switch(rc)
+    {
+        case CY_FLASH_DRV_SUCCESS:
+            retCode = 0;
+            break;
+
+        case CY_FLASH_DRV_INVALID_INPUT_PARAMETERS:
+        case CY_FLASH_DRV_INVALID_FLASH_ADDR:
+            retCode = 1;
+            break;
+
+        default:
+            retCode = 2;
+            break;
+    }
+    return(retCode);
+}
+CY_SECTION_RAMFUNC_END
+#endif /* XMC7200 */
+
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+static uint32_t ota_smif_get_memory_size(void)
+{
+    uint32_t size = 0;
+
+    if (SMIF0 != NULL)
+    {
+        size = smifBlockConfig.memConfig[MEM_SLOT]->deviceCfg->memSize;
+    }
+
+    return size;
+}
+#endif /* CY_IP_MXSMIF & !XMC7200 */
+
+/**********************************************************************************************************************************
+ * External Functions
+ **********************************************************************************************************************************/
+/**
+ * @brief Initializes flash, QSPI flash, or any other external memory type
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_init( void )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if (session_mutex == NULL)
+    {
+        session_mutex = xSemaphoreCreateRecursiveMutex();
+        if (session_mutex == NULL)
+        {
+            return CY_RSLT_TYPE_ERROR;
+        }
+    }
+
+    /* The cycle counter times the flash operations and how long XIP is off */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+#if defined(OTA_USE_EXTERNAL_FLASH)
+    cy_rslt_t smif_status = CY_SMIF_BAD_PARAM;    /* Does not return error if SMIF Quad fails */
+    bool QE_status = false;
+
+    /* pre-access to SMIF */
+    PRE_SMIF_ACCESS_TURN_OFF_XIP;
+
+#if (defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
+    /* SMIF is already initialized for 20829 so we are only initializing the
+     * SMIF base address and the context variables.
+     */
+    smif_status = Cy_SMIF_Init(SMIF0, &ota_SMIF_config, TIMEOUT_1_MS, &ota_QSPI_context);
+    if (smif_status != CY_SMIF_SUCCESS)
+    {
+        result = smif_status;
+        goto _bail;
+    }
+#endif
+
+    /* Set up SMIF */
+    Cy_SMIF_SetDataSelect(SMIF0, smifMemConfigs[0]->slaveSelect, smifMemConfigs[0]->dataSelect);
+    Cy_SMIF_Enable(SMIF0, &ota_QSPI_context);
+
+    /* Map memory device to memory map */
+    smif_status = Cy_SMIF_Memslot_Init(SMIF0, &smifBlockConfig, &ota_QSPI_context);
+    if (smif_status != CY_SMIF_SUCCESS)
+    {
+        result = smif_status;
+        goto _bail;
+    }
+
+#if (OTA_SMIF_MEMORY_MAPPED_READ != 0) && !defined (CY_XIP_SMIF_MODE_CHANGE)
+    /* Memory-mapped reads go through the SMIF cache, with XIP it is enabled by the boot code */
+    (void)Cy_SMIF_CacheEnable(SMIF0, CY_SMIF_CACHE_BOTH);
+    (void)Cy_SMIF_CachePrefetchingEnable(SMIF0, CY_SMIF_CACHE_BOTH);
+#endif
+
+#if (defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
+    /* Even after SFDP enumeration QE command is not initialized */
+    /* So, it should be 1.0 device */
+    if ((smifMemConfigs[0]->deviceCfg->readStsRegQeCmd->command == 0) ||                        /* 0 - if configurator generated code */
+        (smifMemConfigs[0]->deviceCfg->readStsRegQeCmd->command == CY_SMIF_NO_COMMAND_OR_MODE)) /* 0xFF's if SFDP enumerated          */
+    {
+        smif_status = Cy_SMIF_MemInitSfdpMode(SMIF0,
+                                              smifMemConfigs[0],
+                                              CY_SMIF_WIDTH_QUAD,
+                                              CY_SMIF_SFDP_QER_1,
+                                              &ota_QSPI_context);
+        if (smif_status != CY_SMIF_SUCCESS)
+        {
+            result = smif_status;
+            goto _bail;
+        }
+    }
+#else /* NON - CYW20829A0LKML/CYW20829B0LKML */
+    #if !defined(CY_RUN_CODE_FROM_XIP) && (OTA_USE_EXTERNAL_FLASH)
+        {
+            /* Choose SMIF slot number (slave select).
+             * Acceptable values are:
+             * 0 - SMIF disabled (no external memory);
+             * 1, 2, 3 or 4 - slave select line memory module is connected to.
+             */
+    #define SMIF_ID         (1U) /* Assume SlaveSelect_0 is used for External Memory */
+    #include "flash_qspi.h"
+            cy_en_smif_status_t qspi_status = CY_SMIF_SUCCESS;
+            qspi_status = qspi_init_sfdp(SMIF_ID);
+            if(CY_SMIF_SUCCESS == qspi_status)
+            {
+                result = CY_RSLT_SUCCESS;
+            }
+            else
+            {
+                result = CY_RSLT_TYPE_ERROR;
+            }
+        }
+    #endif /* ! CY_RUN_CODE_FROM_XIP */
+#endif /* CYW20829A0LKML/CYW20829B0LKML */
+
+    smif_status = IsQuadEnabled(smifMemConfigs[0], &QE_status);
+    if(smif_status != CY_RSLT_SUCCESS)
+    {
+        result = CY_RSLT_TYPE_ERROR;
+    }
+
+    /* If not enabled, enable quad mode */
+    if(!QE_status)
+    {
+        /* Enable Quad mode */
+        smif_status = EnableQuadMode(smifMemConfigs[0]);
+        if(smif_status != CY_RSLT_SUCCESS)
+        {
+            result = CY_RSLT_TYPE_ERROR;
+        }
+    }
+
+    SET_FLAG(FLAG_HAL_INIT_DONE);
+
+  _bail:
+    /* post-access to SMIF */
+    POST_SMIF_ACCESS_TURN_ON_XIP;
+#endif
+#endif /* CY_IP_MXSMIF & !XMC7200 */
+    return result;
+}
+
+/* Reads the memory without looking at the rows pending in the write-combining buffer */
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+/* Marks a range of the external flash as being programmed or erased */
+static void ota_smif_busy_begin( uint32_t addr, uint32_t len )
+{
+    smif_busy_start = addr;
+    smif_busy_end   = addr + len;
+}
+
+/* Ends the program or erase, the SMIF cache may now hold outdated data */
+static void ota_smif_busy_end( void )
+{
+    smif_busy_start  = 0;
+    smif_busy_end    = 0;
+    smif_cache_stale = true;
+}
+
+/* Returns true if the range can be read from the memory-mapped window */
+static bool ota_smif_can_read_mapped( uint32_t addr, uint32_t len )
+{
+#if (OTA_SMIF_MEMORY_MAPPED_READ != 0)
+    cy_stc_smif_mem_config_t const *memConfig = smifBlockConfig.memConfig[MEM_SLOT];
+
+    return ((memConfig->flags & CY_SMIF_FLAG_MEMORY_MAPPED) != 0u) &&
+           ((addr + len) <= memConfig->memMappedSize) &&
+           ((addr >= smif_busy_end) || ((addr + len) <= smif_busy_start));
+#else
+    (void)addr;
+    (void)len;
+    return false;
+#endif
+}
+
+/*******************************************************************************
+* Function Name: ota_smif_read_mapped
+****************************************************************************//**
+*
+* Reads the external flash through the memory-mapped window, so the SMIF cache
+* and prefetch serve the read. When the code executes from the external flash
+* the SMIF is in memory mode already, otherwise it is switched to memory mode
+* for the copy.
+*
+*******************************************************************************/
+static void ota_smif_read_mapped( uint32_t addr, void *data, size_t len )
+{
+    cy_stc_smif_mem_config_t const *memConfig = smifBlockConfig.memConfig[MEM_SLOT];
+
+#ifndef CY_XIP_SMIF_MODE_CHANGE
+    while(Cy_SMIF_BusyCheck(SMIF0));
+    (void)Cy_SMIF_SetMode(SMIF0, CY_SMIF_MEMORY);
+#endif
+
+    if (smif_cache_stale)
+    {
+        (void)Cy_SMIF_CacheInvalidate(SMIF0, CY_SMIF_CACHE_BOTH);
+        smif_cache_stale = false;
+    }
+    memcpy(data, (const void *)(memConfig->baseAddress + addr), len);
+
+#ifndef CY_XIP_SMIF_MODE_CHANGE
+    (void)Cy_SMIF_SetMode(SMIF0, CY_SMIF_NORMAL);
+#endif
+}
+
+/* Reads the external flash in command mode with XIP off */
+static cy_en_smif_status_t ota_smif_read_command( uint32_t addr, void *data, size_t len )
+{
+    cy_en_smif_status_t cy_smif_result;
+
     /* pre-access to SMIF */
     PRE_SMIF_ACCESS_TURN_OFF_XIP;
 
-#if (defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
-    /* SMIF is already initialized for 20829 so we are only initializing the
-     * SMIF base address and the context variables.
-     */
-    smif_status = Cy_SMIF_Init(SMIF0, &ota_SMIF_config, TIMEOUT_1_MS, &ota_QSPI_context);
-    if (smif_status != CY_SMIF_SUCCESS)
+    cy_smif_result = Cy_SMIF_MemRead(SMIF0, smifBlockConfig.memConfig[MEM_SLOT],
+            addr, data, len, &ota_QSPI_context);
+    /* post-access to SMIF */
+    POST_SMIF_ACCESS_TURN_ON_XIP;
+
+    return cy_smif_result;
+}
+#endif /* CY_IP_MXSMIF & !XMC7200 */
+
+static cy_rslt_t ota_mem_read_flash( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if( mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH )
+    {
+#if !(defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
+        /* flash_area_read() uses offsets, we need absolute address here */
+        addr += CY_FLASH_BASE;
+
+        /* flash read by simple memory copying */
+        memcpy((void *)data, (const void*)addr, (size_t)len);
+        return result;
+#else
+        (void)result;
+        printf("%s() READ not supported for memory type %d\n", __func__, (int)mem_type);
+        return CY_RSLT_TYPE_ERROR;
+#endif
+    }
+    else if( mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH )
+    {
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+        cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
+        if (addr >= CY_SMIF_BASE_MEM_OFFSET)
+        {
+            addr -= CY_SMIF_BASE_MEM_OFFSET;
+        }
+
+        if (IS_FLAG_SET(FLAG_HAL_INIT_DONE))
+        {
+            if (ota_smif_can_read_mapped(addr, len))
+            {
+                ota_smif_read_mapped(addr, data, len);
+            }
+            else
+            {
+                cy_smif_result = ota_smif_read_command(addr, data, len);
+            }
+        }
+
+        return (cy_smif_result == CY_SMIF_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+#else
+        return CY_RSLT_TYPE_ERROR;
+#endif /* CY_IP_MXSMIF & !XMC7200 */
+    }
+    else
+    {
+        printf("%s() READ not supported for memory type %d\n", __func__, (int)mem_type);
+        return CY_RSLT_TYPE_ERROR;
+    }
+}
+
+static cy_rslt_t ota_mem_program_flash( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if( mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH )
+    {
+#if !(defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
+        int rc = 0;
+
+        /* flash_area_write() uses offsets, we need absolute address here */
+        addr += CY_FLASH_BASE;
+
+#if defined (XMC7200)
+        rc = xmc_internal_flash_write((uint8_t *)data, addr, len);
+        if (rc != 0 )
+        {
+            printf("xmc_internal_flash_write(0x%08x, 0x%08x, %u) FAILED rc:%u\n", (unsigned int)data, (unsigned int)addr, len, rc);
+            result = CY_RSLT_TYPE_ERROR;
+        }
+        return result;
+#else
+        rc = psoc6_internal_flash_write((uint8_t *)data, addr, len);
+        if (rc != 0 )
+        {
+            result = CY_RSLT_TYPE_ERROR;
+        }
+        return result;
+#endif
+
+#else
+        (void)result;
+        printf("%s() Write not supported for memory type %d\n", __func__, (int)mem_type);
+        return CY_RSLT_TYPE_ERROR;
+#endif
+    }
+    else if( mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH )
+    {
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+        cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
+
+        if (addr >= CY_SMIF_BASE_MEM_OFFSET)
+        {
+            addr -= CY_SMIF_BASE_MEM_OFFSET;
+        }
+
+        if (IS_FLAG_SET(FLAG_HAL_INIT_DONE))
+        {
+            cy_stc_smif_mem_config_t const *memConfig = smifBlockConfig.memConfig[MEM_SLOT];
+            uint32_t page_size = memConfig->deviceCfg->programSize;
+            uint8_t *curr_src = (uint8_t *)data;
+            size_t bytes_left = len;
+
+            if (page_size == 0u)
+            {
+                page_size = CY_FLASH_SIZEOF_ROW;
+            }
+
+            ota_smif_busy_begin(addr, len);
+
+            /* NOR flash programs any number of bytes within a page and leaves the other
+             * bytes of the page erased, so the data is programmed as it is, without
+             * reading the flash back. Within a flash session consecutive pages share
+             * an XIP-off window, so only RAM resident code runs in the loop.
+             */
+            while ((bytes_left > 0) && (cy_smif_result == CY_SMIF_SUCCESS))
+            {
+                size_t page_len = page_size - (addr % page_size);
+
+                if (page_len > bytes_left)
+                {
+                    page_len = bytes_left;
+                }
+
+                /* pre-access to SMIF */
+                ota_xip_window_enter();
+
+#ifdef CY_XIP_SMIF_MODE_CHANGE
+                cy_smif_result = Cy_SMIF_MemWrite(SMIF0, memConfig, addr, curr_src, page_len, &ota_QSPI_context);
+#else
+                cy_smif_result = ota_smif_program(memConfig, addr, curr_src, page_len);
+#endif
+                write_call_counters.pages_programmed++;
+                write_call_counters.bytes_programmed += page_len;
+
+                /* post-access to SMIF */
+                ota_xip_window_leave(false);
+
+                addr += page_len;
+                curr_src += page_len;
+                bytes_left -= page_len;
+            }
+            ota_xip_window_leave(true);
+
+            ota_smif_busy_end();
+        }
+        else
+        {
+            cy_smif_result = (cy_en_smif_status_t)CY_RSLT_SERIAL_FLASH_ERR_NOT_INITED;
+        }
+
+    #ifdef READBACK_SMIF_WRITE_TEST
+        if (cy_smif_result == CY_SMIF_SUCCESS)
+        {
+            if (ota_mem_read(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, addr, read_back_test, ((16 < length) ? 16 : len)) == CY_RSLT_SUCCESS)
+            {
+                int i;
+                for (i=0; (i<16 && i<len); i++)
+                {
+                    if(data[i] != read_back_test[i])
+                    {
+                        result  = -1;
+                    }
+                }
+            }
+        }
+    #endif
+
+        return (cy_smif_result == CY_SMIF_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+#else
+        return CY_RSLT_TYPE_ERROR;
+#endif /* CY_IP_MXSMIF & !XMC7200 */
+    }
+    else
     {
-        result = smif_status;
-        goto _bail;
+        printf("%s() Write not supported for memory type %d\n", __func__, (int)mem_type);
+        return CY_RSLT_TYPE_ERROR;
+    }
+}
+
+static cy_rslt_t ota_mem_erase_flash( cy_ota_mem_type_t mem_type, uint32_t addr, size_t len )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if( mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH )
+    {
+#if !(defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
+        int rc = 0;
+
+#if defined (XMC7200)
+        uint32_t end = addr + len;
+        uint32_t erase_sz;
+
+        /* One sector erase per sector, the sector size depends on the flash region.
+         * The sectors are planned here, xmc_internal_flash_erase() runs from RAM
+         * and only erases them.
+         */
+        do {
+            erase_sz = ota_mem_erase_plan(CY_OTA_MEM_TYPE_INTERNAL_FLASH, &addr, end);
+            rc = (erase_sz == 0u) ? 1 : xmc_internal_flash_erase(addr);
+            addr += erase_sz;
+        } while ((rc == 0) && (addr < end));
+
+        if (rc != 0 )
+        {
+            printf("xmc_internal_flash_erase(0x%08x, %u) FAILED rc:%d\n", (unsigned int)addr, len, rc);
+            result = CY_RSLT_TYPE_ERROR;
+        }
+#else
+        rc = psoc6_internal_flash_erase(addr, len);
+        if (rc != 0 )
+        {
+            result = CY_RSLT_TYPE_ERROR;
+        }
+#endif
+        return result;
+#else
+        (void)result;
+        printf("%s() Erase not supported for memory type %d\n", __func__, (int)mem_type);
+        return CY_RSLT_TYPE_ERROR;
+#endif
+    }
+    else if( mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH )
+    {
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+        cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
+
+        if (addr >= CY_SMIF_BASE_MEM_OFFSET)
+        {
+            addr -= CY_SMIF_BASE_MEM_OFFSET;
+        }
+
+        if (IS_FLAG_SET(FLAG_HAL_INIT_DONE))
+        {
+            ota_xip_blackout_op_begin();
+            ota_smif_busy_begin(addr, len);
+#if defined (CY_XIP_SMIF_MODE_CHANGE)
+            if ((addr == 0u) && (len == ota_smif_get_memory_size()))
+            {
+                /* pre-access to SMIF */
+                PRE_SMIF_ACCESS_TURN_OFF_XIP;
+
+                cy_smif_result = Cy_SMIF_MemEraseChip(SMIF0,
+                                                    smifBlockConfig.memConfig[MEM_SLOT],
+                                                    &ota_QSPI_context);
+
+                /* post-access to SMIF */
+                POST_SMIF_ACCESS_TURN_ON_XIP;
+            }
+            else
+            {
+                /* Suspend the erase in slices so the code executing from the external flash keeps running */
+                cy_smif_result = ota_smif_erase_sliced(addr, len);
+            }
+#else
+            /* If the erase is for the entire chip, use chip erase command. Otherwise one command
+             * per planned sector or block, Cy_SMIF_MemEraseSector() needs the range aligned to
+             * the sector size of one region and polls for the whole erase.
+             */
+            cy_smif_result = ota_smif_erase_wait(!((addr == 0u) && (len == ota_smif_get_memory_size())), addr, len);
+#endif /* CY_XIP_SMIF_MODE_CHANGE */
+            ota_smif_busy_end();
+            ota_xip_blackout_op_end();
+        }
+        else
+        {
+            return CY_RSLT_SERIAL_FLASH_ERR_NOT_INITED;
+        }
+
+        return (cy_smif_result == CY_SMIF_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+#else
+        return CY_RSLT_TYPE_ERROR;
+#endif /* CY_IP_MXSMIF & !XMC7200 */
+    }
+    else
+    {
+        printf("%s() Erase not supported for memory type %d\n", __func__, (int)mem_type);
+        return CY_RSLT_TYPE_ERROR;
+    }
+}
+
+/* Reads the flash and adds the read to the operation statistics */
+static cy_rslt_t cy_ota_mem_read_direct( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+{
+    uint32_t start = DWT->CYCCNT;
+    cy_rslt_t result = ota_mem_read_flash(mem_type, addr, data, len);
+
+    ota_mem_op_record(mem_type, CY_OTA_MEM_OP_READ, len, start);
+    return result;
+}
+
+/* Programs the flash and adds the program to the operation statistics */
+static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+{
+    uint32_t start = DWT->CYCCNT;
+    cy_rslt_t result = ota_mem_program_flash(mem_type, addr, data, len);
+
+    ota_mem_op_record(mem_type, CY_OTA_MEM_OP_PROGRAM, len, start);
+    return result;
+}
+
+/* Passes each sector of an erased range to the erase hook */
+static void ota_mem_erase_notify( cy_ota_mem_type_t mem_type, uint32_t addr, uint32_t len )
+{
+    uint32_t sector = ota_mem_normalize_addr(mem_type, addr);
+    uint32_t end = sector + len;
+    uint32_t sector_size = ota_mem_erase_sector_size(mem_type, sector);
+
+    if (sector_size == 0u)
+    {
+        return;
+    }
+
+    sector -= sector % sector_size;
+    while ((sector < end) && (sector_size != 0u))
+    {
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+        /* External flash is reported by its address in the XIP window */
+        erase_hook(mem_type, (mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH) ? (sector + CY_SMIF_BASE_MEM_OFFSET) : sector,
+                   sector_size);
+#else
+        erase_hook(mem_type, sector, sector_size);
+#endif
+        sector += sector_size;
+        sector_size = ota_mem_erase_sector_size(mem_type, sector);
+    }
+}
+
+/* Erases the range in the flash, rounded out to erase sector boundaries */
+static cy_rslt_t ota_mem_erase_direct( cy_ota_mem_type_t mem_type, uint32_t addr, size_t len )
+{
+    uint32_t start = DWT->CYCCNT;
+    cy_rslt_t result = ota_mem_erase_flash(mem_type, addr, len);
+
+    ota_mem_op_record(mem_type, CY_OTA_MEM_OP_ERASE, len, start);
+    if ((result == CY_RSLT_SUCCESS) && (erase_hook != NULL))
+    {
+        ota_mem_erase_notify(mem_type, addr, len);
+    }
+    return result;
+}
+
+/* Adds the counters of the current operation to the totals */
+static void ota_mem_accumulate_write_stats( const cy_ota_mem_write_counters_t *counters )
+{
+    write_total_counters.write_calls      += counters->write_calls;
+    write_total_counters.bytes_requested  += counters->bytes_requested;
+    write_total_counters.bytes_programmed += counters->bytes_programmed;
+    write_total_counters.rows_programmed  += counters->rows_programmed;
+    write_total_counters.rows_skipped     += counters->rows_skipped;
+    write_total_counters.rows_read        += counters->rows_read;
+    write_total_counters.partial_writes_combined += counters->partial_writes_combined;
+    write_total_counters.sectors_erased   += counters->sectors_erased;
+    write_total_counters.sectors_blank    += counters->sectors_blank;
+    write_total_counters.pages_programmed += counters->pages_programmed;
+    write_total_counters.bytes_read_back  += counters->bytes_read_back;
+}
+
+/* Moves the blank watermark back below a range that is about to be written */
+static void ota_mem_blank_region_written( cy_ota_mem_type_t mem_type, uint32_t addr, uint32_t len )
+{
+    uint32_t first;
+    uint32_t sector_size;
+
+    if (!blank_region.valid || (blank_region.mem_type != mem_type) || (blank_region.blank_len == 0u) ||
+        ((addr + len) <= blank_region.start) || (addr >= (blank_region.start + blank_region.blank_len)))
+    {
+        return;
+    }
+
+    /* The whole sector holding the first written byte is no longer blank */
+    first = (addr > blank_region.start) ? addr : blank_region.start;
+    sector_size = ota_mem_erase_sector_size(mem_type, first);
+    if (sector_size != 0u)
+    {
+        first &= ~(sector_size - 1u);
+    }
+    blank_region.blank_len = (first > blank_region.start) ? (first - blank_region.start) : 0u;
+}
+
+/* Returns true if every word of the range reads 0xFFFFFFFF, a read error counts as not blank */
+static bool ota_mem_is_blank( cy_ota_mem_type_t mem_type, uint32_t addr, uint32_t len )
+{
+    if (mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH)
+    {
+#if !(defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
+        const volatile uint32_t *word = (const volatile uint32_t *)(CY_FLASH_BASE + addr);
+        uint32_t i;
+
+        for (i = 0; i < (len / sizeof(uint32_t)); i++)
+        {
+            if (word[i] != 0xFFFFFFFFu)
+            {
+                return false;
+            }
+        }
+        return true;
+#endif
+    }
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+    else if (mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH)
+    {
+        uint32_t offset;
+        uint32_t i;
+
+        /* Read one row at a time, XIP is only off for the duration of a row read */
+        for (offset = 0; offset < len; offset += sizeof(smif_compare_buffer))
+        {
+            if (cy_ota_mem_read_direct(mem_type, addr + offset, smif_compare_buffer, sizeof(smif_compare_buffer)) != CY_RSLT_SUCCESS)
+            {
+                return false;
+            }
+            write_call_counters.bytes_read_back += sizeof(smif_compare_buffer);
+            for (i = 0; i < (sizeof(smif_compare_buffer) / sizeof(uint32_t)); i++)
+            {
+                if (smif_compare_buffer[i] != 0xFFFFFFFFu)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+#endif /* CY_IP_MXSMIF & !XMC7200 */
+
+    return false;
+}
+
+/* Erases one sector unless it is blank already */
+static cy_rslt_t ota_mem_erase_sector_if_needed( cy_ota_mem_type_t mem_type, uint32_t sector_base, uint32_t sector_size )
+{
+    uint32_t start = DWT->CYCCNT;
+
+    if (ota_mem_is_blank(mem_type, sector_base, sector_size))
+    {
+        ota_mem_op_record(mem_type, CY_OTA_MEM_OP_BLANK_SKIP, sector_size, start);
+        write_call_counters.sectors_blank++;
+        return CY_RSLT_SUCCESS;
+    }
+
+    write_call_counters.sectors_erased++;
+    return ota_mem_erase_direct(mem_type, sector_base, sector_size);
+}
+
+/* Remembers a range to erase when it is written, false if there is no free slot for it */
+static bool ota_mem_pending_erase_add( cy_ota_mem_type_t mem_type, uint32_t addr, uint32_t len )
+{
+    uint32_t start_sector = ota_mem_erase_sector_size(mem_type, addr);
+    uint32_t end_sector;
+    uint32_t start, end;
+    uint32_t i;
+
+    if ((len == 0u) || (start_sector == 0u))
+    {
+        return false;
+    }
+    end_sector = ota_mem_erase_sector_size(mem_type, addr + len - 1u);
+    if (end_sector == 0u)
+    {
+        return false;
+    }
+
+    /* Same sectors as a direct erase of the range */
+    start = addr & ~(start_sector - 1u);
+    end   = ((addr + len - 1u) & ~(end_sector - 1u)) + end_sector;
+
+    /* Ranges within the new one are not needed anymore, e.g. when the slot is erased again */
+    for (i = 0; i < OTA_MEM_ERASE_ON_DEMAND_RANGES; i++)
+    {
+        if (pending_erase[i].in_use && (pending_erase[i].mem_type == mem_type) &&
+            (pending_erase[i].start >= start) && (pending_erase[i].end <= end))
+        {
+            pending_erase[i].in_use = false;
+        }
+    }
+
+    for (i = 0; i < OTA_MEM_ERASE_ON_DEMAND_RANGES; i++)
+    {
+        if (!pending_erase[i].in_use)
+        {
+            pending_erase[i].in_use   = true;
+            pending_erase[i].mem_type = mem_type;
+            pending_erase[i].start    = start;
+            pending_erase[i].end      = end;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Takes a sector out of the pending ranges, true if it was in one of them */
+static bool ota_mem_pending_erase_remove( cy_ota_mem_type_t mem_type, uint32_t sector_base, uint32_t sector_end,
+                                          cy_rslt_t *result )
+{
+    bool found = false;
+    uint32_t i, j;
+
+    for (i = 0; i < OTA_MEM_ERASE_ON_DEMAND_RANGES; i++)
+    {
+        ota_mem_pending_erase_t *range = &pending_erase[i];
+
+        if (!range->in_use || (range->mem_type != mem_type) ||
+            (sector_base >= range->end) || (sector_end <= range->start))
+        {
+            continue;
+        }
+        found = true;
+
+        if ((sector_base > range->start) && (sector_end < range->end))
+        {
+            /* Split the range, without a free slot for the upper part erase it now */
+            for (j = 0; (j < OTA_MEM_ERASE_ON_DEMAND_RANGES) && pending_erase[j].in_use; j++)
+            {
+            }
+            if (j < OTA_MEM_ERASE_ON_DEMAND_RANGES)
+            {
+                pending_erase[j] = *range;
+                pending_erase[j].start = sector_end;
+            }
+            else if (ota_mem_erase_direct(mem_type, sector_end, range->end - sector_end) != CY_RSLT_SUCCESS)
+            {
+                *result = CY_RSLT_TYPE_ERROR;
+            }
+            range->end = sector_base;
+        }
+        else if (sector_base > range->start)
+        {
+            range->end = sector_base;
+        }
+        else if (sector_end < range->end)
+        {
+            range->start = sector_end;
+        }
+        else
+        {
+            range->in_use = false;
+        }
     }
-#endif
 
-    /* Set up SMIF */
-    Cy_SMIF_SetDataSelect(SMIF0, smifMemConfigs[0]->slaveSelect, smifMemConfigs[0]->dataSelect);
-    Cy_SMIF_Enable(SMIF0, &ota_QSPI_context);
+    return found;
+}
 
-    /* Map memory device to memory map */
-    smif_status = Cy_SMIF_Memslot_Init(SMIF0, &smifBlockConfig, &ota_QSPI_context);
-    if (smif_status != CY_SMIF_SUCCESS)
-    {
-        result = smif_status;
-        goto _bail;
-    }
+/* Erases the sectors of a pending range that the write is about to touch, or only takes them out of it */
+static cy_rslt_t ota_mem_pending_erase_before_write( cy_ota_mem_type_t mem_type, uint32_t addr, uint32_t len, bool erase )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t curr = addr;
 
-#if (defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
-    /* Even after SFDP enumeration QE command is not initialized */
-    /* So, it should be 1.0 device */
-    if ((smifMemConfigs[0]->deviceCfg->readStsRegQeCmd->command == 0) ||                        /* 0 - if configurator generated code */
-        (smifMemConfigs[0]->deviceCfg->readStsRegQeCmd->command == CY_SMIF_NO_COMMAND_OR_MODE)) /* 0xFF's if SFDP enumerated          */
+    while ((curr < (addr + len)) && (result == CY_RSLT_SUCCESS))
     {
-        smif_status = Cy_SMIF_MemInitSfdpMode(SMIF0,
-                                              smifMemConfigs[0],
-                                              CY_SMIF_WIDTH_QUAD,
-                                              CY_SMIF_SFDP_QER_1,
-                                              &ota_QSPI_context);
-        if (smif_status != CY_SMIF_SUCCESS)
+        uint32_t sector_size = ota_mem_erase_sector_size(mem_type, curr);
+        uint32_t sector_base;
+
+        if (sector_size == 0u)
         {
-            result = smif_status;
-            goto _bail;
+            break;
         }
-    }
-#else /* NON - CYW20829A0LKML/CYW20829B0LKML */
-    #if !defined(CY_RUN_CODE_FROM_XIP) && (OTA_USE_EXTERNAL_FLASH)
+        sector_base = curr & ~(sector_size - 1u);
+
+        if (ota_mem_pending_erase_remove(mem_type, sector_base, sector_base + sector_size, &result) && erase)
         {
-            /* Choose SMIF slot number (slave select).
-             * Acceptable values are:
-             * 0 - SMIF disabled (no external memory);
-             * 1, 2, 3 or 4 - slave select line memory module is connected to.
-             */
-    #define SMIF_ID         (1U) /* Assume SlaveSelect_0 is used for External Memory */
-    #include "flash_qspi.h"
-            cy_en_smif_status_t qspi_status = CY_SMIF_SUCCESS;
-            qspi_status = qspi_init_sfdp(SMIF_ID);
-            if(CY_SMIF_SUCCESS == qspi_status)
-            {
-                result = CY_RSLT_SUCCESS;
-            }
-            else
+            if (ota_mem_erase_sector_if_needed(mem_type, sector_base, sector_size) != CY_RSLT_SUCCESS)
             {
                 result = CY_RSLT_TYPE_ERROR;
             }
         }
-    #endif /* ! CY_RUN_CODE_FROM_XIP */
-#endif /* CYW20829A0LKML/CYW20829B0LKML */
+        curr = sector_base + sector_size;
+    }
 
-    smif_status = IsQuadEnabled(smifMemConfigs[0], &QE_status);
-    if(smif_status != CY_RSLT_SUCCESS)
+    return result;
+}
+
+/* Overwrites the part of the buffer that lies in a pending range with the erased value */
+static void ota_mem_pending_erase_fill( cy_ota_mem_type_t mem_type, uint32_t addr, uint8_t *data, uint32_t len )
+{
+    uint32_t i;
+
+    for (i = 0; i < OTA_MEM_ERASE_ON_DEMAND_RANGES; i++)
     {
-        result = CY_RSLT_TYPE_ERROR;
+        const ota_mem_pending_erase_t *range = &pending_erase[i];
+        uint32_t first, last;
+
+        if (!range->in_use || (range->mem_type != mem_type) ||
+            (addr >= range->end) || ((addr + len) <= range->start))
+        {
+            continue;
+        }
+        first = (addr > range->start) ? addr : range->start;
+        last  = ((addr + len) < range->end) ? (addr + len) : range->end;
+        memset(&data[first - addr], 0xFF, last - first);
     }
+}
 
-    /* If not enabled, enable quad mode */
-    if(!QE_status)
+#if (OTA_MEM_COMBINE_ROWS > 0)
+/* Programs a pending row, merging in the current flash content for the bytes that were not written */
+static cy_rslt_t ota_mem_combine_flush_row( ota_mem_combine_row_t *row )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint8_t *src = row->data;
+    uint32_t i;
+
+    if (!row->in_use)
     {
-        /* Enable Quad mode */
-        smif_status = EnableQuadMode(smifMemConfigs[0]);
-        if(smif_status != CY_RSLT_SUCCESS)
+        return CY_RSLT_SUCCESS;
+    }
+
+    if (row->bytes_valid < CY_FLASH_SIZEOF_ROW)
+    {
+        result = cy_ota_mem_read_direct(row->mem_type, row->row_base, (void *)(&block_buffer[0]), sizeof(block_buffer));
+        if (result != CY_RSLT_SUCCESS)
         {
-            result = CY_RSLT_TYPE_ERROR;
+            return result;
+        }
+        write_call_counters.rows_read++;
+        write_call_counters.bytes_read_back += sizeof(block_buffer);
+
+        for (i = 0; i < CY_FLASH_SIZEOF_ROW; i++)
+        {
+            if ((row->valid[i / 8u] & (1u << (i % 8u))) != 0u)
+            {
+                block_buffer[i] = row->data[i];
+            }
         }
+        src = block_buffer;
     }
 
-    SET_FLAG(FLAG_HAL_INIT_DONE);
+    result = cy_ota_mem_write_row_size(row->mem_type, row->row_base, (void *)src, CY_FLASH_SIZEOF_ROW);
+    row->in_use = false;
 
-  _bail:
-    /* post-access to SMIF */
-    POST_SMIF_ACCESS_TURN_ON_XIP;
-#endif
-#endif /* CY_IP_MXSMIF & !XMC7200 */
     return result;
 }
 
-/**
- * @brief Read from flash, QSPI flash, or any other external memory type
- *
- * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
- * @param[in]   addr       Starting address to read from.
- * @param[out]  data       Pointer to the buffer to store the data read from the memory.
- * @param[in]   len        Number of data bytes to read.
- *
- * @return  CY_RSLT_SUCCESS on success
- *          CY_RSLT_TYPE_ERROR on failure
- */
-cy_rslt_t cy_ota_mem_read( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+/* Stores a write that lies within one row in the write-combining buffer */
+static cy_rslt_t ota_mem_combine_write( cy_ota_mem_type_t mem_type, uint32_t row_base, uint32_t row_offset,
+                                        const uint8_t *src, uint32_t len )
 {
     cy_rslt_t result = CY_RSLT_SUCCESS;
+    ota_mem_combine_row_t *row = NULL;
+    uint32_t i;
 
-    if( mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH )
+    /* Look for the row, else take a free slot or evict the least recently used one */
+    for (i = 0; i < OTA_MEM_COMBINE_ROWS; i++)
     {
-#if !(defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
-        /* flash_area_read() uses offsets, we need absolute address here */
-        addr += CY_FLASH_BASE;
-
-        /* flash read by simple memory copying */
-        memcpy((void *)data, (const void*)addr, (size_t)len);
-        return result;
-#else
-        (void)result;
-        printf("%s() READ not supported for memory type %d\n", __func__, (int)mem_type);
-        return CY_RSLT_TYPE_ERROR;
-#endif
+        if (combine_rows[i].in_use && (combine_rows[i].mem_type == mem_type) && (combine_rows[i].row_base == row_base))
+        {
+            row = &combine_rows[i];
+            break;
+        }
+        if ((row == NULL) || (row->in_use && (!combine_rows[i].in_use || (combine_rows[i].last_use < row->last_use))))
+        {
+            row = &combine_rows[i];
+        }
     }
-    else if( mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH )
+
+    if (!row->in_use || (row->mem_type != mem_type) || (row->row_base != row_base))
     {
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
-        cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
-        if (addr >= CY_SMIF_BASE_MEM_OFFSET)
+        result = ota_mem_combine_flush_row(row);
+        if (result != CY_RSLT_SUCCESS)
         {
-            addr -= CY_SMIF_BASE_MEM_OFFSET;
+            return result;
         }
+        row->in_use      = true;
+        row->mem_type    = mem_type;
+        row->row_base    = row_base;
+        row->bytes_valid = 0;
+        memset(row->valid, 0x00, sizeof(row->valid));
+    }
 
-        if (IS_FLAG_SET(FLAG_HAL_INIT_DONE))
+    row->last_use = ++combine_use_count;
+    memcpy(&row->data[row_offset], src, len);
+    for (i = row_offset; i < (row_offset + len); i++)
+    {
+        if ((row->valid[i / 8u] & (1u << (i % 8u))) == 0u)
         {
-            /* pre-access to SMIF */
-            PRE_SMIF_ACCESS_TURN_OFF_XIP;
-
-            cy_smif_result = Cy_SMIF_MemRead(SMIF0, smifBlockConfig.memConfig[MEM_SLOT],
-                    addr, data, len, &ota_QSPI_context);
-            /* post-access to SMIF */
-            POST_SMIF_ACCESS_TURN_ON_XIP;
+            row->valid[i / 8u] |= (uint8_t)(1u << (i % 8u));
+            row->bytes_valid++;
         }
-
-        return (cy_smif_result == CY_SMIF_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
-#else
-        return CY_RSLT_TYPE_ERROR;
-#endif /* CY_IP_MXSMIF & !XMC7200 */
     }
-    else
+    write_call_counters.partial_writes_combined++;
+
+    /* Program the row as soon as it is complete */
+    if (row->bytes_valid == CY_FLASH_SIZEOF_ROW)
     {
-        printf("%s() READ not supported for memory type %d\n", __func__, (int)mem_type);
-        return CY_RSLT_TYPE_ERROR;
+        result = ota_mem_combine_flush_row(row);
     }
+
+    return result;
 }
 
-static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+/* Drops the pending rows that lie completely within the range and programs those that overlap it partially */
+static cy_rslt_t ota_mem_combine_invalidate( cy_ota_mem_type_t mem_type, uint32_t start, uint32_t len )
 {
     cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t i;
 
-    if( mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH )
+    for (i = 0; i < OTA_MEM_COMBINE_ROWS; i++)
     {
-#if !(defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
-        int rc = 0;
+        ota_mem_combine_row_t *row = &combine_rows[i];
 
-        /* flash_area_write() uses offsets, we need absolute address here */
-        addr += CY_FLASH_BASE;
+        if (!row->in_use || (row->mem_type != mem_type) ||
+            (row->row_base >= (start + len)) || ((row->row_base + CY_FLASH_SIZEOF_ROW) <= start))
+        {
+            continue;
+        }
 
-#if defined (XMC7200)
-        rc = xmc_internal_flash_write((uint8_t *)data, addr, len);
-        if (rc != 0 )
+        if ((row->row_base >= start) && ((row->row_base + CY_FLASH_SIZEOF_ROW) <= (start + len)))
         {
-            printf("xmc_internal_flash_write(0x%08x, 0x%08x, %u) FAILED rc:%u\n", (unsigned int)data, (unsigned int)addr, len, rc);
-            result = CY_RSLT_TYPE_ERROR;
+            row->in_use = false;
         }
-        return result;
-#else
-        rc = psoc6_internal_flash_write((uint8_t *)data, addr, len);
-        if (rc != 0 )
+        else if (ota_mem_combine_flush_row(row) != CY_RSLT_SUCCESS)
         {
             result = CY_RSLT_TYPE_ERROR;
         }
-        return result;
-#endif
-
-#else
-        (void)result;
-        printf("%s() Write not supported for memory type %d\n", __func__, (int)mem_type);
-        return CY_RSLT_TYPE_ERROR;
-#endif
     }
-    else if( mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH )
-    {
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
-        cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
 
-        if (addr >= CY_SMIF_BASE_MEM_OFFSET)
-        {
-            addr -= CY_SMIF_BASE_MEM_OFFSET;
-        }
+    return result;
+}
+#endif /* OTA_MEM_COMBINE_ROWS */
 
-        if (IS_FLAG_SET(FLAG_HAL_INIT_DONE))
-        {
-            /* pre-access to SMIF */
-            PRE_SMIF_ACCESS_TURN_OFF_XIP;
+/**
+ * @brief Read from flash, QSPI flash, or any other external memory type
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ * @param[in]   addr       Starting address to read from.
+ * @param[out]  data       Pointer to the buffer to store the data read from the memory.
+ * @param[in]   len        Number of data bytes to read.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_read( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
+{
+    cy_rslt_t result;
 
-            cy_smif_result = Cy_SMIF_MemWrite(SMIF0, smifBlockConfig.memConfig[MEM_SLOT],
-                    addr, data, len, &ota_QSPI_context);
+    ota_mem_lock();
+    result = cy_ota_mem_read_direct(mem_type, addr, data, len);
 
-            /* post-access to SMIF */
-            POST_SMIF_ACCESS_TURN_ON_XIP;
-        }
-        else
+    /* Sectors left to be erased on demand read as erased */
+    if (result == CY_RSLT_SUCCESS)
+    {
+        ota_mem_pending_erase_fill(mem_type, ota_mem_normalize_addr(mem_type, addr), (uint8_t *)data, len);
+    }
+
+#if (OTA_MEM_COMBINE_ROWS > 0)
+    uint32_t start = ota_mem_normalize_addr(mem_type, addr);
+    uint32_t i, j;
+
+    /* Data still in the write-combining buffer is newer than the flash content */
+    for (i = 0; (result == CY_RSLT_SUCCESS) && (i < OTA_MEM_COMBINE_ROWS); i++)
+    {
+        ota_mem_combine_row_t *row = &combine_rows[i];
+
+        if (!row->in_use || (row->mem_type != mem_type) ||
+            (row->row_base >= (start + len)) || ((row->row_base + CY_FLASH_SIZEOF_ROW) <= start))
         {
-            cy_smif_result = (cy_en_smif_status_t)CY_RSLT_SERIAL_FLASH_ERR_NOT_INITED;
+            continue;
         }
 
-    #ifdef READBACK_SMIF_WRITE_TEST
-        if (cy_smif_result == CY_SMIF_SUCCESS)
+        for (j = 0; j < CY_FLASH_SIZEOF_ROW; j++)
         {
-            if (ota_mem_read(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, addr, read_back_test, ((16 < length) ? 16 : len)) == CY_RSLT_SUCCESS)
+            uint32_t byte_addr = row->row_base + j;
+            if ((byte_addr >= start) && (byte_addr < (start + len)) &&
+                ((row->valid[j / 8u] & (1u << (j % 8u))) != 0u))
             {
-                int i;
-                for (i=0; (i<16 && i<len); i++)
-                {
-                    if(data[i] != read_back_test[i])
-                    {
-                        result  = -1;
-                    }
-                }
+                ((uint8_t *)data)[byte_addr - start] = row->data[j];
             }
         }
-    #endif
-
-        return (cy_smif_result == CY_SMIF_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
-#else
-        return CY_RSLT_TYPE_ERROR;
-#endif /* CY_IP_MXSMIF & !XMC7200 */
     }
-    else
+#endif /* OTA_MEM_COMBINE_ROWS */
+
+    ota_mem_unlock();
+    return result;
+}
+
+/**
+ * @brief Program all the rows held in the write-combining buffer
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_flush( void )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+#if (OTA_MEM_COMBINE_ROWS > 0)
+    /* Count the flushed rows in the totals, "last" keeps describing the last cy_ota_mem_write() */
+    cy_ota_mem_write_counters_t last_write;
+    uint32_t i;
+
+    ota_mem_lock();
+    last_write = write_call_counters;
+    memset(&write_call_counters, 0x00, sizeof(write_call_counters));
+    for (i = 0; i < OTA_MEM_COMBINE_ROWS; i++)
     {
-        printf("%s() Write not supported for memory type %d\n", __func__, (int)mem_type);
-        return CY_RSLT_TYPE_ERROR;
+        if (ota_mem_combine_flush_row(&combine_rows[i]) != CY_RSLT_SUCCESS)
+        {
+            result = CY_RSLT_TYPE_ERROR;
+        }
     }
+    ota_mem_accumulate_write_stats(&write_call_counters);
+    write_call_counters = last_write;
+    ota_mem_unlock();
+#endif /* OTA_MEM_COMBINE_ROWS */
+
+    return result;
 }
 
 /**
@@ -860,60 +2511,73 @@ static cy_rslt_t cy_ota_mem_write_row_size( cy_ota_mem_type_t mem_type, uint32_t
 cy_rslt_t cy_ota_mem_write( cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len )
 {
     cy_rslt_t result = CY_RSLT_SUCCESS;
-
-    /**
-     * This is used if a block is < Block size to satisfy requirements
-     * of flash_area_write(). "static" so it is not on the stack.
-     */
-    static uint8_t block_buffer[CY_FLASH_SIZEOF_ROW];
     uint32_t chunk_size = 0;
 
     uint32_t bytes_to_write = len;
     uint32_t curr_addr = addr;
     uint8_t *curr_src = data;
 
-    while(bytes_to_write > 0x0U)
-    {
-        chunk_size = bytes_to_write;
-        if(chunk_size > CY_FLASH_SIZEOF_ROW)
-        {
-            chunk_size = CY_FLASH_SIZEOF_ROW;
-        }
+    ota_mem_lock();
+    ota_xip_blackout_op_begin();
+    ota_mem_blank_region_written(mem_type, ota_mem_normalize_addr(mem_type, addr), len);
 
-        /* Is the chunk_size smaller than a flash row? */
-        if((chunk_size % CY_FLASH_SIZEOF_ROW) != 0x0U)
-        {
-            uint32_t row_offset = 0;
-            uint32_t row_base = 0;
+    memset(&write_call_counters, 0x00, sizeof(write_call_counters));
+    write_call_counters.write_calls = 1;
+    write_call_counters.bytes_requested = len;
+
+    /* Erase the sectors left to be erased on demand just before they are written */
+    result = ota_mem_pending_erase_before_write(mem_type, ota_mem_normalize_addr(mem_type, addr), len, true);
+
+    /* External flash is programmed page by page as it is, rows only matter for internal flash */
+    if ((result == CY_RSLT_SUCCESS) && (mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH))
+    {
+        result = cy_ota_mem_write_row_size(mem_type, addr, data, len);
+        bytes_to_write = 0;
+    }
 
-            row_base   = (curr_addr / CY_FLASH_SIZEOF_ROW) * CY_FLASH_SIZEOF_ROW;
-            row_offset = curr_addr - row_base;
+    while((bytes_to_write > 0x0U) && (result == CY_RSLT_SUCCESS))
+    {
+        uint32_t row_base   = (curr_addr / CY_FLASH_SIZEOF_ROW) * CY_FLASH_SIZEOF_ROW;
+        uint32_t row_offset = curr_addr - row_base;
 
-            if((row_offset + chunk_size) > CY_FLASH_SIZEOF_ROW)
+        /* Does the chunk start or end in the middle of a flash row? */
+        if((row_offset != 0x0U) || (bytes_to_write < CY_FLASH_SIZEOF_ROW))
+        {
+            chunk_size = CY_FLASH_SIZEOF_ROW - row_offset;
+            if(chunk_size > bytes_to_write)
             {
-                chunk_size = (CY_FLASH_SIZEOF_ROW - row_offset);
+                chunk_size = bytes_to_write;
             }
 
+#if (OTA_MEM_COMBINE_ROWS > 0)
+            /* Collect the partial row, it is programmed once it is complete or flushed */
+            result = ota_mem_combine_write(mem_type, ota_mem_normalize_addr(mem_type, row_base), row_offset,
+                                           curr_src, chunk_size);
+#else
             /* we will read a CY_FLASH_SIZEOF_ROW byte block, write the new data into the block, then write the whole block */
             result = cy_ota_mem_read( mem_type, row_base, (void *)(&block_buffer[0]), sizeof(block_buffer));
-            if(result != CY_RSLT_SUCCESS)
-            {
-                 return CY_RSLT_TYPE_ERROR;
-            }
-            memcpy (&block_buffer[row_offset], curr_src, chunk_size);
-
-            result = cy_ota_mem_write_row_size(mem_type, row_base, (void *)(&block_buffer[0]), sizeof(block_buffer));
-            if(result != CY_RSLT_SUCCESS)
+            if(result == CY_RSLT_SUCCESS)
             {
-                return CY_RSLT_TYPE_ERROR;
+                write_call_counters.rows_read++;
+                write_call_counters.bytes_read_back += sizeof(block_buffer);
+                memcpy (&block_buffer[row_offset], curr_src, chunk_size);
+
+                result = cy_ota_mem_write_row_size(mem_type, row_base, (void *)(&block_buffer[0]), sizeof(block_buffer));
             }
+#endif /* OTA_MEM_COMBINE_ROWS */
         }
         else
         {
-            result = cy_ota_mem_write_row_size(mem_type, addr, data, len);
-            if(result != CY_RSLT_SUCCESS)
+            /* Program all the whole rows of the chunk with a single call, every row exactly once */
+            chunk_size = (bytes_to_write / CY_FLASH_SIZEOF_ROW) * CY_FLASH_SIZEOF_ROW;
+
+#if (OTA_MEM_COMBINE_ROWS > 0)
+            /* Pending partial rows within the range are completely overwritten */
+            result = ota_mem_combine_invalidate(mem_type, ota_mem_normalize_addr(mem_type, curr_addr), chunk_size);
+            if(result == CY_RSLT_SUCCESS)
+#endif
             {
-                return CY_RSLT_TYPE_ERROR;
+                result = cy_ota_mem_write_row_size(mem_type, curr_addr, curr_src, chunk_size);
             }
         }
 
@@ -922,7 +2586,54 @@ cy_rslt_t cy_ota_mem_write( cy_ota_mem_type_t mem_type, uint32_t addr, void *dat
         bytes_to_write -= chunk_size;
     }
 
-    return CY_RSLT_SUCCESS;
+    ota_mem_accumulate_write_stats(&write_call_counters);
+    ota_xip_blackout_op_end();
+    ota_mem_unlock();
+
+    return (result == CY_RSLT_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+}
+
+/* Erases the range, or leaves it to cy_ota_mem_write() while erase on demand is enabled */
+static cy_rslt_t ota_mem_erase_range( cy_ota_mem_type_t mem_type, uint32_t addr, size_t len )
+{
+    uint32_t norm_addr = ota_mem_normalize_addr(mem_type, addr);
+
+    /* Skip the part that was erased ahead of time and not written since */
+    if (blank_region.valid && (blank_region.mem_type == mem_type) &&
+        (norm_addr >= blank_region.start) && (norm_addr < (blank_region.start + blank_region.blank_len)))
+    {
+        uint32_t blank_bytes = (blank_region.start + blank_region.blank_len) - norm_addr;
+
+        if (len <= blank_bytes)
+        {
+            return CY_RSLT_SUCCESS;
+        }
+        addr += blank_bytes;
+        len -= blank_bytes;
+    }
+
+#if (OTA_MEM_COMBINE_ROWS > 0)
+    /* Pending rows must not be programmed after the erase, nor lost for the part outside of it */
+    cy_ota_mem_write_counters_t last_write = write_call_counters;
+    cy_rslt_t result;
+
+    memset(&write_call_counters, 0x00, sizeof(write_call_counters));
+    result = ota_mem_combine_invalidate(mem_type, ota_mem_normalize_addr(mem_type, addr), len);
+    ota_mem_accumulate_write_stats(&write_call_counters);
+    write_call_counters = last_write;
+    if (result != CY_RSLT_SUCCESS)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+#endif
+
+    /* Leave the erase to cy_ota_mem_write(), sectors that are never written are never erased */
+    if (erase_on_demand && ota_mem_pending_erase_add(mem_type, ota_mem_normalize_addr(mem_type, addr), len))
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    return ota_mem_erase_direct(mem_type, addr, len);
 }
 
 /**
@@ -937,95 +2648,77 @@ cy_rslt_t cy_ota_mem_write( cy_ota_mem_type_t mem_type, uint32_t addr, void *dat
  */
 cy_rslt_t cy_ota_mem_erase( cy_ota_mem_type_t mem_type, uint32_t addr, size_t len )
 {
-    cy_rslt_t result = CY_RSLT_SUCCESS;
+    cy_rslt_t result;
 
-    if( mem_type == CY_OTA_MEM_TYPE_INTERNAL_FLASH )
-    {
-#if !(defined (CYW20829A0LKML) || defined (CYW20829B0LKML))
-        int rc = 0;
+    ota_mem_lock();
+    result = ota_mem_erase_range(mem_type, addr, len);
+    ota_mem_unlock();
 
-#if defined (XMC7200)
-        rc = xmc_internal_flash_erase(addr, len);
-        if (rc != 0 )
-        {
-            printf("xmc_internal_flash_erase(0x%08x, %u) FAILED rc:%d\n", (unsigned int)addr, len, rc);
-            result = CY_RSLT_TYPE_ERROR;
-        }
-#else
-        rc = psoc6_internal_flash_erase(addr, len);
-        if (rc != 0 )
-        {
-            result = CY_RSLT_TYPE_ERROR;
-        }
-#endif
-        return result;
-#else
-        (void)result;
-        printf("%s() Erase not supported for memory type %d\n", __func__, (int)mem_type);
-        return CY_RSLT_TYPE_ERROR;
-#endif
-    }
-    else if( mem_type == CY_OTA_MEM_TYPE_EXTERNAL_FLASH )
-    {
-#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
-        cy_en_smif_status_t cy_smif_result = CY_SMIF_SUCCESS;
+    return result;
+}
 
-        if (addr >= CY_SMIF_BASE_MEM_OFFSET)
-        {
-            addr -= CY_SMIF_BASE_MEM_OFFSET;
-        }
+/**
+ * @brief Erase now the sectors of a range that are left to erase on demand
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ * @param[in]   addr       Starting address of the range.
+ * @param[in]   len        Number of bytes in the range.
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_TYPE_ERROR
+ */
+cy_rslt_t cy_ota_mem_erase_pending( cy_ota_mem_type_t mem_type, uint32_t addr, size_t len )
+{
+    cy_ota_mem_write_counters_t last_write;
+    cy_rslt_t result;
+
+    ota_mem_lock();
+    ota_xip_blackout_op_begin();
+    last_write = write_call_counters;
+    memset(&write_call_counters, 0x00, sizeof(write_call_counters));
+    result = ota_mem_pending_erase_before_write(mem_type, ota_mem_normalize_addr(mem_type, addr), len, true);
+    ota_mem_accumulate_write_stats(&write_call_counters);
+    write_call_counters = last_write;
+    ota_xip_blackout_op_end();
+    ota_mem_unlock();
 
-        if (IS_FLAG_SET(FLAG_HAL_INIT_DONE))
-        {
-            /* pre-access to SMIF */
-            PRE_SMIF_ACCESS_TURN_OFF_XIP;
+    return result;
+}
 
-            // If the erase is for the entire chip, use chip erase command
-            if ((addr == 0u) && (len == ota_smif_get_memory_size()))
-            {
-                cy_smif_result = Cy_SMIF_MemEraseChip(SMIF0,
-                                                    smifBlockConfig.memConfig[MEM_SLOT],
-                                                    &ota_QSPI_context);
-            }
-            else
-            {
-                // Cy_SMIF_MemEraseSector() returns error if (addr + length) > total flash size or if
-                // addr is not aligned to erase sector size or if (addr + length) is not aligned to
-                // erase sector size.
-                /* Make sure the base offset is correct */
-                uint32_t erase_size;
-                uint32_t diff;
-                erase_size = cy_ota_mem_get_erase_size(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, addr);
-                diff = addr & (erase_size - 1);
-                addr -= diff;
-                len += diff;
-                /* Make sure the length is correct */
-                len = (len + (erase_size - 1)) & ~(erase_size - 1);
-                Cy_SMIF_SetReadyPollingDelay(20000, &ota_QSPI_context);
-                cy_smif_result = Cy_SMIF_MemEraseSector(SMIF0,
-                                                      smifBlockConfig.memConfig[MEM_SLOT],
-                                                      addr, len, &ota_QSPI_context);
-                Cy_SMIF_SetReadyPollingDelay(0, &ota_QSPI_context);
-            }
+/**
+ * @brief Keep the content of the sectors of a range that are left to erase on demand
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ * @param[in]   addr       Starting address of the range.
+ * @param[in]   len        Number of bytes in the range.
+ *
+ * @return  CY_RSLT_SUCCESS
+ *          CY_RSLT_TYPE_ERROR
+ */
+cy_rslt_t cy_ota_mem_erase_cancel( cy_ota_mem_type_t mem_type, uint32_t addr, size_t len )
+{
+    cy_rslt_t result;
 
-            /* post-access to SMIF */
-            POST_SMIF_ACCESS_TURN_ON_XIP;
-        }
-        else
-        {
-            return CY_RSLT_SERIAL_FLASH_ERR_NOT_INITED;
-        }
+    ota_mem_lock();
+    ota_xip_blackout_op_begin();
+    result = ota_mem_pending_erase_before_write(mem_type, ota_mem_normalize_addr(mem_type, addr), len, false);
+    ota_xip_blackout_op_end();
+    ota_mem_unlock();
 
-        return (cy_smif_result == CY_SMIF_SUCCESS) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
-#else
-        return CY_RSLT_TYPE_ERROR;
-#endif /* CY_IP_MXSMIF & !XMC7200 */
-    }
-    else
-    {
-        printf("%s() Erase not supported for memory type %d\n", __func__, (int)mem_type);
-        return CY_RSLT_TYPE_ERROR;
-    }
+    return result;
+}
+
+/**
+ * @brief Get the size of the sector erased on demand at an address
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ * @param[in]   addr       Address that belongs to the sector.
+ *
+ * @return    Sector size in bytes, 0 if the address can not be erased.
+ */
+size_t cy_ota_mem_get_erase_sector_size( cy_ota_mem_type_t mem_type, uint32_t addr )
+{
+    return ota_mem_erase_sector_size(mem_type, ota_mem_normalize_addr(mem_type, addr));
 }
 
 /**
@@ -1129,3 +2822,257 @@ size_t cy_ota_mem_get_erase_size ( cy_ota_mem_type_t mem_type, uint32_t addr )
         return 0;
     }
 }
+
+/**
+ * @brief Get the write counters of cy_ota_mem_write()
+ *
+ * @param[out]  stats      Pointer to the structure to store the counters in.
+ */
+void cy_ota_mem_get_write_stats(cy_ota_mem_write_stats_t *stats)
+{
+    if (stats != NULL)
+    {
+        stats->last  = write_call_counters;
+        stats->total = write_total_counters;
+    }
+}
+
+/**
+ * @brief Clear the write counters of cy_ota_mem_write(), the operation statistics and the XIP blackout statistics
+ */
+void cy_ota_mem_reset_write_stats(void)
+{
+    memset(&write_call_counters, 0x00, sizeof(write_call_counters));
+    memset(&write_total_counters, 0x00, sizeof(write_total_counters));
+    memset(&xip_blackout, 0x00, sizeof(xip_blackout));
+    memset(&op_stats, 0x00, sizeof(op_stats));
+#ifdef CY_XIP_SMIF_MODE_CHANGE
+    xip_off_total_cycles = 0;
+#endif
+}
+
+/**
+ * @brief Get the count, bytes and latency histogram of each flash operation
+ *
+ * @param[out]  stats      Pointer to the structure to store the statistics in.
+ */
+void cy_ota_mem_get_op_stats(cy_ota_mem_op_stats_table_t *stats)
+{
+    if (stats != NULL)
+    {
+        ota_mem_lock();
+        *stats = op_stats;
+        ota_mem_unlock();
+    }
+}
+
+/**
+ * @brief Get the times the external flash was taken out of XIP mode
+ *
+ * @param[out]  stats      Pointer to the structure to store the statistics in.
+ */
+void cy_ota_mem_get_xip_blackout(cy_ota_mem_xip_blackout_t *stats)
+{
+    if (stats != NULL)
+    {
+        *stats = xip_blackout;
+#ifdef CY_XIP_SMIF_MODE_CHANGE
+        uint32_t cycles_per_us = SystemCoreClock / 1000000u;
+
+        stats->total_us = (cycles_per_us != 0u) ? (uint32_t)(xip_off_total_cycles / cycles_per_us) : 0u;
+#endif
+    }
+}
+
+/**
+ * @brief Erase the next sector of a region ahead of time
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ * @param[in]   addr       Start address of the region.
+ * @param[in]   len        Size of the region in bytes.
+ * @param[out]  blank_len  Number of bytes from the start of the region known to be blank.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_pre_erase_step( cy_ota_mem_type_t mem_type, uint32_t addr, size_t len, uint32_t *blank_len )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t norm_addr = ota_mem_normalize_addr(mem_type, addr);
+
+    ota_mem_lock();
+    if (!blank_region.valid || (blank_region.mem_type != mem_type) ||
+        (blank_region.start != norm_addr) || (blank_region.len != len))
+    {
+        blank_region.valid     = true;
+        blank_region.mem_type  = mem_type;
+        blank_region.start     = norm_addr;
+        blank_region.len       = len;
+        blank_region.blank_len = 0;
+    }
+
+    if (blank_region.blank_len < blank_region.len)
+    {
+        uint32_t next = blank_region.start + blank_region.blank_len;
+        uint32_t sector_size = ota_mem_erase_sector_size(mem_type, next);
+        uint32_t step;
+
+        if (sector_size == 0u)
+        {
+            result = CY_RSLT_TYPE_ERROR;
+        }
+        else
+        {
+            /* Up to the end of the sector, the first sector of an unaligned region is erased as a whole */
+            step = sector_size - (next & (sector_size - 1u));
+            if (step > (blank_region.len - blank_region.blank_len))
+            {
+                step = blank_region.len - blank_region.blank_len;
+            }
+
+            result = ota_mem_erase_sector_if_needed(mem_type, next & ~(sector_size - 1u), sector_size);
+            if (result == CY_RSLT_SUCCESS)
+            {
+                blank_region.blank_len += step;
+            }
+        }
+    }
+
+    if (blank_len != NULL)
+    {
+        *blank_len = blank_region.blank_len;
+    }
+    ota_mem_unlock();
+
+    return result;
+}
+
+/**
+ * @brief Enable or disable erasing on demand
+ *
+ * @param[in]   enable     true to leave erases to the first write of each sector.
+ */
+void cy_ota_mem_set_erase_on_demand( bool enable )
+{
+    erase_on_demand = enable;
+    if (!enable)
+    {
+        memset(pending_erase, 0x00, sizeof(pending_erase));
+    }
+}
+
+/**
+ * @brief Time reads of the external flash through the memory-mapped window and in command mode
+ *
+ * @param[in]   addr       Start address of the range to read.
+ * @param[in]   len        Number of bytes to read.
+ * @param[out]  result     Read times of both modes.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_read_benchmark( uint32_t addr, size_t len, cy_ota_mem_read_benchmark_t *result )
+{
+#if (defined (CY_IP_MXSMIF) && !defined (XMC7200))
+    uint32_t cycles_per_us = SystemCoreClock / 1000000u;
+    uint32_t cycles[2] = { 0, 0 };
+    uint32_t mode;
+
+    if ((result == NULL) || (cycles_per_us == 0u) || !IS_FLAG_SET(FLAG_HAL_INIT_DONE))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    addr = ota_mem_normalize_addr(CY_OTA_MEM_TYPE_EXTERNAL_FLASH, addr);
+    if (!ota_smif_can_read_mapped(addr, len))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    /* Mode 0 memory-mapped from a cold cache, mode 1 command mode */
+    smif_cache_stale = true;
+    for (mode = 0; mode < 2u; mode++)
+    {
+        uint32_t offset;
+
+        for (offset = 0; offset < len; offset += sizeof(block_buffer))
+        {
+            uint32_t count = ((len - offset) < sizeof(block_buffer)) ? (len - offset) : sizeof(block_buffer);
+            uint32_t start = DWT->CYCCNT;
+
+            if (mode == 0u)
+            {
+                ota_smif_read_mapped(addr + offset, block_buffer, count);
+            }
+            else if (ota_smif_read_command(addr + offset, block_buffer, count) != CY_SMIF_SUCCESS)
+            {
+                return CY_RSLT_TYPE_ERROR;
+            }
+            cycles[mode] += DWT->CYCCNT - start;
+        }
+    }
+
+    result->bytes      = len;
+    result->mapped_us  = cycles[0] / cycles_per_us;
+    result->command_us = cycles[1] / cycles_per_us;
+
+    return CY_RSLT_SUCCESS;
+#else
+    (void)addr;
+    (void)len;
+    (void)result;
+    return CY_RSLT_TYPE_ERROR;
+#endif /* CY_IP_MXSMIF & !XMC7200 */
+}
+
+/**
+ * @brief Set the function called for each sector erased
+ *
+ * @param[in]   hook       Function to call, NULL for none.
+ */
+void cy_ota_mem_set_erase_hook( cy_ota_mem_erase_hook_t hook )
+{
+    ota_mem_lock();
+    erase_hook = hook;
+    ota_mem_unlock();
+}
+
+/**
+ * @brief Start a flash session
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_session_begin( void )
+{
+    if ((session_mutex != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) &&
+        (xSemaphoreTakeRecursive(session_mutex, portMAX_DELAY) != pdTRUE))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    session_depth++;
+    if (session_depth == 1u)
+    {
+        xip_blackout.sessions++;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/**
+ * @brief End a flash session
+ */
+void cy_ota_mem_session_end( void )
+{
+    if (session_depth == 0u)
+    {
+        return;
+    }
+
+    session_depth--;
+    ota_mem_unlock();
+}
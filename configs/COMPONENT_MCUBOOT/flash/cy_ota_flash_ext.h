@@ -0,0 +1,348 @@
+/******************************************************************************
+* File Name:   cy_ota_flash_ext.h
+*
+* Description: This file contains the declaration of the application specific
+*              extensions to the OTA flash APIs in cy_ota_flash.c
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2023-2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef _CY_OTA_FLASH_EXT_H
+#define _CY_OTA_FLASH_EXT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_result.h"
+#include "cy_ota_flash.h"
+
+/* Secondary (upgrade) slot the OTA agent writes the image to. Must match the
+ * upgrade slot of the flashmap selected with OTA_FLASH_MAP in the Makefile.
+ * Internal flash is addressed by the offset from CY_FLASH_BASE, as the
+ * cy_ota_mem_*() functions expect it.
+ */
+#ifndef OTA_UPGRADE_SLOT_ADDR
+#if defined (XMC7200)
+#define OTA_UPGRADE_SLOT_ADDR               (0x003F8000u)   /* xmc7200_int_*_single.json, 0x103F8000 */
+#define OTA_UPGRADE_SLOT_SIZE               (0x00200000u)
+#define OTA_UPGRADE_SLOT_MEM_TYPE           (CY_OTA_MEM_TYPE_INTERNAL_FLASH)
+#elif defined (PSOC_062_512K)
+#define OTA_UPGRADE_SLOT_ADDR               (0x18180000u)   /* psoc62_512k_xip_swap_single.json */
+#define OTA_UPGRADE_SLOT_SIZE               (0x00140200u)
+#define OTA_UPGRADE_SLOT_MEM_TYPE           (CY_OTA_MEM_TYPE_EXTERNAL_FLASH)
+#else
+#define OTA_UPGRADE_SLOT_ADDR               (0x18000200u)   /* psoc62_2m_ext_*_single.json */
+#define OTA_UPGRADE_SLOT_SIZE               (0x001c0000u)
+#define OTA_UPGRADE_SLOT_MEM_TYPE           (CY_OTA_MEM_TYPE_EXTERNAL_FLASH)
+#endif
+#endif /* OTA_UPGRADE_SLOT_ADDR */
+
+/**
+ * Write counters maintained by cy_ota_mem_write().
+ *
+ * A "row" is CY_FLASH_SIZEOF_ROW bytes of internal flash. External flash is
+ * programmed in pages of programSize bytes without reading it back.
+ * Write amplification is bytes_programmed / bytes_requested.
+ */
+typedef struct
+{
+    uint32_t write_calls;              /* Number of cy_ota_mem_write() calls                        */
+    uint32_t bytes_requested;          /* Bytes passed in by the callers                            */
+    uint32_t bytes_programmed;         /* Bytes sent to the flash program operation                 */
+    uint32_t rows_programmed;          /* Rows programmed                                           */
+    uint32_t rows_skipped;             /* Rows not programmed as the flash already held the data    */
+    uint32_t rows_read;                /* Rows read back for read-modify-write of partial rows      */
+    uint32_t partial_writes_combined;  /* Partial row writes collected in the write-combining buffer */
+    uint32_t sectors_erased;           /* Sectors erased on demand before they were written         */
+    uint32_t sectors_blank;            /* Sectors not erased as they were blank already             */
+    uint32_t pages_programmed;         /* External flash program operations, at most a page each    */
+    uint32_t bytes_read_back;          /* Bytes read from the flash to write or to check for blank  */
+} cy_ota_mem_write_counters_t;
+
+typedef struct
+{
+    cy_ota_mem_write_counters_t last;   /* Counters of the most recent cy_ota_mem_write() call */
+    cy_ota_mem_write_counters_t total;  /* Counters accumulated since the last reset           */
+} cy_ota_mem_write_stats_t;
+
+/**
+ * Times the external flash was taken out of XIP mode to program or erase it.
+ * Only measured when the code executes from the external flash
+ * (CY_XIP_SMIF_MODE_CHANGE), all zero otherwise.
+ */
+typedef struct
+{
+    uint32_t last_op_max_us;    /* Longest blackout of the most recent erase or write */
+    uint32_t max_us;            /* Longest blackout since the last reset              */
+    uint32_t blackouts;         /* Number of times XIP was turned off                 */
+    uint32_t total_us;          /* Time XIP was off since the last reset              */
+    uint32_t sessions;          /* Flash sessions started since the last reset        */
+} cy_ota_mem_xip_blackout_t;
+
+/**
+ * Time taken to read the same range of the external flash through the
+ * memory-mapped window, starting with an empty SMIF cache, and in command mode.
+ */
+typedef struct
+{
+    uint32_t bytes;             /* Bytes read in each mode        */
+    uint32_t mapped_us;         /* Memory-mapped read time        */
+    uint32_t command_us;        /* Command mode read time         */
+} cy_ota_mem_read_benchmark_t;
+
+/* Number of buckets of the latency histograms. Bucket n counts the operations
+ * that took 2^n to 2^(n+1)-1 microseconds, bucket 0 also the ones below 1 us
+ * and the last bucket also all the longer ones.
+ */
+#ifndef OTA_MEM_LATENCY_BUCKETS
+#define OTA_MEM_LATENCY_BUCKETS             (20u)
+#endif
+
+/* Memory types the operation statistics are kept for */
+#define CY_OTA_MEM_STATS_INTERNAL           (0u)
+#define CY_OTA_MEM_STATS_EXTERNAL           (1u)
+#define CY_OTA_MEM_STATS_MEM_TYPES          (2u)
+
+/**
+ * Flash operations the statistics are kept for
+ */
+typedef enum
+{
+    CY_OTA_MEM_OP_READ = 0,     /* Read of the flash, including read back and blank checks       */
+    CY_OTA_MEM_OP_PROGRAM,      /* Program of a row, or of the pages of a range of external flash */
+    CY_OTA_MEM_OP_ERASE,        /* Erase of a range of sectors                                  */
+    CY_OTA_MEM_OP_BLANK_SKIP,   /* Blank check of a sector that then was not erased             */
+
+    CY_OTA_MEM_OP_COUNT
+} cy_ota_mem_op_t;
+
+/**
+ * Count, bytes and latency of one operation on one memory type, timed with
+ * the DWT cycle counter. Operations longer than a wrap of the cycle counter
+ * (2^32 CPU cycles) are not timed correctly.
+ */
+typedef struct
+{
+    uint32_t count;                                 /* Operations done                          */
+    uint32_t bytes;                                 /* Bytes read, programmed or erased         */
+    uint32_t max_us;                                /* Longest operation                        */
+    uint64_t total_us;                              /* Time spent in the operations             */
+    uint32_t histogram[OTA_MEM_LATENCY_BUCKETS];    /* Operations by log2 of the latency in us  */
+} cy_ota_mem_op_stats_t;
+
+typedef struct
+{
+    /* Indexed by CY_OTA_MEM_STATS_INTERNAL / CY_OTA_MEM_STATS_EXTERNAL and cy_ota_mem_op_t */
+    cy_ota_mem_op_stats_t op[CY_OTA_MEM_STATS_MEM_TYPES][CY_OTA_MEM_OP_COUNT];
+} cy_ota_mem_op_stats_table_t;
+
+/**
+ * Function called for each sector erased through the cy_ota_mem_*() functions.
+ * Internal flash sectors are passed by their offset from CY_FLASH_BASE,
+ * external flash sectors by their address in the XIP window. It is called
+ * with the flash lock held, possibly with XIP just turned back on, and must
+ * only update RAM.
+ */
+typedef void (*cy_ota_mem_erase_hook_t)( cy_ota_mem_type_t mem_type, uint32_t sector_addr, uint32_t sector_size );
+
+/**
+ * @brief Program all the rows held in the write-combining buffer
+ *
+ * cy_ota_mem_write() collects writes that cover only part of a flash row and
+ * programs the row once it is complete. This must be called before the data
+ * is expected to be in flash, e.g. on closing the storage and before a reboot.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_flush( void );
+
+/**
+ * @brief Get the write counters of cy_ota_mem_write()
+ *
+ * @param[out]  stats      Pointer to the structure to store the counters in.
+ */
+void cy_ota_mem_get_write_stats(cy_ota_mem_write_stats_t *stats);
+
+/**
+ * @brief Clear the write counters of cy_ota_mem_write(), the operation statistics and the XIP blackout statistics
+ */
+void cy_ota_mem_reset_write_stats(void);
+
+/**
+ * @brief Get the count, bytes and latency histogram of each flash operation
+ *
+ * @param[out]  stats      Pointer to the structure to store the statistics in.
+ */
+void cy_ota_mem_get_op_stats(cy_ota_mem_op_stats_table_t *stats);
+
+/**
+ * @brief Get the times the external flash was taken out of XIP mode
+ *
+ * @param[out]  stats      Pointer to the structure to store the statistics in.
+ */
+void cy_ota_mem_get_xip_blackout(cy_ota_mem_xip_blackout_t *stats);
+
+/**
+ * @brief Erase the next sector of a region ahead of time
+ *
+ * Each call erases one erase sector after the blank watermark of the region
+ * and moves the watermark past it, a sector that is blank already is not
+ * erased again. cy_ota_mem_erase() skips the part of a
+ * request below the watermark, cy_ota_mem_write() moves the watermark back
+ * when it writes below it. Calling it for another region restarts from 0.
+ * The watermark is kept in RAM only, the bootloader may change the region
+ * on the next boot.
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ * @param[in]   addr       Start address of the region.
+ * @param[in]   len        Size of the region in bytes.
+ * @param[out]  blank_len  Number of bytes from the start of the region known to be blank.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_pre_erase_step( cy_ota_mem_type_t mem_type, uint32_t addr, size_t len, uint32_t *blank_len );
+
+/**
+ * @brief Enable or disable erasing on demand
+ *
+ * While enabled, cy_ota_mem_erase() only remembers the range. cy_ota_mem_write()
+ * erases each sector of it just before the first write to it, and skips the
+ * erase if the sector is blank already. Sectors that are never written, e.g.
+ * past the end of a smaller image, are never erased. cy_ota_mem_read() returns
+ * 0xFF for the part of the range that is not erased yet. Disabling it forgets
+ * the ranges without erasing them.
+ *
+ * @param[in]   enable     true to leave erases to the first write of each sector.
+ */
+void cy_ota_mem_set_erase_on_demand( bool enable );
+
+/**
+ * @brief Erase now the sectors of a range that are left to erase on demand
+ *
+ * The ranges left to erase on demand are only kept in RAM. Areas that must be
+ * blank after a reset, e.g. the next records of a log, are erased with
+ * cy_ota_mem_erase() and then this.
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ * @param[in]   addr       Starting address of the range.
+ * @param[in]   len        Number of bytes in the range.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_erase_pending( cy_ota_mem_type_t mem_type, uint32_t addr, size_t len );
+
+/**
+ * @brief Keep the content of the sectors of a range that are left to erase on demand
+ *
+ * Takes the sectors holding any part of the range out of the ranges left to
+ * erase on demand, e.g. the sectors of an interrupted download that is
+ * resumed. Their content is kept and later writes do not erase them. A range
+ * split in two takes a free range, without one the upper part is erased now.
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ * @param[in]   addr       Starting address of the range.
+ * @param[in]   len        Number of bytes in the range.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_erase_cancel( cy_ota_mem_type_t mem_type, uint32_t addr, size_t len );
+
+/**
+ * @brief Get the size of the sector erased on demand at an address
+ *
+ * Unlike cy_ota_mem_get_erase_size(), which reports the erase unit MCUboot
+ * uses, this is the sector cy_ota_mem_erase_cancel() keeps whole, e.g. to
+ * know which sectors a resumed download has written completely.
+ *
+ * @param[in]   mem_type   Memory type @ref cy_ota_mem_type_t
+ * @param[in]   addr       Address that belongs to the sector.
+ *
+ * @return    Sector size in bytes, 0 if the address can not be erased.
+ */
+size_t cy_ota_mem_get_erase_sector_size( cy_ota_mem_type_t mem_type, uint32_t addr );
+
+/**
+ * @brief Time reads of the external flash through the memory-mapped window and in command mode
+ *
+ * cy_ota_mem_read() uses the memory-mapped window for external flash when
+ * OTA_SMIF_MEMORY_MAPPED_READ is set and no program or erase of the range is
+ * in flight. This reads the range both ways to compare them.
+ *
+ * @param[in]   addr       Start address of the range to read.
+ * @param[in]   len        Number of bytes to read.
+ * @param[out]  result     Read times of both modes.
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure, or if the range can not be read memory-mapped
+ */
+cy_rslt_t cy_ota_mem_read_benchmark( uint32_t addr, size_t len, cy_ota_mem_read_benchmark_t *result );
+
+/**
+ * @brief Set the function called for each sector erased
+ *
+ * Sectors erased ahead of time and on demand are passed to it when they are
+ * erased, sectors found blank and not erased are not.
+ *
+ * @param[in]   hook       Function to call, NULL for none.
+ */
+void cy_ota_mem_set_erase_hook( cy_ota_mem_erase_hook_t hook );
+
+/**
+ * @brief Start a flash session
+ *
+ * Groups the flash operations of the calling task, e.g. all the writes of a
+ * chunk, until cy_ota_mem_session_end(). The other tasks wait for their flash
+ * operations until the session ends. Within a session the programs of
+ * consecutive external flash pages share XIP-off windows of up to
+ * OTA_MEM_SESSION_MAX_XIP_OFF_US instead of turning XIP off and on for each
+ * of them. XIP is always back on when a cy_ota_mem_*() call returns, the
+ * caller may execute from the external flash. Sessions may be nested, each
+ * call must be matched by a call to cy_ota_mem_session_end().
+ *
+ * @return  CY_RSLT_SUCCESS on success
+ *          CY_RSLT_TYPE_ERROR on failure
+ */
+cy_rslt_t cy_ota_mem_session_begin( void );
+
+/**
+ * @brief End a flash session started with cy_ota_mem_session_begin()
+ */
+void cy_ota_mem_session_end( void );
+
+#endif /* _CY_OTA_FLASH_EXT_H */
@@ -190,6 +190,8 @@ extern "C" {
  * *
  * Used with sprintf() to insert the current version and UniqueTopicName at runtime.
  * Override if desired by defining in cy_ota_config.h.
+ * MaxChunkSize is overwritten with the chunk size to use before the message is
+ * sent, see ota_chunk_size_advertise().
  */
 #define CY_OTA_DOWNLOAD_REQUEST \
 "{\
@@ -200,6 +202,7 @@ extern "C" {
 \"SerialNumber\": \"ABC213450001\", \
 \"BoardName\": \"CY8CPROTO_062_4343W\", \
 \"Version\": \"%d.%d.%d\", \
+\"MaxChunkSize\": \"04096\", \
 \"UniqueTopicName\": \"%s\"\
 }"
 
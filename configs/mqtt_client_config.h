@@ -95,6 +95,22 @@
 #define MQTT_DEVICE_ON_MESSAGE            "TURN ON"
 #define MQTT_DEVICE_OFF_MESSAGE           "TURN OFF"
 
+/* Message on the MQTT_SUB_TOPIC that requests the flash operation statistics.
+ * The device publishes them on MQTT_FLASH_STATS_TOPIC, one line per memory
+ * type and operation: "<mem> <op> <count> <bytes> <total ms> <max us>"
+ * followed by the non-empty latency buckets as "<log2 us>:<count>".
+ */
+#define MQTT_FLASH_STATS_REQUEST_MESSAGE  "FLASH STATS"
+#define MQTT_FLASH_STATS_TOPIC            MQTT_PUB_TOPIC "/flashstats"
+
+/* Message on the MQTT_SUB_TOPIC that requests the wear table. The device
+ * publishes it on MQTT_FLASH_WEAR_TOPIC, a first line
+ * "<updates> <saves> <wear table area erases> <untracked erases>" and then
+ * one line "<sector address> <erases>" per sector.
+ */
+#define MQTT_FLASH_WEAR_REQUEST_MESSAGE   "FLASH WEAR"
+#define MQTT_FLASH_WEAR_TOPIC             MQTT_PUB_TOPIC "/flashwear"
+
 
 /******************* OTHER MQTT CLIENT CONFIGURATION MACROS *******************/
 /* A unique client identifier to be used for every MQTT connection. */
@@ -156,6 +172,19 @@
  */
 #define MQTT_NETWORK_BUFFER_SIZE          ( 2 * CY_MQTT_MIN_NETWORK_BUFFER_SIZE )
 
+/* The OTA agent opens its own MQTT session to the broker. Set this macro to
+ * 1 to close the session of the application while the OTA agent downloads an
+ * image, so only one TLS session holds heap and sends keep-alives during the
+ * download, and to reconnect once the agent is waiting again. Messages to the
+ * application are not received in the meantime.
+ */
+#define SUSPEND_MQTT_DURING_OTA          ( 1 )
+
+/* Longest time the OTA agent waits for the session of the application to be
+ * closed before it asks for the image, in milliseconds.
+ */
+#define MQTT_SUSPEND_WAIT_MS             ( 5000u )
+
 /* Maximum MQTT connection re-connection limit. */
 #define MAX_MQTT_CONN_RETRIES            (150u)
 
@@ -45,20 +45,12 @@
 #include "cy_ota_config.h"
 #include "cy_ota_api.h"
 
+/* The Wi-Fi network, shared by the OTA agent and the MQTT client */
+#include "wifi_config.h"
+
 /***********************************************
  * Connection configuration
  **********************************************/
-/* Name of the Wi-Fi network */
-#define WIFI_SSID           "MY_WIFI_SSID"
-
-/* Password for the Wi-Fi network */
-#define WIFI_PASSWORD       "MY_WIFI_PASSWORD"
-
-/* Security type of the Wi-Fi access point. See 'cy_wcm_security_t' structure
- * in "cy_wcm.h" for more details.
- */
-#define WIFI_SECURITY       (CY_WCM_SECURITY_WPA2_AES_PSK)
-
 /* MQTT Broker endpoint */
 #define MQTT_BROKER_URL     "192.168.1.56"
 
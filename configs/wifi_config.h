@@ -62,7 +62,11 @@
 /* Maximum Wi-Fi re-connection limit. */
 #define MAX_WIFI_CONN_RETRIES             (120u)
 
-/* Wi-Fi re-connection time interval in milliseconds. */
+/* Wi-Fi re-connection time interval in milliseconds. The first retry waits
+ * WIFI_CONN_RETRY_MIN_INTERVAL_MS, each further one twice as long up to
+ * WIFI_CONN_RETRY_INTERVAL_MS.
+ */
+#define WIFI_CONN_RETRY_MIN_INTERVAL_MS   (500)
 #define WIFI_CONN_RETRY_INTERVAL_MS       (5000)
 
 #endif /* WIFI_CONFIG_H_ */
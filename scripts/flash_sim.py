@@ -0,0 +1,559 @@
+# Python model of the OTA flash layer (configs/COMPONENT_MCUBOOT/flash/cy_ota_flash.c)
+# on a simulated NOR flash, to measure changes to the flash path without a board.
+#
+# The flash is a memory-mapped file with NOR semantics: erased bytes read 0xFF,
+# programming only clears bits, and erases must cover whole sectors of the
+# region they are in (hybrid sectors of the S25HS256T, regions of the XMC7200
+# platform flashmap). The S25HS256T computes its ECC over 16-byte units, a unit
+# must not be programmed a second time before it is erased. Every operation
+# adds to a simulated time from a timing model of the device.
+#
+# The benchmark replays an OTA download the way the OTA agent drives the
+# storage: erase of the upgrade slot on open, one write per chunk as
+# publisher.py splits the image, flush on close and the MCUboot trailer on
+# verify. It reports the simulated flash time, erases, programs, bytes read
+# back and the write amplification. With --check it fails when the write path
+# of the external flash reads the flash, only the blank check of a sector
+# erased on demand may read it.
+#
+# Usage:
+#   python flash_sim.py --flashmap ../flashmap/psoc62_2m_ext_swap_single.json --size 1000000
+#   python flash_sim.py --flashmap ../flashmap/xmc7200_int_swap_single.json --image app.bin --chunk-size 4000
+#   python flash_sim.py --flashmap ../flashmap/*.json --check
+#   python flash_sim.py --help
+#
+# xmc7200_platform.json only describes the flash regions, the upgrade slot is
+# then taken from --slot, or from xmc7200_int_swap_single.json next to it.
+#
+# The timing values are typical datasheet figures, override them with
+# --timing <json file> holding any of the keys of DEVICE_PROFILES.
+#
+import argparse
+import json
+import mmap
+import os
+import random
+import sys
+import tempfile
+
+# Size of each chunk publisher.py sends to the Device (CHUNK_SIZE in publisher.py)
+PUBLISHER_CHUNK_SIZE = 4 * 1024
+
+# Defaults of the flash layer, see cy_ota_flash.c
+CY_FLASH_SIZEOF_ROW = 512
+OTA_MEM_COMBINE_ROWS = 2
+
+# Start of the external flash in the memory map of PSoC6 (CY_XIP_BASE)
+CY_XIP_BASE = 0x18000000
+
+# MCUboot image trailer, written at the end of the slot by cy_ota_storage_verify()
+BOOT_MAGIC_SIZE = 16
+BOOT_MAX_ALIGN = 8
+
+ERASED_BYTE = 0xFF
+
+# ---------------------------------------------------------
+#   Device profiles
+#       regions      - (offset, size, erase_size) from the start of the device
+#       program_size - largest program operation, may not cross its boundary
+#       program_us   - time of one program operation of program_size bytes
+#       erase_us     - sector erase time by erase size
+#       read_us_per_kb, op_overhead_us - read and command overhead
+#       write_erases - a program operation erases the row first (PSoC6 WriteRow)
+#       program_once_size - unit that must be erased before it is programmed
+#                      again, 0 if bits may be cleared by several programs
+# ---------------------------------------------------------
+DEVICE_PROFILES = {
+    "S25HS256T": {
+        "size": 0x2000000,
+        "regions": [(0x0, 0x20000, 0x1000),         # 32 x 4 KB hybrid sectors at the bottom
+                    (0x20000, 0x20000, 0x20000),    # rest of the first 256 KB sector
+                    (0x40000, 0x1FC0000, 0x40000)],
+        "program_size": 256,
+        "program_us": 400,
+        "erase_us": {0x1000: 30000, 0x20000: 500000, 0x40000: 930000},
+        "read_us_per_kb": 41,                       # quad SPI at 50 MHz
+        "op_overhead_us": 2,
+        "write_erases": False,
+        "program_once_size": 16,                    # ECC unit, MCUboot trailer fields share a page
+    },
+    "PSOC6_INTERNAL": {
+        "size": 0x200000,
+        "regions": [(0x0, 0x200000, CY_FLASH_SIZEOF_ROW)],
+        "program_size": CY_FLASH_SIZEOF_ROW,
+        "program_us": 16000,                        # Cy_Flash_WriteRow(), erase and program
+        "erase_us": {CY_FLASH_SIZEOF_ROW: 11000},
+        "read_us_per_kb": 10,
+        "op_overhead_us": 0,
+        "write_erases": True,
+        "program_once_size": 0,
+    },
+    "XMC7200_INTERNAL": {
+        "size": 0x840000,
+        "regions": [],                              # from xmc7200_platform.json
+        "program_size": CY_FLASH_SIZEOF_ROW,
+        "program_us": 3000,
+        "erase_us": {0x8000: 45000, 0x2000: 15000, 0x800: 40000, 0x80: 15000},
+        "read_us_per_kb": 10,
+        "op_overhead_us": 0,
+        "write_erases": False,
+        "program_once_size": 0,
+    },
+}
+
+
+class FlashError(Exception):
+    pass
+
+
+# ---------------------------------------------------------
+#   NorFlash
+#       File-backed flash device enforcing NOR semantics
+# ---------------------------------------------------------
+class NorFlash:
+    def __init__(self, name, profile, base, path=None):
+        self.name = name
+        self.profile = profile
+        self.base = base
+        self.size = profile["size"]
+        if path is None:
+            self.file = tempfile.TemporaryFile()
+        else:
+            self.file = open(path, "w+b")
+        self.file.truncate(self.size)
+        self.mem = mmap.mmap(self.file.fileno(), self.size)
+        self.mem[:] = bytes([ERASED_BYTE]) * self.size
+        self.time_us = {"program": 0, "erase": 0, "read": 0}
+        self.programs = 0
+        self.bytes_read = 0
+        self.bytes_blank_checked = 0
+        self.erases = {}
+        self.programmed = set()                     # units programmed since their last erase
+
+    def contains(self, addr):
+        return self.base <= addr < self.base + self.size
+
+    def region(self, offset):
+        for start, size, erase_size in self.profile["regions"]:
+            if start <= offset < start + size:
+                return start, size, erase_size
+        raise FlashError("%s: 0x%08x is outside of the flash regions" % (self.name, self.base + offset))
+
+    def erase_size(self, offset):
+        return self.region(offset)[2]
+
+    def read(self, offset, length, blank_check=False):
+        self.bytes_read += length
+        if blank_check:
+            self.bytes_blank_checked += length
+        self.time_us["read"] += self.profile["op_overhead_us"] + (length * self.profile["read_us_per_kb"]) // 1024
+        return bytes(self.mem[offset:offset + length])
+
+    def program(self, offset, data):
+        size = self.profile["program_size"]
+        if (offset // size) != ((offset + len(data) - 1) // size):
+            raise FlashError("%s: program of %d bytes at 0x%08x crosses a page" % (self.name, len(data), offset))
+        if self.profile["write_erases"]:
+            row = offset - (offset % size)
+            self.mem[row:row + size] = bytes([ERASED_BYTE]) * size
+        unit = self.profile.get("program_once_size", 0)
+        if unit:
+            units = range(offset // unit, (offset + len(data) - 1) // unit + 1)
+            if any(u in self.programmed for u in units):
+                raise FlashError("%s: program at 0x%08x hits a %d byte unit programmed since its last erase"
+                                 % (self.name, self.base + offset, unit))
+            self.programmed.update(units)
+        current = int.from_bytes(self.mem[offset:offset + len(data)], "little")
+        value = int.from_bytes(data, "little")
+        if (current & value) != value:
+            raise FlashError("%s: program at 0x%08x sets bits that are not erased" % (self.name, self.base + offset))
+        self.mem[offset:offset + len(data)] = bytes(data)
+        self.programs += 1
+        self.time_us["program"] += self.profile["op_overhead_us"] + self.profile["program_us"]
+
+    def erase(self, offset):
+        erase_size = self.erase_size(offset)
+        if offset % erase_size:
+            raise FlashError("%s: erase at 0x%08x is not on a %d byte sector boundary"
+                             % (self.name, self.base + offset, erase_size))
+        self.mem[offset:offset + erase_size] = bytes([ERASED_BYTE]) * erase_size
+        unit = self.profile.get("program_once_size", 0)
+        if unit:
+            self.programmed.difference_update(range(offset // unit, (offset + erase_size) // unit))
+        self.erases[erase_size] = self.erases.get(erase_size, 0) + 1
+        self.time_us["erase"] += self.profile["op_overhead_us"] + self.profile["erase_us"][erase_size]
+
+
+# ---------------------------------------------------------
+#   OtaMem
+#       The cy_ota_mem_*() policies of cy_ota_flash.c: write-combining of
+#       partial internal flash rows, page programming of external flash
+#       without read back, erase on demand with blank sectors skipped.
+# ---------------------------------------------------------
+class OtaMem:
+    def __init__(self, flash, erase_on_demand=True, combine_rows=OTA_MEM_COMBINE_ROWS):
+        self.flash = flash
+        self.external = flash.base == CY_XIP_BASE
+        self.erase_on_demand = erase_on_demand
+        self.combine_rows = combine_rows
+        self.combine = {}                           # row offset -> {byte offset: value}
+        self.combine_use = []
+        self.pending = []                           # [start, end) offsets still to be erased
+        self.blank = None                           # [start, end) erased ahead of time and not written since
+        self.bytes_requested = 0
+        self.bytes_programmed = 0
+        self.write_calls = 0
+        self.sectors_erased = 0
+        self.sectors_blank = 0
+
+    def offset(self, addr):
+        if not self.flash.contains(addr):
+            raise FlashError("0x%08x is not in %s" % (addr, self.flash.name))
+        return addr - self.flash.base
+
+    # cy_ota_mem_get_prog_size()
+    def get_prog_size(self, addr):
+        return self.flash.profile["program_size"] if self.external else CY_FLASH_SIZEOF_ROW
+
+    # cy_ota_mem_get_erase_size()
+    def get_erase_size(self, addr):
+        return self.flash.erase_size(self.offset(addr))
+
+    def sector_bounds(self, offset, end):
+        start = offset - (offset % self.flash.erase_size(offset))
+        last = end - 1
+        end = last - (last % self.flash.erase_size(last)) + self.flash.erase_size(last)
+        return start, end
+
+    # cy_ota_mem_read(), sectors still to be erased read as erased
+    def read(self, addr, length):
+        offset = self.offset(addr)
+        data = bytearray(self.flash.read(offset, length))
+        for start, end in self.pending:
+            first, last = max(start, offset), min(end, offset + length)
+            if first < last:
+                data[first - offset:last - offset] = bytes([ERASED_BYTE]) * (last - first)
+        for row, values in self.combine.items():
+            for i, value in values.items():
+                if offset <= row + i < offset + length:
+                    data[row + i - offset] = value
+        return bytes(data)
+
+    # cy_ota_mem_pre_erase_step() run over the whole range
+    def pre_erase(self, addr, length):
+        offset = self.offset(addr)
+        start, end = self.sector_bounds(offset, offset + length)
+        self.erase_range(start, end)
+        self.blank = [offset, offset + length]
+
+    # ota_mem_blank_region_written(), the sector holding the first byte written is no longer blank
+    def blank_written(self, offset, length):
+        if self.blank is None or offset + length <= self.blank[0] or offset >= self.blank[1]:
+            return
+        first = max(offset, self.blank[0])
+        first -= first % self.flash.erase_size(first)
+        self.blank[1] = max(first, self.blank[0])
+
+    # cy_ota_mem_erase()
+    def erase(self, addr, length):
+        offset = self.offset(addr)
+        # The part erased ahead of time and not written since is skipped
+        if self.blank is not None and self.blank[0] <= offset < self.blank[1]:
+            if offset + length <= self.blank[1]:
+                return
+            length -= self.blank[1] - offset
+            offset = self.blank[1]
+        start, end = self.sector_bounds(offset, offset + length)
+        for row in [r for r in self.combine if start <= r < end]:
+            del self.combine[row]
+            self.combine_use.remove(row)
+        if self.erase_on_demand:
+            self.pending.append([start, end])
+            return
+        self.erase_range(start, end)
+
+    def erase_range(self, start, end):
+        while start < end:
+            self.flash.erase(start)
+            start += self.flash.erase_size(start)
+
+    # ota_mem_is_blank(), read one row at a time up to the first one programmed
+    def is_blank(self, start, size):
+        for row in range(start, start + size, CY_FLASH_SIZEOF_ROW):
+            if self.flash.read(row, CY_FLASH_SIZEOF_ROW, True) != bytes([ERASED_BYTE]) * CY_FLASH_SIZEOF_ROW:
+                return False
+        return True
+
+    def erase_pending_before_write(self, offset, length):
+        for pending in list(self.pending):
+            start, end = pending
+            if end <= offset or start >= offset + length:
+                continue
+            # Erase the sectors of the range that are written, sector by sector
+            sector = max(start, offset)
+            sector -= sector % self.flash.erase_size(sector)
+            while sector < min(end, offset + length):
+                size = self.flash.erase_size(sector)
+                if self.is_blank(sector, size):
+                    self.sectors_blank += 1
+                else:
+                    self.flash.erase(sector)
+                    self.sectors_erased += 1
+                sector += size
+            self.pending.remove(pending)
+            if start < offset - (offset % self.flash.erase_size(offset)):
+                self.pending.append([start, offset - (offset % self.flash.erase_size(offset))])
+            if sector < end:
+                self.pending.append([sector, end])
+
+    def program_row(self, row, data):
+        # Internal flash rows that already hold the data are not programmed again
+        if self.flash.read(row, len(data)) == bytes(data):
+            return
+        self.flash.program(row, data)
+        self.bytes_programmed += len(data)
+
+    def flush_row(self, row):
+        values = self.combine.pop(row)
+        self.combine_use.remove(row)
+        data = bytearray(self.flash.read(row, CY_FLASH_SIZEOF_ROW)) if len(values) < CY_FLASH_SIZEOF_ROW \
+            else bytearray(CY_FLASH_SIZEOF_ROW)
+        for i, value in values.items():
+            data[i] = value
+        self.program_row(row, data)
+
+    # cy_ota_mem_write()
+    def write(self, addr, data):
+        offset = self.offset(addr)
+        self.write_calls += 1
+        self.bytes_requested += len(data)
+        self.blank_written(offset, len(data))
+        self.erase_pending_before_write(offset, len(data))
+
+        if self.external:
+            # Page programming, the rest of a partial page stays erased
+            page = self.flash.profile["program_size"]
+            pos = 0
+            while pos < len(data):
+                count = min(page - ((offset + pos) % page), len(data) - pos)
+                self.flash.program(offset + pos, data[pos:pos + count])
+                self.bytes_programmed += count
+                pos += count
+            return
+
+        pos = 0
+        while pos < len(data):
+            row = (offset + pos) - ((offset + pos) % CY_FLASH_SIZEOF_ROW)
+            row_offset = offset + pos - row
+            count = min(CY_FLASH_SIZEOF_ROW - row_offset, len(data) - pos)
+            if count == CY_FLASH_SIZEOF_ROW:
+                if row in self.combine:
+                    del self.combine[row]
+                    self.combine_use.remove(row)
+                self.program_row(row, data[pos:pos + count])
+            elif self.combine_rows == 0:
+                buf = bytearray(self.flash.read(row, CY_FLASH_SIZEOF_ROW))
+                buf[row_offset:row_offset + count] = data[pos:pos + count]
+                self.program_row(row, buf)
+            else:
+                if row not in self.combine:
+                    if len(self.combine) >= self.combine_rows:
+                        self.flush_row(self.combine_use[0])
+                    self.combine[row] = {}
+                else:
+                    self.combine_use.remove(row)
+                self.combine_use.append(row)
+                for i in range(count):
+                    self.combine[row][row_offset + i] = data[pos + i]
+                if len(self.combine[row]) == CY_FLASH_SIZEOF_ROW:
+                    self.flush_row(row)
+            pos += count
+
+    # cy_ota_mem_flush()
+    def flush(self):
+        for row in list(self.combine_use):
+            self.flush_row(row)
+
+
+# ---------------------------------------------------------
+#   load_flashmap()
+#       Returns the device profile name, the flash base address, the
+#       upgrade slot (address, size) and the flash regions of a flashmap
+#       JSON file. The slot of a platform file holding only the regions is
+#       given by slot, or is the one of the default XMC7200 layout.
+# ---------------------------------------------------------
+def load_platform_regions(platform_path):
+    with open(platform_path) as f:
+        regions = json.load(f)["memory_regions"]
+    base = min(int(r["address"], 0) for r in regions)
+    return base, [(int(r["address"], 0) - base, int(r["size"], 0), int(r["erase_size"], 0)) for r in regions]
+
+
+def load_flashmap(path, slot=None, platform_path=None):
+    with open(path) as f:
+        flashmap = json.load(f)
+
+    if "memory_regions" in flashmap:
+        if slot is None:
+            default_path = os.path.join(os.path.dirname(path), "xmc7200_int_swap_single.json")
+            _, _, slot_addr, slot_size, _ = load_flashmap(default_path, platform_path=path)
+        else:
+            slot_addr, slot_size = slot
+        base, region_list = load_platform_regions(path)
+        return "XMC7200_INTERNAL", base, slot_addr, slot_size, region_list
+
+    if "boot_and_upgrade" in flashmap:
+        app = flashmap["boot_and_upgrade"]["application_1"]
+        slot_addr = int(app["upgrade_address"]["value"], 0)
+        slot_size = int(app["upgrade_size"]["value"], 0)
+    else:
+        slots = flashmap["application_1"]["slots"]
+        slot_addr = int(slots["upgrade"], 0)
+        slot_size = int(slots["size"], 0)
+
+    if slot_addr >= CY_XIP_BASE and "external_flash" in flashmap:
+        model = flashmap["external_flash"][0]["model"]
+        if model not in DEVICE_PROFILES:
+            raise FlashError("No timing model for external flash %s" % model)
+        return model, CY_XIP_BASE, slot_addr, slot_size, None
+
+    if platform_path is None:
+        platform_path = os.path.join(os.path.dirname(path), "xmc7200_platform.json")
+    if "bootloader" in flashmap and os.path.exists(platform_path):
+        base, region_list = load_platform_regions(platform_path)
+        return "XMC7200_INTERNAL", base, slot_addr, slot_size, region_list
+
+    return "PSOC6_INTERNAL", 0x10000000, slot_addr, slot_size, None
+
+
+# ---------------------------------------------------------
+#   chunks()
+#       Offsets and sizes of the chunks of the image, as do_chunking() in
+#       publisher.py splits it. "shuffled" sends them out of order.
+# ---------------------------------------------------------
+def chunks(image_size, chunk_size, pattern):
+    offsets = list(range(0, image_size, chunk_size))
+    if pattern == "shuffled":
+        random.Random(0).shuffle(offsets)
+    return [(offset, min(chunk_size, image_size - offset)) for offset in offsets]
+
+
+def run_benchmark(args, flashmap_path):
+    model, base, slot_addr, slot_size, regions = load_flashmap(flashmap_path, args.slot)
+    profile = dict(DEVICE_PROFILES[model])
+    if regions is not None:
+        profile["regions"] = regions
+    if args.timing:
+        with open(args.timing) as f:
+            profile.update(json.load(f).get(model, {}))
+
+    flash = NorFlash(model, profile, base, args.backing)
+    mem = OtaMem(flash, erase_on_demand=not args.no_erase_on_demand, combine_rows=args.combine_rows)
+
+    if args.image:
+        with open(args.image, "rb") as f:
+            image = f.read()
+    else:
+        image = random.Random(1).randbytes(args.size)
+    if len(image) > slot_size - BOOT_MAGIC_SIZE - 4 * BOOT_MAX_ALIGN:
+        raise FlashError("Image of %d bytes does not fit the %d byte slot" % (len(image), slot_size))
+
+    # Slot content left from the previous update, unless it was pre-erased
+    if not args.pre_erased:
+        old = random.Random(2).randbytes(min(slot_size, len(image) + 0x10000))
+        setup = OtaMem(flash, erase_on_demand=False)
+        setup.erase(slot_addr, len(old))
+        setup.write(slot_addr, old)
+        setup.flush()
+        flash.time_us = {"program": 0, "erase": 0, "read": 0}
+        flash.programs = 0
+        flash.bytes_read = 0
+        flash.bytes_blank_checked = 0
+        flash.erases = {}
+    else:
+        # The pre-erase task erases the slot before the download starts
+        mem.pre_erase(slot_addr, slot_size)
+        flash.time_us = {"program": 0, "erase": 0, "read": 0}
+        flash.bytes_read = 0
+        flash.erases = {}
+
+    # cy_ota_storage_open() erases the slot, cy_ota_storage_write() per chunk
+    chunk_list = chunks(len(image), args.chunk_size, args.pattern)
+    chunk_times = []
+    mem.erase(slot_addr, slot_size)
+    for offset, size in chunk_list:
+        before = sum(flash.time_us.values())
+        mem.write(slot_addr + offset, image[offset:offset + size])
+        chunk_times.append(sum(flash.time_us.values()) - before)
+
+    # cy_ota_storage_close() and cy_ota_storage_verify(), pending trailer
+    mem.flush()
+    mem.write(slot_addr + slot_size - BOOT_MAGIC_SIZE, bytes(range(BOOT_MAGIC_SIZE)))
+    mem.write(slot_addr + slot_size - BOOT_MAGIC_SIZE - 3 * BOOT_MAX_ALIGN, bytes([0x01]))
+    mem.flush()
+
+    time_us = dict(flash.time_us)
+    total_us = sum(time_us.values())
+    bytes_read = flash.bytes_read
+    bytes_blank_checked = flash.bytes_blank_checked
+    if mem.read(slot_addr, len(image)) != image:
+        raise FlashError("The slot does not hold the image after the download")
+
+    print("Device         : %s, upgrade slot 0x%08x size 0x%x" % (model, slot_addr, slot_size))
+    print("Image          : %d bytes in %d chunks of %d bytes (%s)"
+          % (len(image), len(chunk_list), args.chunk_size, args.pattern))
+    print("Flash time     : %d ms (program %d ms, erase %d ms, read %d ms)"
+          % (total_us // 1000, time_us["program"] // 1000, time_us["erase"] // 1000, time_us["read"] // 1000))
+    print("Erases         : " + (", ".join("%d x %d KB" % (n, size // 1024 if size >= 1024 else size)
+                                           for size, n in sorted(flash.erases.items())) or "none"))
+    print("Sectors        : %d erased on demand, %d skipped as blank" % (mem.sectors_erased, mem.sectors_blank))
+    print("Programs       : %d operations, %d bytes programmed" % (flash.programs, mem.bytes_programmed))
+    print("Read back      : %d bytes, %d of them to check sectors erased on demand for blank"
+          % (bytes_read, bytes_blank_checked))
+    print("Write amplif.  : %d/100" % ((mem.bytes_programmed * 100) // max(mem.bytes_requested, 1)))
+    if args.network_kbps:
+        network_us = [(size * 8 * 1000) // args.network_kbps for _, size in chunk_list]
+        serial = sum(network_us) + sum(chunk_times)
+        pipelined = sum(max(n, f) for n, f in zip(network_us, chunk_times))
+        print("Download       : %d ms in series, %d ms with the flash service pipeline (%d kbit/s network)"
+              % (serial // 1000, pipelined // 1000, args.network_kbps))
+
+    # Model check: external flash pages are programmed without reading the flash back
+    if args.check and mem.external and bytes_read != bytes_blank_checked:
+        raise FlashError("The write path read %d bytes of the external flash" % (bytes_read - bytes_blank_checked))
+    if args.check and mem.external and args.pre_erased and bytes_read != 0:
+        raise FlashError("%d bytes read from a slot erased ahead of time" % bytes_read)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Replay an OTA download on a simulated NOR flash")
+    parser.add_argument("--flashmap", required=True, nargs="+",
+                        help="flashmap JSON files selected with OTA_FLASH_MAP, each is run in turn")
+    parser.add_argument("--slot", type=lambda v: tuple(int(x, 0) for x in v.split(":")),
+                        help="upgrade slot address:size, for a platform file that only holds the flash regions")
+    parser.add_argument("--image", help="OTA image to download, random data of --size bytes if not given")
+    parser.add_argument("--size", type=int, default=512 * 1024, help="size of the random image")
+    parser.add_argument("--chunk-size", type=int, default=PUBLISHER_CHUNK_SIZE, help="bytes per chunk")
+    parser.add_argument("--pattern", choices=["sequential", "shuffled"], default="sequential",
+                        help="order the chunks are received in")
+    parser.add_argument("--pre-erased", action="store_true", help="the slot is blank already (pre-erase task)")
+    parser.add_argument("--no-erase-on-demand", action="store_true", help="erase the whole slot on open")
+    parser.add_argument("--combine-rows", type=int, default=OTA_MEM_COMBINE_ROWS,
+                        help="rows of the write-combining buffer (OTA_MEM_COMBINE_ROWS)")
+    parser.add_argument("--network-kbps", type=int, default=0, help="network throughput to compare the flash with")
+    parser.add_argument("--timing", help="JSON file overriding the device profiles")
+    parser.add_argument("--check", action="store_true",
+                        help="fail if the flash is read other than to check sectors erased on demand for blank")
+    parser.add_argument("--backing", help="file backing the simulated flash, a temporary file if not given")
+    args = parser.parse_args()
+
+    failed = False
+    for flashmap_path in args.flashmap:
+        if len(args.flashmap) > 1:
+            print("\n%s" % flashmap_path)
+        try:
+            run_benchmark(args, flashmap_path)
+        except FlashError as e:
+            print("Error: " + str(e))
+            failed = True
+    sys.exit(1 if failed else 0)
@@ -1,5 +1,6 @@
 import json
 import os
+import queue
 import random
 import re
 import signal
@@ -165,6 +166,7 @@
 #       "SerialNumber": "<serial number>",
 #       "BoardName": "CY8CPROTO_062_4343W",
 #       "Version": "<software version>",
+#       "MaxChunkSize": "<largest chunk size the Device can take>",
 #       "UniqueTopicName": "<my unique topic>",
 #       ... other info as desired ...
 #   }
@@ -273,8 +275,25 @@
 
 # Each Chunk of the OTA Image needs a header for the Device to handle the chunk properly
 #
-# Size of each chunk of data sent to the Device when splitting the OTA Image
+# Size of each chunk of data sent to the Device when splitting the OTA Image,
+# unless the "Request Update" message has a "MaxChunkSize" within the bounds.
+# The chunk size is a 16-bit field of the chunk header.
 CHUNK_SIZE = 4 * 1024
+CHUNK_SIZE_MIN = 512
+CHUNK_SIZE_MAX = 32 * 1024
+
+# Chunks are published without waiting for the PUBACK of the previous one.
+# Up to CHUNK_WINDOW chunks wait for their PUBACK at a time, the window grows
+# by one chunk per window acknowledged and is halved when the PUBACK round
+# trip time exceeds CHUNK_WINDOW_RTT_FACTOR times the shortest seen.
+# Set with "-w <window>", 1 sends one chunk at a time.
+CHUNK_WINDOW = 8
+CHUNK_WINDOW_MAX = 32
+CHUNK_WINDOW_RTT_FACTOR = 2.0
+
+# A chunk sender serves all the "Request Data Chunk" messages of a Device on
+# one connection, and disconnects after this many seconds without a request.
+CHUNK_SENDER_IDLE_TIMEOUT = 30
 
 # OTA header information - MUST match Device structure cy_ota_mqtt_chunk_payload_header_s
 #                          defined in ota-update/source/cy_ota_mqtt.c !!
@@ -306,6 +325,87 @@ def __init__(self, cname, **kwargs):
         super(MQTTSender, self).__init__(cname, **kwargs)
         self.connected_flag = False
         self.publish_mid = -1
+        self.chunk_window = None
+
+
+# Chunks waiting for their PUBACK, and the window adapted to the round trip time
+
+
+class ChunkWindow:
+    def __init__(self, window):
+        self.window = max(1, min(window, CHUNK_WINDOW_MAX))
+        self.outstanding = {}  # mid -> time the chunk was published
+        self.publishing = 0  # chunks being handed to the client, not yet in outstanding
+        self.early_acks = set()  # mids acknowledged before publish() recorded them
+        self.min_rtt = None
+        self.acked_in_window = 0
+        self.last_decrease = 0.0
+        self.cond = threading.Condition()
+
+    # Publish one chunk once the window has room for it
+    def publish(self, client, topic, packet):
+        global terminate
+        with self.cond:
+            while (len(self.outstanding) + self.publishing) >= self.window:
+                self.cond.wait(0.1)
+                if terminate:
+                    exit(0)
+            self.publishing += 1
+        # Not under the condition: client.publish() takes the client's own locks,
+        # which its network thread holds while calling acked()
+        sent = time.monotonic()
+        try:
+            info = client.publish(topic, packet, PUBLISHER_PUBLISH_QOS)
+        except Exception:
+            with self.cond:
+                self.publishing -= 1
+                self.cond.notify_all()
+            raise
+        with self.cond:
+            self.publishing -= 1
+            if info.mid in self.early_acks:
+                # The PUBACK arrived while client.publish() was returning
+                self.early_acks.discard(info.mid)
+                self.record_ack(sent)
+            else:
+                self.outstanding[info.mid] = sent
+            self.cond.notify_all()
+
+    # Adapt the window to the round trip time of one chunk, called with the condition held
+    def record_ack(self, sent):
+        now = time.monotonic()
+        rtt = now - sent
+        if self.min_rtt is None or rtt < self.min_rtt:
+            self.min_rtt = rtt
+        if rtt > (self.min_rtt * CHUNK_WINDOW_RTT_FACTOR) and (now - self.last_decrease) > rtt:
+            # The broker queues the chunks, back off once per round trip
+            self.window = max(1, self.window // 2)
+            self.acked_in_window = 0
+            self.last_decrease = now
+        else:
+            self.acked_in_window += 1
+            if self.acked_in_window >= self.window:
+                self.window = min(CHUNK_WINDOW_MAX, self.window + 1)
+                self.acked_in_window = 0
+
+    # PUBACK received, called from the network thread of the client
+    def acked(self, mid):
+        with self.cond:
+            sent = self.outstanding.pop(mid, None)
+            if sent is not None:
+                self.record_ack(sent)
+            elif self.publishing > 0:
+                self.early_acks.add(mid)
+            self.cond.notify_all()
+
+    # Wait for the PUBACK of all the chunks
+    def drain(self):
+        global terminate
+        with self.cond:
+            while (len(self.outstanding) + self.publishing) > 0:
+                self.cond.wait(0.1)
+                if terminate:
+                    exit(0)
 
 
 class MQTTPublisher(mqtt.Client):
@@ -561,26 +661,23 @@ def on_send_connect(client, userdata, flags, rc):
 # -----------------------------------------------------------
 def on_send_publish(client, userdata, mid):
     client.publish_mid = mid
+    if client.chunk_window is not None:
+        client.chunk_window.acked(mid)
 
 
 # ---------------------------------------------------------
-#   send_image_chunk_thread()
-#       This is used in a separate thread.
-#       Call do_chunking() to send one chunk to the Device.
-#   message_string  - The Initial "Update Availability" message
-#   unique_topic    - The unique topic to send the OTA Image on.
+#   connect_send_client()
+#       Connect a new client to send chunks on, its network
+#       loop runs in a separate thread.
+#   window          - ChunkWindow the PUBACKs are passed to
 # ---------------------------------------------------------
-
-
-def send_image_chunk_thread(message_string, unique_topic):
+def connect_send_client(window):
     global terminate
 
     # Create unique MQTT ID
     client_id = SEND_IMAGE_MQTT_CLIENT_ID + str(random.randint(0, 1024 * 1024 * 1024))
     client_id = str.ljust(client_id, 24)  # limit to 24 characters
     client_id = str.rstrip(client_id)
-    if DEBUG_LOG:
-        print("Send Image chunks: MQTT Connect on topic: " + unique_topic)
 
     # Create a new client
     send_client = MQTTSender(client_id)
@@ -589,6 +686,8 @@ def send_image_chunk_thread(message_string, unique_topic):
 
     send_client.on_connect = on_send_connect
     send_client.on_publish = on_send_publish
+    send_client.chunk_window = window
+    send_client.max_inflight_messages_set(CHUNK_WINDOW_MAX)
     if TLS_ENABLED:
         if BROKER_ADDRESS == MOSQUITTO_BROKER_LOCAL_ADDRESS:
             send_client.tls_set(ca_certs, certfile, keyfile, cert_reqs=ssl.CERT_NONE)
@@ -596,49 +695,130 @@ def send_image_chunk_thread(message_string, unique_topic):
         else:
             send_client.tls_set(ca_certs, certfile, keyfile)
     send_client.connect(BROKER_ADDRESS, BROKER_PORT, MQTT_KEEP_ALIVE)
+    send_client.loop_start()
     while send_client.connected_flag == False:
-        send_client.loop(0.1)
         time.sleep(0.1)
         if terminate:
             exit(0)
 
-    try:
-        time_string = time.asctime()
-        if DEBUG_LOG:
-            print("Send Chunk Begins..." + time_string + " ")
+    return send_client
+
+
+# ---------------------------------------------------------
+#   queue_chunk_request()
+#       Queue a "Request Data Chunk" message to the chunk
+#       sender of the Device, start one if there is none.
+#   message_string  - The "Request Data Chunk" message
+#   unique_topic    - The unique topic to send the chunk on.
+# ---------------------------------------------------------
+chunk_senders = {}  # unique topic -> queue of requests of the running chunk sender
+chunk_senders_lock = threading.Lock()
+
+
+def queue_chunk_request(message_string, unique_topic):
+    with chunk_senders_lock:
+        requests = chunk_senders.get(unique_topic)
+        if requests is None:
+            print("Publisher: Start Sending CHUNK Thread")
+            requests = queue.Queue()
+            chunk_senders[unique_topic] = requests
+            send_thread = threading.Thread(None, send_image_chunk_thread, None, args=(requests, unique_topic))
+            send_thread.start()
+        requests.put(message_string)
+
+
+# ---------------------------------------------------------
+#   send_image_chunk_thread()
+#       This is used in a separate thread.
+#       Call do_chunking() to send the chunks the Device
+#       requests, all on one connection. The chunks of the
+#       requests queued meanwhile are published without
+#       waiting for the PUBACK of the previous ones.
+#   requests        - Queue of "Request Data Chunk" messages
+#   unique_topic    - The unique topic to send the OTA Image on.
+# ---------------------------------------------------------
 
-        job_dict = json.loads(message_string)
-        offset = int(job_dict["Offset"])
-        size = int(job_dict["Size"])
 
-        pub_mqtt_msgs, pub_total_payloads = do_chunking(OTA_IMAGE_FILE, False, offset, size)
+def send_image_chunk_thread(requests, unique_topic):
+    global terminate
 
-        # print(" Sending Chunk  offset:" + str(offset) + " size:" + str(size) + " packet sz: " + str( len(pub_mqtt_msgs[0])) + " to: " + unique_topic)
-        result, messageID = send_client.publish(unique_topic, pub_mqtt_msgs[0], PUBLISHER_PUBLISH_QOS)
-        while send_client.publish_mid != messageID:
-            send_client.loop(0.1)
-            time.sleep(0.1)
+    if DEBUG_LOG:
+        print("Send Image chunks: MQTT Connect on topic: " + unique_topic)
+    window = ChunkWindow(CHUNK_WINDOW)
+    send_client = None
+
+    try:
+        send_client = connect_send_client(window)
+        while True:
             if terminate:
                 exit(0)
 
-        time_string = time.asctime()
-        if DEBUG_LOG:
-            print("Send Chunk Ends..." + time_string)
+            try:
+                message_string = requests.get(timeout=CHUNK_SENDER_IDLE_TIMEOUT)
+            except queue.Empty:
+                # A request queued while timing out is served before stopping
+                with chunk_senders_lock:
+                    if requests.empty():
+                        del chunk_senders[unique_topic]
+                        break
+                continue
+
+            job_dict = json.loads(message_string)
+            offset = int(job_dict["Offset"])
+            size = int(job_dict["Size"])
+
+            pub_mqtt_msgs, pub_total_payloads = do_chunking(OTA_IMAGE_FILE, False, offset, size)
+            if DEBUG_LOG:
+                print(" Sending Chunk offset:" + str(offset) + " size:" + str(size) + " window: " + str(window.window))
+            window.publish(send_client, unique_topic, pub_mqtt_msgs[0])
+
+        window.drain()
 
     except Exception as e:
         print("Exception Occurred... Exiting...")
         print(str(e) + os.linesep)
         traceback.print_exc()
+        if send_client is not None:
+            send_client.disconnect()
+            send_client.loop_stop()
         exit(0)
 
+    finally:
+        # The next request of the Device starts a new chunk sender
+        with chunk_senders_lock:
+            if chunk_senders.get(unique_topic) is requests:
+                del chunk_senders[unique_topic]
+
+    send_client.disconnect()
+    send_client.loop_stop()
+
     # we're done
     exit(0)
 
 
+# -----------------------------------------------------------
+#   requested_chunk_size()
+#       Chunk size asked for by the Device, CHUNK_SIZE if it
+#       asked for none or for one out of bounds.
+#   message_string  - The "Request Update" message
+# -----------------------------------------------------------
+def requested_chunk_size(message_string):
+    try:
+        chunk_size = int(json.loads(message_string).get("MaxChunkSize", CHUNK_SIZE))
+    except (ValueError, TypeError, AttributeError):
+        return CHUNK_SIZE
+
+    if chunk_size < CHUNK_SIZE_MIN or chunk_size > CHUNK_SIZE_MAX:
+        print("Send Image: MaxChunkSize " + str(chunk_size) + " out of bounds, using " + str(CHUNK_SIZE))
+        return CHUNK_SIZE
+    return chunk_size
+
+
 # -----------------------------------------------------------
 #   send_image_thread()
 #       This is used in a separate thread.
-#       Call do_chunking() and send the chunks to the Device.
+#       Call do_chunking() and send the chunks to the Device,
+#       without waiting for the PUBACK of the previous ones.
 #   message_string  - The Initial "Update Availability" message
 #   unique_topic    - The unique topic to send the OTA Image on.
 #
@@ -646,58 +826,57 @@ def send_image_chunk_thread(message_string, unique_topic):
 def send_image_thread(message_string, unique_topic):
     global terminate
 
-    # Create unique MQTT ID
-    client_id = SEND_IMAGE_MQTT_CLIENT_ID + str(random.randint(0, 1024 * 1024 * 1024))
-    client_id = str.ljust(client_id, 24)  # limit to 24 characters
-    client_id = str.rstrip(client_id)
     print("Send Image: MQTT Connect on topic: " + unique_topic)
-
-    # Create a new client
-    send_client = MQTTSender(client_id)
-    if DEBUG_LOG:
-        send_client.on_log = on_send_log
-
-    send_client.on_connect = on_send_connect
-    send_client.on_publish = on_send_publish
-    if TLS_ENABLED:
-        if BROKER_ADDRESS == MOSQUITTO_BROKER_LOCAL_ADDRESS:
-            send_client.tls_set(ca_certs, certfile, keyfile, cert_reqs=ssl.CERT_NONE)
-            send_client.tls_insecure_set(True)
-        else:
-            send_client.tls_set(ca_certs, certfile, keyfile)
-    send_client.connect(BROKER_ADDRESS, BROKER_PORT, MQTT_KEEP_ALIVE)
-    while send_client.connected_flag == False:
-        send_client.loop(0.1)
-        time.sleep(0.1)
-        if terminate:
-            exit(0)
+    chunk_size = requested_chunk_size(message_string)
+    window = ChunkWindow(CHUNK_WINDOW)
+    send_client = connect_send_client(window)
 
     try:
         time_string = time.asctime()
-        print("Publishing Begins..." + time_string + " ")
-        pub_mqtt_msgs, pub_total_payloads = do_chunking(OTA_IMAGE_FILE, True, 0, CHUNK_SIZE)
+        start_time = time.monotonic()
+        print("Publishing Begins..." + time_string + " chunk size: " + str(chunk_size))
+        pub_mqtt_msgs, pub_total_payloads = do_chunking(OTA_IMAGE_FILE, True, 0, chunk_size)
 
         # for chunk in pub_mqtt_msgs:
         for chunk in range(0, pub_total_payloads):
             if terminate:
                 exit(0)
             # print(" Sending Chunk " + str(chunk)  + " of " + str(pub_total_payloads) + " to: " + unique_topic)
-            result, messageID = send_client.publish(unique_topic, pub_mqtt_msgs[chunk], PUBLISHER_PUBLISH_QOS)
-            while send_client.publish_mid != messageID:
-                send_client.loop(0.1)
-                time.sleep(0.1)
-                if terminate:
-                    exit(0)
+            window.publish(send_client, unique_topic, pub_mqtt_msgs[chunk])
+        window.drain()
 
         time_string = time.asctime()
         print("Publishing Ends..." + time_string)
+        print(
+            "Published "
+            + str(pub_total_payloads)
+            + " chunks in "
+            + "{:.2f}".format(time.monotonic() - start_time)
+            + " s, window "
+            + str(window.window)
+            + ", shortest PUBACK "
+            + "{:.1f}".format((window.min_rtt or 0.0) * 1000)
+            + " ms"
+        )
 
     except Exception as e:
         print("Exception Occurred... Exiting...")
         print(str(e) + os.linesep)
         traceback.print_exc()
+        if send_client is not None:
+            send_client.disconnect()
+            send_client.loop_stop()
         exit(0)
 
+    finally:
+        # The next request of the Device starts a new chunk sender
+        with chunk_senders_lock:
+            if chunk_senders.get(unique_topic) is requests:
+                del chunk_senders[unique_topic]
+
+    send_client.disconnect()
+    send_client.loop_stop()
+
     # we're done
     exit(0)
 
@@ -801,10 +980,8 @@ def publisher_recv_message(client, userdata, message):
 
         # print( "Publisher: Send Chunk of OTA Image on topic:" + unique_topic )
 
-        # Create a new thread to send the data. This will allow for multiple, overlapping requests.
-        print("Publisher: Start Sending CHUNK Thread")
-        send_thread = threading.Thread(None, send_image_chunk_thread, None, args=(message_string, unique_topic))
-        send_thread.start()
+        # Queue the request to the thread sending the chunks of this Device, requests may overlap.
+        queue_chunk_request(message_string, unique_topic)
         return
 
     # Handle incoming "result" notification
@@ -913,16 +1090,18 @@ def publisher_loop():
         "################################################################################################################################"
     )
     print("Infineon Test MQTT Publisher.")
-    print("Usage: 'python publisher.py [tls] [-l] [-b <broker>] [-k <kit>] [-f <filepath>]'")
+    print("Usage: 'python publisher.py [tls] [-l] [-b <broker>] [-k <kit>] [-f <filepath>] [-w <window>]'")
     print("<broker>       | [a] or [amazon] | [e] or [eclipse] | [m] or [mosquitto] | [ml] or [mosquitto_local] |")
     print(
         "<kit>          CY8CPROTO_062S2_43439 | CY8CPROTO_062_4343W | CY8CKIT_062S2_43012 | CY8CEVAL_062S2_LAI_4373M2 | CY8CEVAL_062S2_MUR_43439M2 | CY8CPROTO_062S3_4343W | KIT_XMC72_EVK_MUR_43439M2 |"
     )
     print("<filepath>     The location of the OTA Image file to server to the device")
+    print("<window>       Number of chunks published ahead of their PUBACK at the start, 1 to wait for each")
     print("Defaults: <non-TLS>")
     print("        : -f " + OTA_IMAGE_FILE)
     print("        : -b mosquitto_local ")
     print("        : -k " + KIT)
+    print("        : -w " + str(CHUNK_WINDOW))
     print("        : -l turn on extra logging")
     print(
         "################################################################################################################################"
@@ -951,6 +1130,8 @@ def publisher_loop():
                 BROKER_ADDRESS = MOSQUITTO_BROKER_LOCAL_ADDRESS
         if last_arg == "-k":
             KIT = arg
+        if last_arg == "-w":
+            CHUNK_WINDOW = int(arg)
         last_arg = arg
 
     if OTA_IMAGE_FILE_NEW == None:
@@ -971,6 +1152,7 @@ def publisher_loop():
 print("   Using    KIT: " + KIT)
 print("   Using   File: " + OTA_IMAGE_FILE)
 print("   extra debug : " + DEBUG_LOG_STRING)
+print("   Chunk window: " + str(CHUNK_WINDOW))
 
 
 PUBLISHER_JOB_REQUEST_TOPIC = COMPANY_TOPIC_PREPEND + "/APP_" + KIT + "/" + PUBLISHER_LISTEN_TOPIC
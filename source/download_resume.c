@@ -0,0 +1,642 @@
+/******************************************************************************
+* File Name:   download_resume.c
+*
+* Description: This file contains the progress of the download of an image,
+*              saved to a reserved flash area so a download interrupted by a
+*              reset, a power failure or a lost connection keeps the part of
+*              the image already written to the upgrade slot.
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "cyhal.h"
+#include "cybsp.h"
+
+#include "download_resume.h"
+#include "flash_record.h"
+#include "flash_service.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Marks a record of the download progress */
+#define DOWNLOAD_RESUME_MAGIC               (0x444C5253u)
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Blocks of the image handed to the flash service. They are all programmed
+ * once flash_service_sync() returns without an error.
+ */
+static download_resume_state_t resume_state;
+
+static flash_record_area_t resume_area =
+{
+    .mem_type     = DOWNLOAD_RESUME_MEM_TYPE,
+    .addr         = DOWNLOAD_RESUME_ADDR,
+    .size         = DOWNLOAD_RESUME_SIZE,
+    .magic        = DOWNLOAD_RESUME_MAGIC,
+    .payload_size = sizeof(download_resume_state_t),
+};
+
+static bool resume_ready;
+
+/* Set once the first chunk of the download was compared with the progress */
+static bool resume_checked;
+
+/* Set while the flash holds the progress of an unfinished download */
+static bool resume_saved;
+
+/* Bytes written since the progress was last saved */
+static uint32_t resume_unsaved_bytes;
+
+/* Contiguous range of the image handed to the flash service or skipped,
+ * the blocks in it are complete whatever the size of the chunks.
+ */
+static uint32_t resume_run_start;
+static uint32_t resume_run_end;
+
+/*******************************************************************************
+ * Function Name: download_resume_block_done
+ *******************************************************************************
+ * Summary:
+ *  Returns true if the block was written to the upgrade slot.
+ *
+ *******************************************************************************/
+static bool download_resume_block_done(uint32_t block)
+{
+    return (resume_state.bitmap[block / 8u] & (1u << (block % 8u))) != 0u;
+}
+
+/* Block holding an offset of the image */
+static uint32_t download_resume_block_of(uint32_t offset)
+{
+    return (offset + DOWNLOAD_RESUME_SKEW) / DOWNLOAD_RESUME_BLOCK_SIZE;
+}
+
+/* Offset of the start of a block in the image */
+static uint32_t download_resume_block_start(uint32_t block)
+{
+    return (block == 0u) ? 0u : ((block * DOWNLOAD_RESUME_BLOCK_SIZE) - DOWNLOAD_RESUME_SKEW);
+}
+
+/*******************************************************************************
+ * Function Name: download_resume_advance
+ *******************************************************************************
+ * Summary:
+ *  Extends the contiguous range of the image written with a chunk. A chunk
+ *  that does not follow or overlap the range starts a new one.
+ *
+ * Parameters:
+ *  uint32_t offset : Offset of the chunk in the image
+ *  uint32_t len    : Size of the chunk
+ *
+ *******************************************************************************/
+static void download_resume_advance(uint32_t offset, uint32_t len)
+{
+    if ((offset < resume_run_start) || (offset > resume_run_end))
+    {
+        resume_run_start = offset;
+        resume_run_end = offset + len;
+    }
+    else if ((offset + len) > resume_run_end)
+    {
+        resume_run_end = offset + len;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: download_resume_clear
+ *******************************************************************************
+ * Summary:
+ *  Forgets the progress kept in RAM, the download starts from the beginning.
+ *
+ *******************************************************************************/
+static void download_resume_clear(void)
+{
+    memset(&resume_state, 0x00, sizeof(resume_state));
+    resume_unsaved_bytes = 0;
+}
+
+/*******************************************************************************
+ * Function Name: download_resume_init
+ *******************************************************************************
+ * Summary:
+ *  Loads the progress of an unfinished download from the flash. Must be
+ *  called after the OTA storage is initialized and before the secondary slot
+ *  is erased.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+cy_rslt_t download_resume_init(void)
+{
+    bool found;
+
+    if (CY_RSLT_SUCCESS != flash_record_load(&resume_area, &resume_state, &found))
+    {
+        printf("\n Download progress area does not fit the progress.\n");
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    if (!found || (resume_state.total_size == 0u) || (resume_state.total_size > OTA_UPGRADE_SLOT_SIZE) ||
+        (resume_state.blocks_done > DOWNLOAD_RESUME_BLOCKS))
+    {
+        download_resume_clear();
+    }
+    else
+    {
+        resume_saved = true;
+        printf("Download to resume: %lu of %lu bytes written\n",
+               (unsigned long)(resume_state.blocks_done * DOWNLOAD_RESUME_BLOCK_SIZE),
+               (unsigned long)resume_state.total_size);
+    }
+    resume_ready = true;
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: download_resume_pending
+ *******************************************************************************
+ * Summary:
+ *  Returns true if the upgrade slot holds part of an unfinished download. The
+ *  slot must then not be erased ahead of time.
+ *
+ *******************************************************************************/
+bool download_resume_pending(void)
+{
+    return resume_state.blocks_done > 0u;
+}
+
+/*******************************************************************************
+ * Function Name: download_resume_drop
+ *******************************************************************************
+ * Summary:
+ *  Clears the blocks of a range from the progress, they are written again.
+ *
+ * Parameters:
+ *  uint32_t first : First block of the range
+ *  uint32_t end   : Block after the range
+ *
+ *******************************************************************************/
+static void download_resume_drop(uint32_t first, uint32_t end)
+{
+    uint32_t block;
+
+    for (block = first; block < end; block++)
+    {
+        if (download_resume_block_done(block))
+        {
+            resume_state.bitmap[block / 8u] &= (uint8_t)~(1u << (block % 8u));
+            resume_state.blocks_done--;
+        }
+    }
+}
+
+/*******************************************************************************
+ * Function Name: download_resume_sector_bound
+ *******************************************************************************
+ * Summary:
+ *  Rounds an address of the upgrade slot to a bound of its erase sector, up
+ *  or down. The slot start and end are bounds, only the part of a sector in
+ *  the slot is erased on demand. Returns the address itself if it can not be
+ *  erased.
+ *
+ *******************************************************************************/
+static uint32_t download_resume_sector_bound(uint32_t addr, bool up)
+{
+    uint32_t slot_end = OTA_UPGRADE_SLOT_ADDR + OTA_UPGRADE_SLOT_SIZE;
+    uint32_t sector_size;
+    uint32_t sector_start;
+
+    if ((addr <= OTA_UPGRADE_SLOT_ADDR) || (addr >= slot_end))
+    {
+        return addr;
+    }
+
+    sector_size = (uint32_t)cy_ota_mem_get_erase_sector_size(OTA_UPGRADE_SLOT_MEM_TYPE, addr);
+    if (sector_size == 0u)
+    {
+        return addr;
+    }
+
+    sector_start = addr & ~(sector_size - 1u);
+    if ((sector_start == addr) || !up)
+    {
+        return (sector_start > OTA_UPGRADE_SLOT_ADDR) ? sector_start : OTA_UPGRADE_SLOT_ADDR;
+    }
+
+    return ((sector_start + sector_size) < slot_end) ? (sector_start + sector_size) : slot_end;
+}
+
+/*******************************************************************************
+ * Function Name: download_resume_block_bound
+ *******************************************************************************
+ * Summary:
+ *  Rounds an address of the upgrade slot to a block bound, up or down. The
+ *  slot start and end are bounds.
+ *
+ *******************************************************************************/
+static uint32_t download_resume_block_bound(uint32_t addr, bool up)
+{
+    uint32_t slot_end = OTA_UPGRADE_SLOT_ADDR + OTA_UPGRADE_SLOT_SIZE;
+
+    if (addr <= OTA_UPGRADE_SLOT_ADDR)
+    {
+        return OTA_UPGRADE_SLOT_ADDR;
+    }
+    if (up)
+    {
+        addr += DOWNLOAD_RESUME_BLOCK_SIZE - 1u;
+    }
+    addr -= addr % DOWNLOAD_RESUME_BLOCK_SIZE;
+
+    if (addr < OTA_UPGRADE_SLOT_ADDR)
+    {
+        return OTA_UPGRADE_SLOT_ADDR;
+    }
+    return (addr < slot_end) ? addr : slot_end;
+}
+
+/*******************************************************************************
+ * Function Name: download_resume_keep
+ *******************************************************************************
+ * Summary:
+ *  Keeps the sectors a run of written blocks covers completely. The blocks
+ *  that lie in a sector at either end of the run that is only partly covered
+ *  are dropped, with the blocks sharing a sector with them. Blocks written
+ *  after the progress was last saved may lie in those sectors, they are
+ *  erased again before the blocks are written, as the flash must not be
+ *  programmed twice.
+ *
+ * Parameters:
+ *  uint32_t first : First block of the run
+ *  uint32_t end   : Block after the run
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+static cy_rslt_t download_resume_keep(uint32_t first, uint32_t end)
+{
+    uint32_t slot_end = OTA_UPGRADE_SLOT_ADDR + OTA_UPGRADE_SLOT_SIZE;
+    uint32_t lo = OTA_UPGRADE_SLOT_ADDR + download_resume_block_start(first);
+    uint32_t hi = OTA_UPGRADE_SLOT_ADDR + download_resume_block_start(end);
+    uint32_t next_lo, next_hi;
+
+    if ((end >= DOWNLOAD_RESUME_BLOCKS) || (hi > slot_end))
+    {
+        hi = slot_end;
+    }
+
+    /* Shrink the run to bounds that are both sector and block bounds */
+    while (lo < hi)
+    {
+        next_lo = download_resume_block_bound(download_resume_sector_bound(lo, true), true);
+        next_hi = download_resume_block_bound(download_resume_sector_bound(hi, false), false);
+        if ((next_lo == lo) && (next_hi == hi))
+        {
+            break;
+        }
+        lo = next_lo;
+        hi = next_hi;
+    }
+
+    if (lo >= hi)
+    {
+        download_resume_drop(first, end);
+        return CY_RSLT_SUCCESS;
+    }
+
+    download_resume_drop(first, download_resume_block_of(lo - OTA_UPGRADE_SLOT_ADDR));
+    if (hi < slot_end)
+    {
+        download_resume_drop(download_resume_block_of(hi - OTA_UPGRADE_SLOT_ADDR), end);
+    }
+
+    return cy_ota_mem_erase_cancel(OTA_UPGRADE_SLOT_MEM_TYPE, lo, hi - lo);
+}
+
+/*******************************************************************************
+ * Function Name: download_resume_open
+ *******************************************************************************
+ * Summary:
+ *  Keeps the sectors written completely by the unfinished download. Called
+ *  after the OTA storage is opened, which leaves the whole slot to be erased
+ *  on demand, and after image_digest_start(). The blocks in the other sectors
+ *  are dropped from the progress, those sectors are erased again before they
+ *  are written. The image digest saved with the progress is restored.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+cy_rslt_t download_resume_open(void)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t block = 0;
+    uint32_t first;
+    uint32_t covered;
+
+    resume_checked = false;
+    resume_unsaved_bytes = 0;
+    resume_run_start = 0;
+    resume_run_end = 0;
+
+    /* Blocks of a previous attempt that failed to program are not kept */
+    if (!resume_ready || (CY_RSLT_SUCCESS != flash_service_sync()))
+    {
+        download_resume_clear();
+    }
+
+    if (download_resume_pending())
+    {
+        /* The digest continues over the bytes kept, the blocks it does not cover
+         * are written again. Without a digest the image is verified by reading
+         * the slot.
+         */
+        covered = image_digest_restore(&resume_state.digest);
+        if ((covered > 0u) && (covered < resume_state.total_size))
+        {
+            download_resume_drop(download_resume_block_of(covered), DOWNLOAD_RESUME_BLOCKS);
+        }
+    }
+
+    while ((block < DOWNLOAD_RESUME_BLOCKS) && (CY_RSLT_SUCCESS == result))
+    {
+        if (!download_resume_block_done(block))
+        {
+            block++;
+            continue;
+        }
+
+        first = block;
+        while ((block < DOWNLOAD_RESUME_BLOCKS) && download_resume_block_done(block))
+        {
+            block++;
+        }
+        result = download_resume_keep(first, block);
+    }
+
+    if (CY_RSLT_SUCCESS != result)
+    {
+        /* Some sectors may be kept, erase them all again */
+        printf("\n Failed to keep the blocks of the interrupted download.\n");
+        download_resume_clear();
+        return cy_ota_mem_erase(OTA_UPGRADE_SLOT_MEM_TYPE, OTA_UPGRADE_SLOT_ADDR, OTA_UPGRADE_SLOT_SIZE);
+    }
+
+    if (download_resume_pending())
+    {
+        printf("Resuming the download, %lu bytes kept\n",
+               (unsigned long)(resume_state.blocks_done * DOWNLOAD_RESUME_BLOCK_SIZE));
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: download_resume_skip
+ *******************************************************************************
+ * Summary:
+ *  Returns the bytes at the start of the chunk that were written by the
+ *  unfinished download, and the number of bytes after them to write. The
+ *  rest of the chunk is in the upgrade slot already. The blocks kept are
+ *  aligned to the flash, so the part written never shares a page with them
+ *  and no byte of the slot is programmed twice. The first
+ *  DOWNLOAD_RESUME_CHECK_SIZE bytes of the first chunk are compared with the
+ *  unfinished download, it is skipped like the others if they match. If they
+ *  differ, or the image size differs, the progress is dropped, the kept
+ *  sectors are erased again and the image digest starts over.
+ *
+ * Parameters:
+ *  uint32_t offset     : Offset of the chunk in the image
+ *  const uint8_t *data : Data of the chunk
+ *  uint32_t len        : Size of the chunk
+ *  uint32_t total_size : Size of the image
+ *  uint32_t *write_len : Number of bytes to write after the ones skipped
+ *
+ * Return:
+ *  uint32_t : Number of bytes at the start of the chunk to skip
+ *
+ *******************************************************************************/
+uint32_t download_resume_skip(uint32_t offset, const uint8_t *data, uint32_t len, uint32_t total_size,
+                              uint32_t *write_len)
+{
+    uint32_t head = offset;
+    uint32_t tail = offset + len;
+    uint32_t block;
+    uint32_t check_len;
+    uint32_t crc;
+
+    *write_len = len;
+
+    if (!resume_ready || (len == 0u))
+    {
+        return 0;
+    }
+
+    if (offset == 0u)
+    {
+        /* The span checked does not depend on the chunk size, which may change between attempts */
+        check_len = (total_size < DOWNLOAD_RESUME_CHECK_SIZE) ? total_size : DOWNLOAD_RESUME_CHECK_SIZE;
+        crc = flash_record_crc32(0, data, (len < check_len) ? len : check_len);
+
+        if (download_resume_pending() &&
+            ((len < check_len) || (total_size != resume_state.total_size) || (crc != resume_state.first_crc)))
+        {
+            printf("\n Not the image of the interrupted download, it is written again.\n");
+            download_resume_clear();
+            image_digest_start();
+            if (CY_RSLT_SUCCESS != flash_service_erase(OTA_UPGRADE_SLOT_MEM_TYPE, OTA_UPGRADE_SLOT_ADDR,
+                                                       OTA_UPGRADE_SLOT_SIZE))
+            {
+                printf("\n Failed to erase the secondary slot.\n");
+            }
+        }
+
+        resume_state.total_size = total_size;
+        resume_state.first_crc = crc;
+        resume_checked = true;
+    }
+
+    /* Chunks received before the first one are written */
+    if (!resume_checked || !download_resume_pending())
+    {
+        return 0;
+    }
+
+    /* Blocks written at the start of the chunk */
+    block = download_resume_block_of(head);
+    while ((head < tail) && (block < DOWNLOAD_RESUME_BLOCKS) && download_resume_block_done(block))
+    {
+        block++;
+        head = download_resume_block_start(block);
+    }
+    if (head >= tail)
+    {
+        *write_len = 0;
+        return len;
+    }
+
+    /* Blocks written at the end of the chunk */
+    block = download_resume_block_of(tail - 1u);
+    while ((block < DOWNLOAD_RESUME_BLOCKS) && download_resume_block_done(block) &&
+           (download_resume_block_start(block) > head))
+    {
+        tail = download_resume_block_start(block);
+        block--;
+    }
+
+    *write_len = tail - head;
+    return head - offset;
+}
+
+/*******************************************************************************
+ * Function Name: download_resume_written
+ *******************************************************************************
+ * Summary:
+ *  Marks the blocks completed by a chunk handed to the flash service, or
+ *  skipped in part or whole by download_resume_skip(): the blocks of the
+ *  chunk that lie completely in the contiguous range written, or that end
+ *  with the image. Every DOWNLOAD_RESUME_SAVE_INTERVAL bytes, waits until
+ *  the chunks are programmed and saves the progress with the image digest.
+ *  The chunk must be added to the digest first.
+ *
+ * Parameters:
+ *  uint32_t offset : Offset of the chunk in the image
+ *  uint32_t len    : Size of the chunk
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error programming the chunks
+ *              queued before otherwise
+ *
+ *******************************************************************************/
+cy_rslt_t download_resume_written(uint32_t offset, uint32_t len)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t block, end;
+
+    if (!resume_ready || (len == 0u))
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    download_resume_advance(offset, len);
+
+    /* Only blocks the range covers from their start are marked */
+    block = download_resume_block_of(offset);
+    if (download_resume_block_start(block) < resume_run_start)
+    {
+        block++;
+    }
+    end = download_resume_block_of(resume_run_end);
+
+    /* The last block of the image is shorter */
+    if ((resume_state.total_size != 0u) && (resume_run_end >= resume_state.total_size))
+    {
+        end = download_resume_block_of(resume_run_end - 1u) + 1u;
+    }
+
+    for (; (block < end) && (block < DOWNLOAD_RESUME_BLOCKS); block++)
+    {
+        if (!download_resume_block_done(block))
+        {
+            resume_state.bitmap[block / 8u] |= (uint8_t)(1u << (block % 8u));
+            resume_state.blocks_done++;
+        }
+    }
+
+    resume_unsaved_bytes += len;
+    if (resume_unsaved_bytes >= DOWNLOAD_RESUME_SAVE_INTERVAL)
+    {
+        resume_unsaved_bytes = 0;
+
+        /* Only blocks programmed to the flash are saved */
+        result = flash_service_sync();
+        if ((CY_RSLT_SUCCESS == result) && (resume_state.total_size != 0u))
+        {
+            image_digest_save(&resume_state.digest);
+            if (CY_RSLT_SUCCESS == flash_record_save(&resume_area, &resume_state))
+            {
+                resume_saved = true;
+            }
+            else
+            {
+                printf("\n Failed to save the download progress.\n");
+            }
+        }
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: download_resume_finish
+ *******************************************************************************
+ * Summary:
+ *  Drops the progress once the download is complete, whether the image
+ *  verifies or not, so the next download starts from the beginning.
+ *
+ *******************************************************************************/
+void download_resume_finish(void)
+{
+    if (!resume_ready)
+    {
+        return;
+    }
+
+    resume_checked = false;
+    download_resume_clear();
+
+    if (resume_saved)
+    {
+        if (CY_RSLT_SUCCESS == flash_record_save(&resume_area, &resume_state))
+        {
+            resume_saved = false;
+        }
+        else
+        {
+            printf("\n Failed to clear the download progress.\n");
+        }
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,127 @@
+/******************************************************************************
+* File Name:   download_resume.h
+*
+* Description: This file is the public interface of download_resume.c
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef DOWNLOAD_RESUME_H_
+#define DOWNLOAD_RESUME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_result.h"
+#include "cy_ota_flash_ext.h"
+#include "image_digest.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Flash area reserved for the download progress, split in two halves that
+ * are used in turn. Each half must be a whole number of erase sectors and
+ * must not be used by the bootloader or the application. Internal flash is
+ * addressed by the offset from CY_FLASH_BASE.
+ */
+#ifndef DOWNLOAD_RESUME_ADDR
+#if defined (XMC7200)
+#define DOWNLOAD_RESUME_ADDR                (0x00800000u)   /* Code flash small sectors 0x10800000, after the wear table */
+#define DOWNLOAD_RESUME_SIZE                (0x00010000u)   /* 2 x 32 KB of 8 KB sectors */
+#define DOWNLOAD_RESUME_MEM_TYPE            (CY_OTA_MEM_TYPE_INTERNAL_FLASH)
+#else
+#define DOWNLOAD_RESUME_ADDR                (0x18580000u)   /* After the wear table */
+#define DOWNLOAD_RESUME_SIZE                (0x00080000u)   /* 2 x 256 KB sectors of the S25HS256T */
+#define DOWNLOAD_RESUME_MEM_TYPE            (CY_OTA_MEM_TYPE_EXTERNAL_FLASH)
+#endif
+#endif /* DOWNLOAD_RESUME_ADDR */
+
+/* Unit of the download progress. Only blocks received completely are kept
+ * when the download is resumed, the publisher sends chunks of this size.
+ */
+#ifndef DOWNLOAD_RESUME_BLOCK_SIZE
+#define DOWNLOAD_RESUME_BLOCK_SIZE          (4096u)
+#endif
+
+/* Bytes at the start of the image whose CRC-32 tells the images apart. The
+ * same for every chunk size, it must not be above the smallest chunk the
+ * publisher is asked for (OTA_CHUNK_SIZE_MIN).
+ */
+#ifndef DOWNLOAD_RESUME_CHECK_SIZE
+#define DOWNLOAD_RESUME_CHECK_SIZE          (1024u)
+#endif
+
+/* Bytes received between two saves of the progress. A reset loses at most
+ * this much of the download, each save waits for the chunks queued to the
+ * flash service.
+ */
+#ifndef DOWNLOAD_RESUME_SAVE_INTERVAL
+#define DOWNLOAD_RESUME_SAVE_INTERVAL       (64u * 1024u)
+#endif
+
+/* The blocks are aligned to the flash addresses, like the erase sectors. The
+ * first block is shorter when the slot does not start on a block bound.
+ */
+#define DOWNLOAD_RESUME_SKEW                (OTA_UPGRADE_SLOT_ADDR % DOWNLOAD_RESUME_BLOCK_SIZE)
+#define DOWNLOAD_RESUME_BLOCKS              ((DOWNLOAD_RESUME_SKEW + OTA_UPGRADE_SLOT_SIZE + \
+                                              DOWNLOAD_RESUME_BLOCK_SIZE - 1u) / DOWNLOAD_RESUME_BLOCK_SIZE)
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Progress of a download, as saved in the flash */
+typedef struct
+{
+    uint32_t total_size;            /* Size of the image, 0 when no download is in progress */
+    uint32_t first_crc;             /* CRC-32 of DOWNLOAD_RESUME_CHECK_SIZE first bytes     */
+    uint32_t blocks_done;           /* Blocks set in the bitmap                             */
+    uint8_t  bitmap[(DOWNLOAD_RESUME_BLOCKS + 7u) / 8u];  /* Blocks written to the slot   */
+    image_digest_state_t digest;    /* Digest of the bytes received when the progress was saved */
+} download_resume_state_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+cy_rslt_t download_resume_init(void);
+bool download_resume_pending(void);
+cy_rslt_t download_resume_open(void);
+uint32_t download_resume_skip(uint32_t offset, const uint8_t *data, uint32_t len, uint32_t total_size,
+                              uint32_t *write_len);
+cy_rslt_t download_resume_written(uint32_t offset, uint32_t len);
+void download_resume_finish(void);
+
+#endif /* DOWNLOAD_RESUME_H_ */
+
+/* [] END OF FILE */
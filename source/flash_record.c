@@ -0,0 +1,316 @@
+/******************************************************************************
+* File Name:   flash_record.c
+*
+* Description: This file contains the store of small structures in a reserved
+*              flash area, as a log of records that survives resets and power
+*              failures while it is written.
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "cyhal.h"
+#include "cybsp.h"
+
+#include "flash_record.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+#define FLASH_RECORD_ERASED_WORD            (0xFFFFFFFFu)
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+typedef struct
+{
+    uint32_t magic;                 /* Never 0xFFFFFFFF, so a blank slot is never taken for a record */
+    uint32_t sequence;
+    uint32_t crc;                   /* CRC-32 of the sequence number and the payload */
+} flash_record_header_t;
+
+/* Record read from or written to the flash, "static" so it is not on the
+ * stack. Only used with the flash lock held.
+ */
+static union
+{
+    flash_record_header_t header;
+    uint8_t bytes[FLASH_RECORD_MAX_SIZE];
+} flash_record_slot;
+
+/*******************************************************************************
+ * Function Name: flash_record_crc32
+ *******************************************************************************
+ * Summary:
+ *  Computes the CRC-32 (IEEE 802.3) of the data, bit by bit as it is only
+ *  computed for a few records. The CRC of data split in parts is computed
+ *  by passing the CRC of the previous parts.
+ *
+ * Parameters:
+ *  uint32_t crc     : 0, or the CRC of the previous parts
+ *  const void *data : Data to compute the CRC of
+ *  size_t len       : Number of bytes
+ *
+ * Return:
+ *  uint32_t : CRC-32 of the data
+ *
+ *******************************************************************************/
+uint32_t flash_record_crc32(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *ptr = (const uint8_t *)data;
+    uint32_t bit;
+
+    crc = ~crc;
+    while (len-- > 0u)
+    {
+        crc ^= *ptr++;
+        for (bit = 0; bit < 8u; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+
+    return ~crc;
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_slot_size
+ *******************************************************************************
+ * Summary:
+ *  Returns the bytes taken by each record of the area in the flash.
+ *
+ *******************************************************************************/
+static uint32_t flash_record_slot_size(const flash_record_area_t *area)
+{
+    return ((sizeof(flash_record_header_t) + area->payload_size + FLASH_RECORD_ALIGN - 1u) /
+            FLASH_RECORD_ALIGN) * FLASH_RECORD_ALIGN;
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_crc
+ *******************************************************************************
+ * Summary:
+ *  Computes the CRC of the record in flash_record_slot.
+ *
+ *******************************************************************************/
+static uint32_t flash_record_crc(const flash_record_area_t *area)
+{
+    uint32_t crc;
+
+    crc = flash_record_crc32(0, &flash_record_slot.header.sequence, sizeof(flash_record_slot.header.sequence));
+    return flash_record_crc32(crc, &flash_record_slot.bytes[sizeof(flash_record_header_t)], area->payload_size);
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_check_area
+ *******************************************************************************
+ * Summary:
+ *  Checks that a record fits the slot buffer and that each half of the area
+ *  is a whole number of erase sectors.
+ *
+ *******************************************************************************/
+static cy_rslt_t flash_record_check_area(const flash_record_area_t *area)
+{
+    uint32_t half_size = area->size / 2u;
+    uint32_t erase_size = cy_ota_mem_get_erase_size(area->mem_type, area->addr);
+
+    if ((area->magic == FLASH_RECORD_ERASED_WORD) ||
+        ((sizeof(flash_record_header_t) + area->payload_size) > FLASH_RECORD_MAX_SIZE) ||
+        (erase_size == 0u) || ((half_size % erase_size) != 0u) ||
+        (half_size < flash_record_slot_size(area)))
+    {
+        printf("\n Flash record area 0x%08lx does not fit its records.\n", (unsigned long)area->addr);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_load
+ *******************************************************************************
+ * Summary:
+ *  Finds the newest valid record in both halves of the area and copies its
+ *  payload. Without one the payload is left as it is and the first save
+ *  erases the first half. Must be called before the first
+ *  flash_record_save() of the area.
+ *
+ * Parameters:
+ *  flash_record_area_t *area : Area to load the record from
+ *  void *payload             : Buffer of area->payload_size bytes for the payload
+ *  bool *found               : Set to true if a record was found
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code if the area does not fit its records
+ *
+ *******************************************************************************/
+cy_rslt_t flash_record_load(flash_record_area_t *area, void *payload, bool *found)
+{
+    cy_rslt_t result;
+    uint32_t half_size = area->size / 2u;
+    uint32_t slot_size;
+    uint32_t half_end[2];
+    uint32_t half, offset;
+
+    *found = false;
+
+    result = flash_record_check_area(area);
+    if ((CY_RSLT_SUCCESS != result) || (CY_RSLT_SUCCESS != cy_ota_mem_session_begin()))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+    slot_size = flash_record_slot_size(area);
+
+    for (half = 0; half < 2u; half++)
+    {
+        uint32_t half_addr = area->addr + (half * half_size);
+
+        for (offset = 0; (offset + slot_size) <= half_size; offset += slot_size)
+        {
+            if (CY_RSLT_SUCCESS != cy_ota_mem_read(area->mem_type, half_addr + offset, flash_record_slot.bytes,
+                                                   sizeof(flash_record_header_t) + area->payload_size))
+            {
+                break;
+            }
+
+            /* Records are written in order, the rest of the half is blank */
+            if (flash_record_slot.header.magic == FLASH_RECORD_ERASED_WORD)
+            {
+                break;
+            }
+
+            /* A record torn by a reset while it was written is skipped */
+            if ((flash_record_slot.header.magic != area->magic) ||
+                (flash_record_slot.header.crc != flash_record_crc(area)))
+            {
+                continue;
+            }
+
+            if (!*found || ((int32_t)(flash_record_slot.header.sequence - area->sequence) > 0))
+            {
+                memcpy(payload, &flash_record_slot.bytes[sizeof(flash_record_header_t)], area->payload_size);
+                area->sequence = flash_record_slot.header.sequence;
+                area->half = half;
+                *found = true;
+            }
+        }
+        half_end[half] = offset;
+    }
+
+    if (*found)
+    {
+        area->next_slot = half_end[area->half];
+    }
+    else
+    {
+        /* The first save moves to the first half and erases it */
+        area->sequence = 0;
+        area->half = 1u;
+        area->next_slot = half_size;
+    }
+
+    cy_ota_mem_session_end();
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: flash_record_save
+ *******************************************************************************
+ * Summary:
+ *  Appends a record with the payload to the half in use, or erases the other
+ *  half and writes it there when the half in use is full. The previous
+ *  record stays valid until the new one is completely written.
+ *
+ * Parameters:
+ *  flash_record_area_t *area : Area to save the record to
+ *  const void *payload       : area->payload_size bytes to save
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+cy_rslt_t flash_record_save(flash_record_area_t *area, const void *payload)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t half_size = area->size / 2u;
+    uint32_t slot_size = flash_record_slot_size(area);
+    uint32_t half_addr;
+
+    if (CY_RSLT_SUCCESS != cy_ota_mem_session_begin())
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    if ((area->next_slot + slot_size) > half_size)
+    {
+        area->half ^= 1u;
+        area->next_slot = 0;
+        result = cy_ota_mem_erase(area->mem_type, area->addr + (area->half * half_size), half_size);
+
+        /* The whole half must be blank after a reset, not erased sector by sector as it is written */
+        if (CY_RSLT_SUCCESS == result)
+        {
+            result = cy_ota_mem_erase_pending(area->mem_type, area->addr + (area->half * half_size), half_size);
+        }
+    }
+    half_addr = area->addr + (area->half * half_size);
+
+    if (CY_RSLT_SUCCESS == result)
+    {
+        area->sequence++;
+
+        memset(flash_record_slot.bytes, 0xFF, slot_size);
+        flash_record_slot.header.magic = area->magic;
+        flash_record_slot.header.sequence = area->sequence;
+        memcpy(&flash_record_slot.bytes[sizeof(flash_record_header_t)], payload, area->payload_size);
+        flash_record_slot.header.crc = flash_record_crc(area);
+
+        result = cy_ota_mem_write(area->mem_type, half_addr + area->next_slot, flash_record_slot.bytes, slot_size);
+        /* A failed write may leave a torn record, the next save uses the next slot */
+        area->next_slot += slot_size;
+    }
+
+    if (CY_RSLT_SUCCESS == result)
+    {
+        result = cy_ota_mem_flush();
+    }
+
+    cy_ota_mem_session_end();
+    return result;
+}
+
+/* [] END OF FILE */
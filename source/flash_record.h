@@ -0,0 +1,96 @@
+/******************************************************************************
+* File Name:   flash_record.h
+*
+* Description: This file is the public interface of flash_record.c
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef FLASH_RECORD_H_
+#define FLASH_RECORD_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "cy_result.h"
+#include "cy_ota_flash_ext.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Records start on this boundary, a multiple of the program size of the
+ * internal flash rows and of the external flash pages.
+ */
+#define FLASH_RECORD_ALIGN                  (512u)
+
+/* Largest record, header included, that an area can hold */
+#define FLASH_RECORD_MAX_SIZE               (4u * FLASH_RECORD_ALIGN)
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* A flash area holding the newest copy of a structure. The area is split in
+ * two halves, each a whole number of erase sectors. Records are appended to
+ * the half in use, when it is full the other half is erased and used. A
+ * record is valid if its CRC matches, the valid record with the highest
+ * sequence number is the current one. The newest valid record is never
+ * erased, so a reset or power failure while saving loses the new record
+ * only.
+ */
+typedef struct
+{
+    cy_ota_mem_type_t   mem_type;
+    uint32_t            addr;           /* Start of the area, as passed to cy_ota_mem_*() */
+    uint32_t            size;           /* Size of both halves together                   */
+    uint32_t            magic;          /* Tells the records of this area apart           */
+    size_t              payload_size;   /* Size of the structure saved in each record     */
+
+    /* Position of the current record, set by flash_record_load() */
+    uint32_t            sequence;
+    uint32_t            half;
+    uint32_t            next_slot;
+} flash_record_area_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+cy_rslt_t flash_record_load(flash_record_area_t *area, void *payload, bool *found);
+cy_rslt_t flash_record_save(flash_record_area_t *area, const void *payload);
+uint32_t flash_record_crc32(uint32_t crc, const void *data, size_t len);
+
+#endif /* FLASH_RECORD_H_ */
+
+/* [] END OF FILE */
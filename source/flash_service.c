@@ -0,0 +1,627 @@
+/******************************************************************************
+* File Name:   flash_service.c
+*
+* Description: This file contains the flash service task. It executes the
+*              flash operations of the other tasks from a queue, so the OTA
+*              download continues while the previous chunk is programmed.
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "cyhal.h"
+#include "cybsp.h"
+
+/* FreeRTOS header files */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+/* Task header files */
+#include "flash_service.h"
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+/* Buffered request with its own copy of the data, in flash_service_data[] */
+typedef struct
+{
+    bool                        in_use;
+    flash_service_request_t     request;
+    flash_service_callback_t    callback;   /* Callback of the submitted request */
+} flash_service_buffer_t;
+
+/*******************************************************************************
+* Forward declaration
+********************************************************************************/
+static void flash_service_task(void *args);
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Queue of pointers to the submitted requests, NULL until the service is started */
+static QueueHandle_t flash_service_queue;
+
+/* Buffers of the buffered requests and the number of free ones */
+static flash_service_buffer_t flash_service_buffers[FLASH_SERVICE_BUFFERS];
+static SemaphoreHandle_t flash_service_buffers_free;
+
+/* Data of the buffered requests, word aligned and back to back. Buffers are
+ * used in turn, so the data of consecutive writes is usually contiguous and
+ * merged writes are executed from it without another copy.
+ */
+static uint32_t flash_service_data[FLASH_SERVICE_BUFFERS][FLASH_SERVICE_BUFFER_SIZE / sizeof(uint32_t)];
+static uint32_t flash_service_next_buffer;
+
+/* First error of a buffered request since the last flash_service_sync() */
+static cy_rslt_t flash_service_deferred_result = CY_RSLT_SUCCESS;
+
+static flash_service_stats_t flash_service_stats;
+
+#if (FLASH_SERVICE_MERGE_SIZE > 0)
+/* Data of merged requests, only used by the flash service task */
+static uint8_t flash_service_merge_buffer[FLASH_SERVICE_MERGE_SIZE];
+#endif
+
+/*******************************************************************************
+ * Function Name: flash_service_start
+ *******************************************************************************
+ * Summary:
+ *  Creates the request queue and starts the flash service task. Until it is
+ *  started the requests are executed in the task submitting them.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, CY_RSLT_TYPE_ERROR otherwise
+ *
+ *******************************************************************************/
+cy_rslt_t flash_service_start(void)
+{
+    if (flash_service_queue != NULL)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    flash_service_buffers_free = xSemaphoreCreateCounting(FLASH_SERVICE_BUFFERS, FLASH_SERVICE_BUFFERS);
+    if (flash_service_buffers_free == NULL)
+    {
+        printf("\n Failed to create the flash service buffer semaphore.\n");
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    flash_service_queue = xQueueCreate(FLASH_SERVICE_QUEUE_LENGTH, sizeof(flash_service_request_t *));
+    if (flash_service_queue == NULL)
+    {
+        printf("\n Failed to create the flash service queue.\n");
+        vSemaphoreDelete(flash_service_buffers_free);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    if (pdPASS != xTaskCreate(flash_service_task, "Flash service", FLASH_SERVICE_TASK_STACK_SIZE, NULL,
+                              FLASH_SERVICE_TASK_PRIORITY, NULL))
+    {
+        printf("\n Failed to create the flash service task.\n");
+        vQueueDelete(flash_service_queue);
+        vSemaphoreDelete(flash_service_buffers_free);
+        flash_service_queue = NULL;
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: flash_service_run
+ *******************************************************************************
+ * Summary:
+ *  Executes the flash operation of a request in one flash session.
+ *
+ * Parameters:
+ *  flash_service_request_t *request : Request to execute
+ *
+ * Return:
+ *  cy_rslt_t : Result of the flash operation
+ *
+ *******************************************************************************/
+static cy_rslt_t flash_service_run(flash_service_request_t *request)
+{
+    cy_rslt_t result = cy_ota_mem_session_begin();
+
+    if (CY_RSLT_SUCCESS != result)
+    {
+        return result;
+    }
+
+    switch (request->op)
+    {
+        case FLASH_SERVICE_OP_READ:
+            result = cy_ota_mem_read(request->mem_type, request->addr, request->data, request->len);
+            break;
+        case FLASH_SERVICE_OP_WRITE:
+            result = cy_ota_mem_write(request->mem_type, request->addr, request->data, request->len);
+            break;
+        case FLASH_SERVICE_OP_ERASE:
+            result = cy_ota_mem_erase(request->mem_type, request->addr, request->len);
+            break;
+        case FLASH_SERVICE_OP_FLUSH:
+            result = cy_ota_mem_flush();
+            break;
+        case FLASH_SERVICE_OP_JOB:
+            result = (request->job != NULL) ? request->job(request) : CY_RSLT_TYPE_ERROR;
+            break;
+        default:
+            result = CY_RSLT_TYPE_ERROR;
+            break;
+    }
+
+    cy_ota_mem_session_end();
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: flash_service_complete
+ *******************************************************************************
+ * Summary:
+ *  Records the result and the latency of a request and reports its completion
+ *  through the callback, or by notifying the submitting task.
+ *
+ * Parameters:
+ *  flash_service_request_t *request : Completed request
+ *  cy_rslt_t result                 : Result of the flash operation
+ *
+ *******************************************************************************/
+static void flash_service_complete(flash_service_request_t *request, cy_rslt_t result)
+{
+    uint32_t latency_ms = (uint32_t)((xTaskGetTickCount() - request->submit_tick) * portTICK_PERIOD_MS);
+
+    flash_service_stats.requests++;
+    flash_service_stats.latency_total_ms += latency_ms;
+    if (latency_ms > flash_service_stats.latency_max_ms)
+    {
+        flash_service_stats.latency_max_ms = latency_ms;
+    }
+    if (CY_RSLT_SUCCESS != result)
+    {
+        flash_service_stats.errors++;
+    }
+
+    request->result = result;
+    if (request->callback != NULL)
+    {
+        request->callback(request);
+    }
+    else
+    {
+        (void)xTaskNotifyGiveIndexed(request->task, FLASH_SERVICE_NOTIFY_INDEX);
+    }
+}
+
+#if (FLASH_SERVICE_MERGE_SIZE > 0)
+/*******************************************************************************
+ * Function Name: flash_service_can_merge
+ *******************************************************************************
+ * Summary:
+ *  Checks if a request continues the data of the previous one, so both can be
+ *  executed as one flash operation.
+ *
+ *******************************************************************************/
+static bool flash_service_can_merge(const flash_service_request_t *first, const flash_service_request_t *last,
+                                    const flash_service_request_t *next, size_t merged_len)
+{
+    return ((next->op == first->op) &&
+            ((first->op == FLASH_SERVICE_OP_WRITE) || (first->op == FLASH_SERVICE_OP_JOB)) &&
+            (next->mem_type == first->mem_type) &&
+            (next->job == first->job) &&
+            (next->arg == first->arg) &&
+            (next->param == first->param) &&
+            (next->addr == (last->addr + last->len)) &&
+            ((merged_len + next->len) <= FLASH_SERVICE_MERGE_SIZE));
+}
+#endif
+
+/*******************************************************************************
+ * Function Name: flash_service_task
+ *******************************************************************************
+ * Summary:
+ *  Executes the requests in the order of the queue. High priority requests are
+ *  queued ahead of the others. Writes that continue each other and are queued
+ *  back to back are merged into one flash operation.
+ *
+ * Parameters:
+ *  void *args : Task parameter defined during task creation (unused)
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+static void flash_service_task(void *args)
+{
+    flash_service_request_t *batch[FLASH_SERVICE_QUEUE_LENGTH + 1u];
+
+    (void)args;
+
+    for (;;)
+    {
+        uint32_t count = 1;
+        uint32_t i;
+        cy_rslt_t result;
+
+        if (pdPASS != xQueueReceive(flash_service_queue, &batch[0], portMAX_DELAY))
+        {
+            continue;
+        }
+
+#if (FLASH_SERVICE_MERGE_SIZE > 0)
+        flash_service_request_t *next;
+        size_t merged_len = batch[0]->len;
+
+        while ((count <= FLASH_SERVICE_QUEUE_LENGTH) &&
+               (pdPASS == xQueuePeek(flash_service_queue, &next, 0)) &&
+               flash_service_can_merge(batch[0], batch[count - 1u], next, merged_len))
+        {
+            (void)xQueueReceive(flash_service_queue, &batch[count], 0);
+            merged_len += next->len;
+            count++;
+        }
+
+        if (count > 1u)
+        {
+            flash_service_request_t merged = *batch[0];
+            size_t offset = 0;
+
+            /* Data already back to back in memory is used where it is */
+            i = 1;
+            while ((i < count) && (batch[i]->data == (batch[i - 1u]->data + batch[i - 1u]->len)))
+            {
+                i++;
+            }
+            if (i < count)
+            {
+                for (i = 0; i < count; i++)
+                {
+                    memcpy(&flash_service_merge_buffer[offset], batch[i]->data, batch[i]->len);
+                    offset += batch[i]->len;
+                }
+                merged.data = flash_service_merge_buffer;
+            }
+            else
+            {
+                flash_service_stats.merged_in_place += count - 1u;
+            }
+            merged.len = merged_len;
+            flash_service_stats.merged += count - 1u;
+
+            result = flash_service_run(&merged);
+        }
+        else
+#endif
+        {
+            result = flash_service_run(batch[0]);
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            flash_service_complete(batch[i], result);
+        }
+    }
+}
+
+/*******************************************************************************
+ * Function Name: flash_service_submit
+ *******************************************************************************
+ * Summary:
+ *  Queues a request and returns without waiting for it. The request and its
+ *  data must stay valid until it is completed. On completion the callback of
+ *  the request is called in the flash service task, without a callback the
+ *  submitting task is notified on FLASH_SERVICE_NOTIFY_INDEX. Before the service is
+ *  started the request is executed and completed right away.
+ *
+ * Parameters:
+ *  flash_service_request_t *request : Request to queue
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS if the request is queued
+ *
+ *******************************************************************************/
+cy_rslt_t flash_service_submit(flash_service_request_t *request)
+{
+    BaseType_t queued;
+    uint32_t depth;
+
+    if (request == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    request->task = xTaskGetCurrentTaskHandle();
+    request->submit_tick = xTaskGetTickCount();
+    request->result = CY_RSLT_SUCCESS;
+
+    if (flash_service_queue == NULL)
+    {
+        flash_service_complete(request, flash_service_run(request));
+        return CY_RSLT_SUCCESS;
+    }
+
+    if (FLASH_SERVICE_PRIORITY_HIGH == request->priority)
+    {
+        queued = xQueueSendToFront(flash_service_queue, &request, portMAX_DELAY);
+    }
+    else
+    {
+        queued = xQueueSendToBack(flash_service_queue, &request, portMAX_DELAY);
+    }
+
+    depth = (uint32_t)uxQueueMessagesWaiting(flash_service_queue);
+    if (depth > flash_service_stats.queue_depth_max)
+    {
+        flash_service_stats.queue_depth_max = depth;
+    }
+
+    return (pdPASS == queued) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+}
+
+/*******************************************************************************
+ * Function Name: flash_service_execute
+ *******************************************************************************
+ * Summary:
+ *  Queues a request and waits until it is completed. The callback of the
+ *  request is not used.
+ *
+ * Parameters:
+ *  flash_service_request_t *request : Request to execute
+ *
+ * Return:
+ *  cy_rslt_t : Result of the flash operation
+ *
+ *******************************************************************************/
+cy_rslt_t flash_service_execute(flash_service_request_t *request)
+{
+    cy_rslt_t result;
+
+    if (request == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    request->callback = NULL;
+    result = flash_service_submit(request);
+    if (CY_RSLT_SUCCESS != result)
+    {
+        return result;
+    }
+
+    (void)ulTaskNotifyTakeIndexed(FLASH_SERVICE_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+
+    return request->result;
+}
+
+/* Releases the buffer of a completed buffered request, keeping the first error for flash_service_sync() */
+static void flash_service_buffer_done(flash_service_request_t *request)
+{
+    flash_service_buffer_t *buffer = (flash_service_buffer_t *)((uint8_t *)request - offsetof(flash_service_buffer_t, request));
+
+    if ((CY_RSLT_SUCCESS != request->result) && (CY_RSLT_SUCCESS == flash_service_deferred_result))
+    {
+        flash_service_deferred_result = request->result;
+    }
+    if (buffer->callback != NULL)
+    {
+        buffer->callback(request);
+    }
+
+    buffer->in_use = false;
+    (void)xSemaphoreGive(flash_service_buffers_free);
+}
+
+/*******************************************************************************
+ * Function Name: flash_service_submit_buffered
+ *******************************************************************************
+ * Summary:
+ *  Copies the data of a request to one of the service buffers and queues it,
+ *  the caller may reuse its buffer right away. Waits for a free buffer while
+ *  all of them are queued. An error of the request is returned by the next
+ *  flash_service_sync(). Requests larger than FLASH_SERVICE_BUFFER_SIZE, and
+ *  all requests before the service is started, are executed before it returns.
+ *
+ * Parameters:
+ *  const flash_service_request_t *request : Request to queue, data is copied
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS if the request is queued
+ *
+ *******************************************************************************/
+cy_rslt_t flash_service_submit_buffered(const flash_service_request_t *request)
+{
+    flash_service_buffer_t *buffer = NULL;
+    uint32_t index = 0;
+    uint32_t i;
+
+    if (request == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    if ((flash_service_queue == NULL) || (request->len > FLASH_SERVICE_BUFFER_SIZE))
+    {
+        flash_service_request_t copy = *request;
+        cy_rslt_t result = flash_service_execute(&copy);
+
+        if (request->callback != NULL)
+        {
+            request->callback(&copy);
+        }
+        return result;
+    }
+
+    (void)xSemaphoreTake(flash_service_buffers_free, portMAX_DELAY);
+
+    taskENTER_CRITICAL();
+    for (i = 0; i < FLASH_SERVICE_BUFFERS; i++)
+    {
+        index = (flash_service_next_buffer + i) % FLASH_SERVICE_BUFFERS;
+        if (!flash_service_buffers[index].in_use)
+        {
+            buffer = &flash_service_buffers[index];
+            buffer->in_use = true;
+            flash_service_next_buffer = (index + 1u) % FLASH_SERVICE_BUFFERS;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if (buffer == NULL)
+    {
+        (void)xSemaphoreGive(flash_service_buffers_free);
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    buffer->request = *request;
+    buffer->callback = request->callback;
+    if ((request->data != NULL) && (request->len > 0u))
+    {
+        memcpy(flash_service_data[index], request->data, request->len);
+        buffer->request.data = (uint8_t *)flash_service_data[index];
+    }
+    buffer->request.callback = flash_service_buffer_done;
+
+    return flash_service_submit(&buffer->request);
+}
+
+/*******************************************************************************
+ * Function Name: flash_service_sync
+ *******************************************************************************
+ * Summary:
+ *  Waits until the requests queued before are completed and programs the rows
+ *  still held in the flash write-combining buffer.
+ *
+ * Return:
+ *  cy_rslt_t : First error of a buffered request since the last call, or the
+ *              result of the flush
+ *
+ *******************************************************************************/
+cy_rslt_t flash_service_sync(void)
+{
+    flash_service_request_t request = { .op = FLASH_SERVICE_OP_FLUSH };
+    cy_rslt_t result = flash_service_execute(&request);
+
+    taskENTER_CRITICAL();
+    if (CY_RSLT_SUCCESS != flash_service_deferred_result)
+    {
+        result = flash_service_deferred_result;
+        flash_service_deferred_result = CY_RSLT_SUCCESS;
+    }
+    taskEXIT_CRITICAL();
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: flash_service_read
+ *******************************************************************************
+ * Summary:
+ *  Reads the flash through the flash service, after the requests queued
+ *  before it.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_service_read(cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len)
+{
+    flash_service_request_t request = { .op = FLASH_SERVICE_OP_READ, .mem_type = mem_type,
+                                        .addr = addr, .data = data, .len = len };
+
+    return flash_service_execute(&request);
+}
+
+/*******************************************************************************
+ * Function Name: flash_service_write
+ *******************************************************************************
+ * Summary:
+ *  Writes to the flash through the flash service and waits for the write.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_service_write(cy_ota_mem_type_t mem_type, uint32_t addr, const void *data, size_t len)
+{
+    flash_service_request_t request = { .op = FLASH_SERVICE_OP_WRITE, .mem_type = mem_type,
+                                        .addr = addr, .data = (uint8_t *)data, .len = len };
+
+    return flash_service_execute(&request);
+}
+
+/*******************************************************************************
+ * Function Name: flash_service_erase
+ *******************************************************************************
+ * Summary:
+ *  Erases the flash through the flash service and waits for the erase.
+ *
+ *******************************************************************************/
+cy_rslt_t flash_service_erase(cy_ota_mem_type_t mem_type, uint32_t addr, size_t len)
+{
+    flash_service_request_t request = { .op = FLASH_SERVICE_OP_ERASE, .mem_type = mem_type,
+                                        .addr = addr, .len = len };
+
+    return flash_service_execute(&request);
+}
+
+/*******************************************************************************
+ * Function Name: flash_service_get_stats
+ *******************************************************************************
+ * Summary:
+ *  Gets the statistics of the flash service.
+ *
+ *******************************************************************************/
+void flash_service_get_stats(flash_service_stats_t *stats)
+{
+    if (stats != NULL)
+    {
+        *stats = flash_service_stats;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: flash_service_reset_stats
+ *******************************************************************************
+ * Summary:
+ *  Clears the statistics of the flash service.
+ *
+ *******************************************************************************/
+void flash_service_reset_stats(void)
+{
+    memset(&flash_service_stats, 0x00, sizeof(flash_service_stats));
+}
+
+/* [] END OF FILE */
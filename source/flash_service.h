@@ -0,0 +1,162 @@
+/******************************************************************************
+* File Name:   flash_service.h
+*
+* Description: This file is the public interface of flash_service.c source
+*              file
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef FLASH_SERVICE_H_
+#define FLASH_SERVICE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cy_result.h"
+#include "cy_ota_flash_ext.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Task parameters for the flash service task */
+#define FLASH_SERVICE_TASK_PRIORITY         (2)
+#define FLASH_SERVICE_TASK_STACK_SIZE       (1024 * 2)
+
+/* Number of requests the queue of the flash service holds */
+#ifndef FLASH_SERVICE_QUEUE_LENGTH
+#define FLASH_SERVICE_QUEUE_LENGTH          (8u)
+#endif
+
+/* Number and size of the buffers holding the data of buffered requests. One
+ * buffer is filled while the previous one is programmed, the size should be
+ * the OTA chunk size, a multiple of 4 bytes.
+ */
+#ifndef FLASH_SERVICE_BUFFERS
+#define FLASH_SERVICE_BUFFERS               (2u)
+#endif
+#ifndef FLASH_SERVICE_BUFFER_SIZE
+#define FLASH_SERVICE_BUFFER_SIZE           (4096u)
+#endif
+
+/* Task notification index used to report the completion of a request, the
+ * default index 0 stays free for the other notifications of the caller.
+ * Needs configTASK_NOTIFICATION_ARRAY_ENTRIES above this index.
+ */
+#ifndef FLASH_SERVICE_NOTIFY_INDEX
+#define FLASH_SERVICE_NOTIFY_INDEX          (1u)
+#endif
+
+/* Largest write adjacent requests are merged into, 0 to disable merging */
+#ifndef FLASH_SERVICE_MERGE_SIZE
+#define FLASH_SERVICE_MERGE_SIZE            (FLASH_SERVICE_BUFFER_SIZE * 2u)
+#endif
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+typedef enum
+{
+    FLASH_SERVICE_OP_READ,          /* cy_ota_mem_read()                         */
+    FLASH_SERVICE_OP_WRITE,         /* cy_ota_mem_write()                        */
+    FLASH_SERVICE_OP_ERASE,         /* cy_ota_mem_erase()                        */
+    FLASH_SERVICE_OP_FLUSH,         /* cy_ota_mem_flush()                        */
+    FLASH_SERVICE_OP_JOB            /* Calls job() in the flash service task     */
+} flash_service_op_t;
+
+typedef enum
+{
+    FLASH_SERVICE_PRIORITY_NORMAL,  /* Served in the order submitted             */
+    FLASH_SERVICE_PRIORITY_HIGH     /* Served before all the normal requests     */
+} flash_service_priority_t;
+
+typedef struct flash_service_request flash_service_request_t;
+
+/* Called in the flash service task once the request is completed */
+typedef void (*flash_service_callback_t)(flash_service_request_t *request);
+
+/* Flash operation of a FLASH_SERVICE_OP_JOB request, e.g. a write through the OTA storage API */
+typedef cy_rslt_t (*flash_service_job_t)(flash_service_request_t *request);
+
+struct flash_service_request
+{
+    flash_service_op_t          op;
+    flash_service_priority_t    priority;
+    cy_ota_mem_type_t           mem_type;
+    uint32_t                    addr;       /* Flash address, the offset of the data for a job */
+    uint8_t                     *data;
+    size_t                      len;
+    flash_service_job_t         job;        /* FLASH_SERVICE_OP_JOB only                       */
+    void                        *arg;       /* Passed on to job and callback                   */
+    uint32_t                    param;      /* Passed on to job and callback                   */
+    flash_service_callback_t    callback;   /* NULL to notify the submitting task instead      */
+
+    /* Set by the flash service */
+    TaskHandle_t                task;
+    TickType_t                  submit_tick;
+    cy_rslt_t                   result;
+};
+
+/* Statistics of the flash service, latency is from submitting to completion */
+typedef struct
+{
+    uint32_t requests;              /* Requests completed                        */
+    uint32_t merged;                /* Requests merged into the previous one     */
+    uint32_t merged_in_place;       /* Of them, merged without copying the data  */
+    uint32_t errors;                /* Requests completed with an error          */
+    uint32_t queue_depth_max;       /* Most requests waiting in the queue        */
+    uint32_t latency_max_ms;        /* Longest latency of a request              */
+    uint32_t latency_total_ms;      /* Latency of all the requests               */
+} flash_service_stats_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+cy_rslt_t flash_service_start(void);
+cy_rslt_t flash_service_submit(flash_service_request_t *request);
+cy_rslt_t flash_service_execute(flash_service_request_t *request);
+cy_rslt_t flash_service_submit_buffered(const flash_service_request_t *request);
+cy_rslt_t flash_service_sync(void);
+cy_rslt_t flash_service_read(cy_ota_mem_type_t mem_type, uint32_t addr, void *data, size_t len);
+cy_rslt_t flash_service_write(cy_ota_mem_type_t mem_type, uint32_t addr, const void *data, size_t len);
+cy_rslt_t flash_service_erase(cy_ota_mem_type_t mem_type, uint32_t addr, size_t len);
+void flash_service_get_stats(flash_service_stats_t *stats);
+void flash_service_reset_stats(void);
+
+#endif /* FLASH_SERVICE_H_ */
+
+/* [] END OF FILE */
@@ -0,0 +1,567 @@
+/******************************************************************************
+* File Name:   image_digest.c
+*
+* Description: This file contains the streaming SHA-256 of the OTA image. The
+*              image is hashed as it is written to the upgrade slot, so it can
+*              be verified against the digest in its MCUboot TLV area without
+*              reading the slot back. The SHA-256 state is saved with the
+*              download progress, so it continues over an interrupted download.
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "image_digest.h"
+
+#if (IMAGE_DIGEST_READBACK_STRIDE > 0)
+/* mbedTLS header files */
+#include "mbedtls/sha256.h"
+#endif
+
+/* Flash API extensions */
+#include "cy_ota_flash_ext.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* MCUboot image format, see bootutil/image.h */
+#define IMAGE_MAGIC                         (0x96f3b83du)
+#define IMAGE_HEADER_SIZE                   (IMAGE_DIGEST_HEADER_SIZE)
+#define IMAGE_F_ENCRYPTED_AES128            (0x00000004u)
+#define IMAGE_F_ENCRYPTED_AES256            (0x00000008u)
+#define IMAGE_TLV_INFO_MAGIC                (0x6907u)
+#define IMAGE_TLV_INFO_SIZE                 (4u)
+#define IMAGE_TLV_SIZE                      (4u)
+#define IMAGE_TLV_SHA256                    (0x10u)
+#define IMAGE_SHA256_SIZE                   (32u)
+
+#define GET_LE16(p)                         ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8))
+#define GET_LE32(p)                         (GET_LE16(p) | (GET_LE16((p) + 2) << 16))
+
+#define ROTR32(x, n)                        (((x) >> (n)) | ((x) << (32u - (n))))
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* SHA-256 of the image header, the image and the protected TLVs, and what is
+ * kept of the image to check it. Saved with the download progress.
+ */
+static image_digest_state_t digest;
+
+static const uint32_t sha256_k[64] =
+{
+    0x428a2f98u, 0x71374491u, 0xb5c0fbcfu, 0xe9b5dba5u, 0x3956c25bu, 0x59f111f1u, 0x923f82a4u, 0xab1c5ed5u,
+    0xd807aa98u, 0x12835b01u, 0x243185beu, 0x550c7dc3u, 0x72be5d74u, 0x80deb1feu, 0x9bdc06a7u, 0xc19bf174u,
+    0xe49b69c1u, 0xefbe4786u, 0x0fc19dc6u, 0x240ca1ccu, 0x2de92c6fu, 0x4a7484aau, 0x5cb0a9dcu, 0x76f988dau,
+    0x983e5152u, 0xa831c66du, 0xb00327c8u, 0xbf597fc7u, 0xc6e00bf3u, 0xd5a79147u, 0x06ca6351u, 0x14292967u,
+    0x27b70a85u, 0x2e1b2138u, 0x4d2c6dfcu, 0x53380d13u, 0x650a7354u, 0x766a0abbu, 0x81c2c92eu, 0x92722c85u,
+    0xa2bfe8a1u, 0xa81a664bu, 0xc24b8b70u, 0xc76c51a3u, 0xd192e819u, 0xd6990624u, 0xf40e3585u, 0x106aa070u,
+    0x19a4c116u, 0x1e376c08u, 0x2748774cu, 0x34b0bcb5u, 0x391c0cb3u, 0x4ed8aa4au, 0x5b9cca4fu, 0x682e6ff3u,
+    0x748f82eeu, 0x78a5636fu, 0x84c87814u, 0x8cc70208u, 0x90befffau, 0xa4506cebu, 0xbef9a3f7u, 0xc67178f2u,
+};
+
+#if (IMAGE_DIGEST_READBACK_STRIDE > 0)
+/* SHA-256 of the sampled blocks as written, and the block read back from the slot */
+static mbedtls_sha256_context readback_ctx;
+static uint8_t readback_buffer[IMAGE_DIGEST_READBACK_BLOCK_SIZE];
+#endif
+
+/*******************************************************************************
+ * Function Name: image_digest_sha256_block
+ *******************************************************************************
+ * Summary:
+ *  Runs the SHA-256 compression function over one 64-byte block.
+ *
+ *******************************************************************************/
+static void image_digest_sha256_block(image_digest_sha256_t *sha, const uint8_t *block)
+{
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, h;
+    uint32_t t1, t2;
+    uint32_t i;
+
+    for (i = 0; i < 16u; i++)
+    {
+        w[i] = ((uint32_t)block[4u * i] << 24) | ((uint32_t)block[(4u * i) + 1u] << 16) |
+               ((uint32_t)block[(4u * i) + 2u] << 8) | (uint32_t)block[(4u * i) + 3u];
+    }
+    for (i = 16; i < 64u; i++)
+    {
+        t1 = ROTR32(w[i - 2u], 17u) ^ ROTR32(w[i - 2u], 19u) ^ (w[i - 2u] >> 10);
+        t2 = ROTR32(w[i - 15u], 7u) ^ ROTR32(w[i - 15u], 18u) ^ (w[i - 15u] >> 3);
+        w[i] = t1 + w[i - 7u] + t2 + w[i - 16u];
+    }
+
+    a = sha->state[0];
+    b = sha->state[1];
+    c = sha->state[2];
+    d = sha->state[3];
+    e = sha->state[4];
+    f = sha->state[5];
+    g = sha->state[6];
+    h = sha->state[7];
+
+    for (i = 0; i < 64u; i++)
+    {
+        t1 = h + (ROTR32(e, 6u) ^ ROTR32(e, 11u) ^ ROTR32(e, 25u)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        t2 = (ROTR32(a, 2u) ^ ROTR32(a, 13u) ^ ROTR32(a, 22u)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    sha->state[0] += a;
+    sha->state[1] += b;
+    sha->state[2] += c;
+    sha->state[3] += d;
+    sha->state[4] += e;
+    sha->state[5] += f;
+    sha->state[6] += g;
+    sha->state[7] += h;
+}
+
+/*******************************************************************************
+ * Function Name: image_digest_sha256_starts
+ *******************************************************************************
+ * Summary:
+ *  Starts a SHA-256 computation.
+ *
+ *******************************************************************************/
+static void image_digest_sha256_starts(image_digest_sha256_t *sha)
+{
+    static const uint32_t sha256_init[8] =
+    {
+        0x6a09e667u, 0xbb67ae85u, 0x3c6ef372u, 0xa54ff53au, 0x510e527fu, 0x9b05688cu, 0x1f83d9abu, 0x5be0cd19u,
+    };
+
+    memcpy(sha->state, sha256_init, sizeof(sha->state));
+    sha->total_len = 0;
+}
+
+/*******************************************************************************
+ * Function Name: image_digest_sha256_update
+ *******************************************************************************
+ * Summary:
+ *  Adds bytes to a SHA-256 computation.
+ *
+ *******************************************************************************/
+static void image_digest_sha256_update(image_digest_sha256_t *sha, const uint8_t *data, uint32_t len)
+{
+    while (len > 0u)
+    {
+        uint32_t used = sha->total_len % sizeof(sha->block);
+        uint32_t count = sizeof(sha->block) - used;
+
+        count = (count < len) ? count : len;
+        if ((used == 0u) && (count == sizeof(sha->block)))
+        {
+            /* Whole blocks are hashed in place */
+            image_digest_sha256_block(sha, data);
+        }
+        else
+        {
+            memcpy(&sha->block[used], data, count);
+            if ((used + count) == sizeof(sha->block))
+            {
+                image_digest_sha256_block(sha, sha->block);
+            }
+        }
+
+        sha->total_len += count;
+        data += count;
+        len -= count;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: image_digest_sha256_finish
+ *******************************************************************************
+ * Summary:
+ *  Pads the message and writes the SHA-256 in big-endian order.
+ *
+ *******************************************************************************/
+static void image_digest_sha256_finish(image_digest_sha256_t *sha, uint8_t *output)
+{
+    uint32_t used = sha->total_len % sizeof(sha->block);
+    uint64_t bits = (uint64_t)sha->total_len * 8u;
+    uint32_t i;
+
+    sha->block[used++] = 0x80u;
+    if (used > (sizeof(sha->block) - 8u))
+    {
+        memset(&sha->block[used], 0x00, sizeof(sha->block) - used);
+        image_digest_sha256_block(sha, sha->block);
+        used = 0;
+    }
+    memset(&sha->block[used], 0x00, sizeof(sha->block) - 8u - used);
+    for (i = 0; i < 8u; i++)
+    {
+        sha->block[sizeof(sha->block) - 1u - i] = (uint8_t)(bits >> (8u * i));
+    }
+    image_digest_sha256_block(sha, sha->block);
+
+    for (i = 0; i < 32u; i++)
+    {
+        output[i] = (uint8_t)(sha->state[i / 4u] >> (24u - (8u * (i % 4u))));
+    }
+}
+
+/*******************************************************************************
+ * Function Name: image_digest_start
+ *******************************************************************************
+ * Summary:
+ *  Starts hashing a new image. Called when the OTA storage is opened.
+ *
+ *******************************************************************************/
+void image_digest_start(void)
+{
+    memset(&digest, 0x00, sizeof(digest));
+    image_digest_sha256_starts(&digest.sha);
+    digest.in_order = true;
+#if (IMAGE_DIGEST_READBACK_STRIDE > 0)
+    mbedtls_sha256_init(&readback_ctx);
+    (void)mbedtls_sha256_starts(&readback_ctx, 0);
+#endif
+
+}
+
+/*******************************************************************************
+ * Function Name: image_digest_parse_header
+ *******************************************************************************
+ * Summary:
+ *  Checks the MCUboot image header and gets the length of the hashed part.
+ *  The digest of an encrypted image is computed over the decrypted data, it
+ *  can not be checked while the image is written.
+ *
+ *******************************************************************************/
+static void image_digest_parse_header(void)
+{
+    uint32_t hdr_size  = GET_LE16(&digest.header[8]);
+    uint32_t prot_size = GET_LE16(&digest.header[10]);
+    uint32_t img_size  = GET_LE32(&digest.header[12]);
+    uint32_t flags     = GET_LE32(&digest.header[16]);
+
+    digest.is_image = (GET_LE32(&digest.header[0]) == IMAGE_MAGIC) && (hdr_size >= IMAGE_HEADER_SIZE) &&
+                      ((flags & (IMAGE_F_ENCRYPTED_AES128 | IMAGE_F_ENCRYPTED_AES256)) == 0u);
+    digest.hashed_len = hdr_size + img_size + prot_size;
+}
+
+/*******************************************************************************
+ * Function Name: image_digest_consume
+ *******************************************************************************
+ * Summary:
+ *  Hashes the next bytes of the image and keeps the header and the start of
+ *  the unprotected TLV area.
+ *
+ * Parameters:
+ *  const uint8_t *data : Data following the bytes received so far
+ *  uint32_t len        : Number of bytes
+ *
+ *******************************************************************************/
+static void image_digest_consume(const uint8_t *data, uint32_t len)
+{
+    while (len > 0u)
+    {
+        uint32_t count = len;
+
+        if (digest.next_offset < IMAGE_HEADER_SIZE)
+        {
+            count = IMAGE_HEADER_SIZE - digest.next_offset;
+            count = (count < len) ? count : len;
+            memcpy(&digest.header[digest.next_offset], data, count);
+            image_digest_sha256_update(&digest.sha, data, count);
+            if ((digest.next_offset + count) == IMAGE_HEADER_SIZE)
+            {
+                image_digest_parse_header();
+            }
+        }
+        else if (!digest.is_image)
+        {
+            /* Nothing to check, just count the bytes */
+        }
+        else if (digest.next_offset < digest.hashed_len)
+        {
+            count = digest.hashed_len - digest.next_offset;
+            count = (count < len) ? count : len;
+            image_digest_sha256_update(&digest.sha, data, count);
+        }
+        else if ((digest.next_offset - digest.hashed_len) < IMAGE_DIGEST_TLV_BUFFER_SIZE)
+        {
+            count = IMAGE_DIGEST_TLV_BUFFER_SIZE - (digest.next_offset - digest.hashed_len);
+            count = (count < len) ? count : len;
+            memcpy(&digest.tlv[digest.tlv_len], data, count);
+            digest.tlv_len += count;
+        }
+
+        digest.next_offset += count;
+        data += count;
+        len -= count;
+    }
+}
+
+#if (IMAGE_DIGEST_READBACK_STRIDE > 0)
+/*******************************************************************************
+ * Function Name: image_digest_sample
+ *******************************************************************************
+ * Summary:
+ *  Hashes the bytes that lie in the blocks read back on verification.
+ *
+ * Parameters:
+ *  uint32_t offset     : Offset of the data in the image
+ *  const uint8_t *data : Data to write at the offset
+ *  uint32_t len        : Number of bytes
+ *
+ *******************************************************************************/
+static void image_digest_sample(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    while (len > 0u)
+    {
+        uint32_t block = offset / IMAGE_DIGEST_READBACK_BLOCK_SIZE;
+        uint32_t count = ((block + 1u) * IMAGE_DIGEST_READBACK_BLOCK_SIZE) - offset;
+
+        count = (count < len) ? count : len;
+        if ((block % IMAGE_DIGEST_READBACK_STRIDE) == 0u)
+        {
+            (void)mbedtls_sha256_update(&readback_ctx, data, count);
+        }
+
+        offset += count;
+        data += count;
+        len -= count;
+    }
+}
+
+/*******************************************************************************
+ * Function Name: image_digest_readback
+ *******************************************************************************
+ * Summary:
+ *  Reads the sampled blocks back from the upgrade slot and compares them with
+ *  the data that was written.
+ *
+ * Return:
+ *  bool : true if the flash holds the data that was written
+ *
+ *******************************************************************************/
+static bool image_digest_readback(void)
+{
+    mbedtls_sha256_context flash_ctx;
+    uint8_t written[IMAGE_SHA256_SIZE];
+    uint8_t read[IMAGE_SHA256_SIZE];
+    uint32_t offset;
+    bool result = true;
+
+    mbedtls_sha256_init(&flash_ctx);
+    (void)mbedtls_sha256_starts(&flash_ctx, 0);
+
+    for (offset = 0; offset < digest.next_offset;
+         offset += IMAGE_DIGEST_READBACK_STRIDE * IMAGE_DIGEST_READBACK_BLOCK_SIZE)
+    {
+        uint32_t count = digest.next_offset - offset;
+
+        count = (count < IMAGE_DIGEST_READBACK_BLOCK_SIZE) ? count : IMAGE_DIGEST_READBACK_BLOCK_SIZE;
+        if (CY_RSLT_SUCCESS != cy_ota_mem_read(OTA_UPGRADE_SLOT_MEM_TYPE, OTA_UPGRADE_SLOT_ADDR + offset,
+                                               readback_buffer, count))
+        {
+            result = false;
+            break;
+        }
+        (void)mbedtls_sha256_update(&flash_ctx, readback_buffer, count);
+    }
+
+    (void)mbedtls_sha256_finish(&flash_ctx, read);
+    (void)mbedtls_sha256_finish(&readback_ctx, written);
+    mbedtls_sha256_free(&flash_ctx);
+    mbedtls_sha256_free(&readback_ctx);
+
+    return result && (memcmp(written, read, sizeof(read)) == 0);
+}
+#endif /* IMAGE_DIGEST_READBACK_STRIDE */
+
+/*******************************************************************************
+ * Function Name: image_digest_update
+ *******************************************************************************
+ * Summary:
+ *  Hashes a chunk written to the upgrade slot. Chunks must follow each other,
+ *  a chunk repeating data already received is ignored. After a gap the digest
+ *  is no longer available for this image.
+ *
+ * Parameters:
+ *  uint32_t offset     : Offset of the chunk in the image
+ *  const uint8_t *data : Chunk data
+ *  uint32_t len        : Chunk size
+ *
+ *******************************************************************************/
+void image_digest_update(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    if (!digest.in_order || ((offset + len) <= digest.next_offset))
+    {
+        return;
+    }
+    if (offset > digest.next_offset)
+    {
+        digest.in_order = false;
+        return;
+    }
+
+    /* Skip the part received before */
+    data += digest.next_offset - offset;
+    len  -= digest.next_offset - offset;
+    offset = digest.next_offset;
+
+#if (IMAGE_DIGEST_READBACK_STRIDE > 0)
+    image_digest_sample(offset, data, len);
+#endif
+    image_digest_consume(data, len);
+}
+
+/*******************************************************************************
+ * Function Name: image_digest_verify
+ *******************************************************************************
+ * Summary:
+ *  Compares the digest of the data written with the SHA-256 TLV of the image,
+ *  and in paranoia builds reads the sampled blocks back. Ends the digest of
+ *  the image, image_digest_start() must be called for the next one.
+ *
+ * Return:
+ *  image_digest_result_t : Result of the comparison
+ *
+ *******************************************************************************/
+image_digest_result_t image_digest_verify(void)
+{
+    image_digest_result_t result = IMAGE_DIGEST_UNAVAILABLE;
+    uint8_t sha256[IMAGE_SHA256_SIZE];
+    uint32_t tlv_end;
+    uint32_t off;
+
+    if (!digest.in_order)
+    {
+        return IMAGE_DIGEST_UNAVAILABLE;
+    }
+    digest.in_order = false;
+
+    image_digest_sha256_finish(&digest.sha, sha256);
+
+    if (digest.is_image && (digest.tlv_len >= IMAGE_TLV_INFO_SIZE) &&
+        (GET_LE16(&digest.tlv[0]) == IMAGE_TLV_INFO_MAGIC))
+    {
+        /* it_tlv_tot includes the info header */
+        tlv_end = GET_LE16(&digest.tlv[2]);
+        tlv_end = (tlv_end < digest.tlv_len) ? tlv_end : digest.tlv_len;
+
+        for (off = IMAGE_TLV_INFO_SIZE; (off + IMAGE_TLV_SIZE) <= tlv_end;
+             off += IMAGE_TLV_SIZE + GET_LE16(&digest.tlv[off + 2]))
+        {
+            if ((GET_LE16(&digest.tlv[off]) == IMAGE_TLV_SHA256) &&
+                (GET_LE16(&digest.tlv[off + 2]) == IMAGE_SHA256_SIZE) &&
+                ((off + IMAGE_TLV_SIZE + IMAGE_SHA256_SIZE) <= tlv_end))
+            {
+                result = (memcmp(&digest.tlv[off + IMAGE_TLV_SIZE], sha256, sizeof(sha256)) == 0) ?
+                         IMAGE_DIGEST_MATCH : IMAGE_DIGEST_MISMATCH;
+                break;
+            }
+        }
+    }
+
+#if (IMAGE_DIGEST_READBACK_STRIDE > 0)
+    if (!image_digest_readback())
+    {
+        printf("\n Readback of the upgrade slot does not match the data written.\n");
+        result = IMAGE_DIGEST_MISMATCH;
+    }
+#endif
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: image_digest_save
+ *******************************************************************************
+ * Summary:
+ *  Copies the digest of the bytes received so far, to save it with the
+ *  progress of the download.
+ *
+ * Parameters:
+ *  image_digest_state_t *state : Where to copy the digest
+ *
+ *******************************************************************************/
+void image_digest_save(image_digest_state_t *state)
+{
+    memcpy(state, &digest, sizeof(digest));
+#if (IMAGE_DIGEST_READBACK_STRIDE > 0)
+    /* The hash of the sampled blocks is not saved, a resumed image is not checked */
+    state->in_order = false;
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: image_digest_restore
+ *******************************************************************************
+ * Summary:
+ *  Continues the digest saved by an interrupted download, in place of
+ *  image_digest_start(). The bytes below the offset returned are not hashed
+ *  again, they must be those the saved digest was computed over. A saved
+ *  digest that was no longer in order leaves it unavailable for this image.
+ *
+ * Parameters:
+ *  const image_digest_state_t *state : Saved digest
+ *
+ * Return:
+ *  uint32_t : Number of bytes from the start of the image the digest covers,
+ *             0 if it is unavailable
+ *
+ *******************************************************************************/
+uint32_t image_digest_restore(const image_digest_state_t *state)
+{
+    image_digest_start();
+
+    if (!state->in_order || (state->tlv_len > IMAGE_DIGEST_TLV_BUFFER_SIZE))
+    {
+        digest.in_order = false;
+        return 0;
+    }
+
+    memcpy(&digest, state, sizeof(digest));
+    return digest.next_offset;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,115 @@
+/******************************************************************************
+* File Name:   image_digest.h
+*
+* Description: This file is the public interface of image_digest.c
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef IMAGE_DIGEST_H_
+#define IMAGE_DIGEST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_result.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Paranoia builds: read back one block out of IMAGE_DIGEST_READBACK_STRIDE
+ * from the upgrade slot on verification and compare it with the data that
+ * was written. 0 disables the readback, the slot is then not read at all.
+ */
+#ifndef IMAGE_DIGEST_READBACK_STRIDE
+#define IMAGE_DIGEST_READBACK_STRIDE        (0u)
+#endif
+
+/* Size of the blocks read back */
+#define IMAGE_DIGEST_READBACK_BLOCK_SIZE    (512u)
+
+/* Size of the MCUboot image header */
+#define IMAGE_DIGEST_HEADER_SIZE            (32u)
+
+/* Start of the unprotected TLV area kept to find the SHA-256 TLV, imgtool
+ * places it first.
+ */
+#define IMAGE_DIGEST_TLV_BUFFER_SIZE        (128u)
+
+/*******************************************************************************
+* Data structure and enumeration
+********************************************************************************/
+typedef enum
+{
+    IMAGE_DIGEST_MATCH,         /* The digest of the written data matches the image */
+    IMAGE_DIGEST_MISMATCH,      /* The written data is corrupted                    */
+    IMAGE_DIGEST_UNAVAILABLE    /* Not an unencrypted MCUboot image, or not written in order */
+} image_digest_result_t;
+
+/* SHA-256 computation. A plain structure, unlike the context of the hardware
+ * accelerated mbedTLS SHA-256, so it can be saved to the flash and restored.
+ */
+typedef struct
+{
+    uint32_t state[8];
+    uint32_t total_len;             /* Bytes hashed                  */
+    uint8_t  block[64];             /* Block being filled            */
+} image_digest_sha256_t;
+
+/* Digest of the image received so far, saved with the download progress */
+typedef struct
+{
+    image_digest_sha256_t sha;      /* SHA-256 of the header, the image and the protected TLVs */
+    uint32_t next_offset;           /* Number of bytes received in order, from offset 0         */
+    uint32_t hashed_len;            /* Length of the hashed part, known once the header is in   */
+    uint32_t tlv_len;               /* Bytes kept of the unprotected TLV area                   */
+    uint8_t  in_order;              /* Cleared when a chunk is not contiguous with the previous */
+    uint8_t  is_image;              /* Set once the header describes an unencrypted image       */
+    uint8_t  header[IMAGE_DIGEST_HEADER_SIZE];
+    uint8_t  tlv[IMAGE_DIGEST_TLV_BUFFER_SIZE];
+} image_digest_state_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+void image_digest_start(void);
+void image_digest_update(uint32_t offset, const uint8_t *data, uint32_t len);
+image_digest_result_t image_digest_verify(void);
+void image_digest_save(image_digest_state_t *state);
+uint32_t image_digest_restore(const image_digest_state_t *state);
+
+#endif /* IMAGE_DIGEST_H_ */
+
+/* [] END OF FILE */
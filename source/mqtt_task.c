@@ -2,11 +2,13 @@
 * File Name:   mqtt_task.c
 *
 * Description: This file contains the task that handles initialization & 
-*              connection of Wi-Fi and the MQTT client. The task then starts 
-*              the subscriber and the publisher tasks. The task also implements
-*              reconnection mechanisms to handle WiFi and MQTT disconnections.
-*              The task also handles all the cleanup operations to gracefully 
-*              terminate the Wi-Fi and MQTT connections in case of any failure.
+*              connection of the MQTT client once the Wi-Fi service is
+*              connected. The task then starts the subscriber and the
+*              publisher tasks. The task also implements reconnection
+*              mechanisms to handle MQTT disconnections, waiting for the
+*              Wi-Fi service to reconnect if the link is down. The task also
+*              handles all the cleanup operations to gracefully terminate the
+*              MQTT connection in case of any failure.
 *
 * Related Document: See README.md
 *
@@ -44,6 +46,7 @@
 * so agrees to indemnify Cypress against all liability.
 *******************************************************************************/
 
+#include <string.h>
 #include "cyhal.h"
 #include "cybsp.h"
 
@@ -56,20 +59,17 @@
 #include "subscriber_task.h"
 #include "publisher_task.h"
 
-/* Configuration file for Wi-Fi and MQTT client */
-#include "wifi_config.h"
+#include "wifi_service.h"
+
+/* Configuration file for MQTT client */
 #include "mqtt_client_config.h"
 
 /* Middleware libraries */
 #include "cy_retarget_io.h"
-#include "cy_wcm.h"
 
 #include "cy_mqtt_api.h"
 #include "clock.h"
 
-/* LwIP header files */
-#include "lwip/netif.h"
-
 /******************************************************************************
 * Macros
 ******************************************************************************/
@@ -82,8 +82,6 @@
 #define TASK_CREATION_DELAY_MS           (2000u)
 
 /* Flag Masks for tracking which cleanup functions must be called. */
-#define WCM_INITIALIZED                  (1lu << 0)
-#define WIFI_CONNECTED                   (1lu << 1)
 #define LIBS_INITIALIZED                 (1lu << 2)
 #define BUFFER_INITIALIZED               (1lu << 3)
 #define MQTT_INSTANCE_CREATED            (1lu << 4)
@@ -124,9 +122,15 @@ cy_mqtt_t mqtt_connection;
  */
 QueueHandle_t mqtt_task_q;
 
+/* Tells the OTA agent when the connection is closed for its download */
+EventGroupHandle_t mqtt_client_events;
+
 /* Flag to denote initialization status of various operations. */
 uint32_t status_flag;
 
+/* Set while the connection is closed for the OTA agent, only used by the MQTT client task */
+static bool mqtt_connection_suspended;
+
 /* Pointer to the network buffer needed by the MQTT library for MQTT send and 
  * receive operations.
  */
@@ -135,9 +139,9 @@ uint8_t *mqtt_network_buffer = NULL;
 /******************************************************************************
 * Function Prototypes
 *******************************************************************************/
-static cy_rslt_t wifi_connect(void);
 static cy_rslt_t mqtt_init(void);
 static cy_rslt_t mqtt_connect(void);
+static cy_rslt_t mqtt_restore_connection(void);
 
 static void mqtt_event_callback(cy_mqtt_t mqtt_handle, cy_mqtt_event_t event, void *user_data);
 static void cleanup(void);
@@ -151,10 +155,11 @@ static cy_rslt_t mqtt_get_unique_client_identifier(char *mqtt_client_identifier)
  * Function Name: mqtt_client_task
  ******************************************************************************
  * Summary:
- *  Task for handling initialization & connection of Wi-Fi and the MQTT client.
- *  The task also creates and manages the subscriber and publisher tasks upon 
- *  successful MQTT connection. The task also handles the WiFi and MQTT 
- *  connections by initiating reconnection on the event of disconnections.
+ *  Task for handling initialization & connection of the MQTT client, after
+ *  the Wi-Fi service is connected to the AP. The task also creates and
+ *  manages the subscriber and publisher tasks upon successful MQTT
+ *  connection. The task also handles the MQTT connection by initiating
+ *  reconnection on the event of disconnections.
  *
  * Parameters:
  *  void *pvParameters : Task parameter defined during task creation (unused)
@@ -169,36 +174,21 @@ void mqtt_client_task(void *pvParameters)
      * message queues.
      */
     mqtt_task_cmd_t mqtt_status;
-    subscriber_data_t subscriber_q_data;
     publisher_data_t publisher_q_data;
 
-    /* Configure the Wi-Fi interface as a Wi-Fi STA (i.e. Client). */
-    cy_wcm_config_t config = {.interface = CY_WCM_INTERFACE_TYPE_STA};
-
     /* To avoid compiler warnings */
     (void) pvParameters;
 
     /* Create a message queue to communicate with other tasks and callbacks. */
     mqtt_task_q = xQueueCreate(MQTT_TASK_QUEUE_LENGTH, sizeof(mqtt_task_cmd_t));
+    mqtt_client_events = xEventGroupCreate();
 
-    /* Initialize the Wi-Fi Connection Manager and jump to the cleanup block 
-     * upon failure.
+    /* Wait for the Wi-Fi service to connect to the AP and cleanup if the
+     * operation fails.
      */
-    if (CY_RSLT_SUCCESS != cy_wcm_init(&config))
-    {
-        printf("\nWi-Fi Connection Manager initialization failed!\n");
-        goto exit_cleanup;
-    }
-
-    /* Set the appropriate bit in the status_flag to denote successful 
-     * WCM initialization.
-     */
-    status_flag |= WCM_INITIALIZED;
-    printf("\nWi-Fi Connection Manager initialized.\n");
-
-    /* Initiate connection to the Wi-Fi AP and cleanup if the operation fails. */
-    if (CY_RSLT_SUCCESS != wifi_connect())
+    if (CY_RSLT_SUCCESS != wifi_service_connect(portMAX_DELAY))
     {
+        printf("\nWi-Fi connection failed!\n");
         goto exit_cleanup;
     }
 
@@ -260,6 +250,14 @@ void mqtt_client_task(void *pvParameters)
 
                 case HANDLE_DISCONNECTION:
                 {
+                    /* A disconnection reported before the connection was
+                     * suspended is handled when it is resumed.
+                     */
+                    if (mqtt_connection_suspended)
+                    {
+                        break;
+                    }
+
                     /* Deinit the publisher before initiating reconnections. */
                     publisher_q_data.cmd = PUBLISHER_DEINIT;
                     xQueueSend(publisher_task_q, &publisher_q_data, portMAX_DELAY);
@@ -270,32 +268,57 @@ void mqtt_client_task(void *pvParameters)
                      */
                     cy_mqtt_disconnect(mqtt_connection);
 
-                    /* Check if Wi-Fi connection is active. If not, update the 
-                     * status flag and initiate Wi-Fi reconnection.
-                     */
-                    if (cy_wcm_is_connected_to_ap() == 0)
+                    if (CY_RSLT_SUCCESS != mqtt_restore_connection())
                     {
-                        status_flag &= ~(WIFI_CONNECTED);
-                        printf("\nInitiating Wi-Fi Reconnection...\n");
-                        if (CY_RSLT_SUCCESS != wifi_connect())
-                        {
-                            goto exit_cleanup;
-                        }
+                        goto exit_cleanup;
                     }
+                    break;
+                }
 
-                    printf("\nInitiating MQTT Reconnection...\n");
-                    if (CY_RSLT_SUCCESS != mqtt_connect())
+                case HANDLE_CONNECTION_SUSPEND:
+                {
+                    if (mqtt_connection_suspended)
                     {
-                        goto exit_cleanup;
+                        break;
                     }
+                    mqtt_connection_suspended = true;
 
-                    /* Initiate MQTT subscribe post the reconnection. */
-                    subscriber_q_data.cmd = SUBSCRIBE_TO_TOPIC;
-                    xQueueSend(subscriber_task_q, &subscriber_q_data, portMAX_DELAY);
-
-                    /* Initialize Publisher post the reconnection. */
-                    publisher_q_data.cmd = PUBLISHER_INIT;
+                    /* Stop publishing and close the session, the broker and
+                     * the TLS resources are left to the OTA agent.
+                     */
+                    publisher_q_data.cmd = PUBLISHER_DEINIT;
                     xQueueSend(publisher_task_q, &publisher_q_data, portMAX_DELAY);
+
+                    if (status_flag & MQTT_CONNECTION_SUCCESS)
+                    {
+                        status_flag &= ~(MQTT_CONNECTION_SUCCESS);
+                        cy_mqtt_disconnect(mqtt_connection);
+                    }
+                    printf("\nMQTT connection suspended while the OTA agent downloads.\n");
+                    print_heap_usage("mqtt_client_task: connection suspended");
+                    if (mqtt_client_events != NULL)
+                    {
+                        (void)xEventGroupSetBits(mqtt_client_events, MQTT_CLIENT_SUSPENDED);
+                    }
+                    break;
+                }
+
+                case HANDLE_CONNECTION_RESUME:
+                {
+                    if (!mqtt_connection_suspended)
+                    {
+                        break;
+                    }
+                    mqtt_connection_suspended = false;
+                    if (mqtt_client_events != NULL)
+                    {
+                        (void)xEventGroupClearBits(mqtt_client_events, MQTT_CLIENT_SUSPENDED);
+                    }
+
+                    if (CY_RSLT_SUCCESS != mqtt_restore_connection())
+                    {
+                        goto exit_cleanup;
+                    }
                     break;
                 }
 
@@ -319,77 +342,65 @@ void mqtt_client_task(void *pvParameters)
         vTaskDelete(publisher_task_handle);
     }
     cleanup();
+
+    /* Nothing reads the queue any more, mqtt_client_suspend() and
+     * mqtt_client_resume() do nothing from now on. The session is closed.
+     */
+    mqtt_task_q = NULL;
+    if (mqtt_client_events != NULL)
+    {
+        (void)xEventGroupSetBits(mqtt_client_events, MQTT_CLIENT_SUSPENDED);
+    }
     printf("\nCleanup Done\nTerminating the MQTT task...\n\n");
     vTaskDelete(NULL);
 }
 
 /******************************************************************************
- * Function Name: wifi_connect
+ * Function Name: mqtt_restore_connection
  ******************************************************************************
  * Summary:
- *  Function that initiates connection to the Wi-Fi Access Point using the 
- *  specified SSID and PASSWORD. The connection is retried a maximum of 
- *  'MAX_WIFI_CONN_RETRIES' times with interval of 'WIFI_CONN_RETRY_INTERVAL_MS'
- *  milliseconds.
+ *  Function that connects to the MQTT broker again after the connection was
+ *  lost or suspended, waiting for the Wi-Fi service first if needed. The
+ *  subscriber and publisher tasks are then told to subscribe and to
+ *  initialize the publisher again.
  *
  * Parameters:
  *  void
  *
  * Return:
- *  cy_rslt_t : CY_RSLT_SUCCESS upon a successful Wi-Fi connection, else an 
- *              error code indicating the failure.
+ *  cy_rslt_t : CY_RSLT_SUCCESS upon a successful reconnection, else an error
+ *              code indicating the failure.
  *
  ******************************************************************************/
-static cy_rslt_t wifi_connect(void)
+static cy_rslt_t mqtt_restore_connection(void)
 {
-    cy_rslt_t result = CY_RSLT_SUCCESS;
-    cy_wcm_connect_params_t connect_param;
-    cy_wcm_ip_address_t ip_address;
+    subscriber_data_t subscriber_q_data;
+    publisher_data_t publisher_q_data;
+    cy_rslt_t result;
 
-    /* Check if Wi-Fi connection is already established. */
-    if (cy_wcm_is_connected_to_ap() == 0)
+    /* Wait for the Wi-Fi service to reconnect if the link is down. */
+    result = wifi_service_connect(portMAX_DELAY);
+    if (CY_RSLT_SUCCESS != result)
     {
-        /* Configure the connection parameters for the Wi-Fi interface. */
-        memset(&connect_param, 0, sizeof(cy_wcm_connect_params_t));
-        memcpy(connect_param.ap_credentials.SSID, WIFI_SSID, sizeof(WIFI_SSID));
-        memcpy(connect_param.ap_credentials.password, WIFI_PASSWORD, sizeof(WIFI_PASSWORD));
-        connect_param.ap_credentials.security = WIFI_SECURITY;
-
-        printf("\nWi-Fi Connecting to '%s'\n", connect_param.ap_credentials.SSID);
-
-        /* Connect to the Wi-Fi AP. */
-        for (uint32_t retry_count = 0; retry_count < MAX_WIFI_CONN_RETRIES; retry_count++)
-        {
-            result = cy_wcm_connect_ap(&connect_param, &ip_address);
+        printf("\nWi-Fi reconnection failed!\n");
+        return result;
+    }
 
-            if (result == CY_RSLT_SUCCESS)
-            {
-                printf("\nSuccessfully connected to Wi-Fi network '%s'.\n", connect_param.ap_credentials.SSID);
+    printf("\nInitiating MQTT Reconnection...\n");
+    result = mqtt_connect();
+    if (CY_RSLT_SUCCESS != result)
+    {
+        return result;
+    }
 
-                /* Set the appropriate bit in the status_flag to denote 
-                 * successful Wi-Fi connection, print the assigned IP address.
-                 */
-                status_flag |= WIFI_CONNECTED;
-                if (ip_address.version == CY_WCM_IP_VER_V4)
-                {
-                    printf("IPv4 Address Assigned: %s\n\n", ip4addr_ntoa((const ip4_addr_t *) &ip_address.ip.v4));
-                }
-                else if (ip_address.version == CY_WCM_IP_VER_V6)
-                {
-                    printf("IPv6 Address Assigned: %s\n\n", ip6addr_ntoa((const ip6_addr_t *) &ip_address.ip.v6));
-                }
-                return result;
-            }
+    /* Initiate MQTT subscribe post the reconnection. */
+    subscriber_q_data.cmd = SUBSCRIBE_TO_TOPIC;
+    xQueueSend(subscriber_task_q, &subscriber_q_data, portMAX_DELAY);
 
-            printf("Wi-Fi Connection failed. Error code:0x%0X. Retrying in %d ms. Retries left: %d\n",
-                (int)result, WIFI_CONN_RETRY_INTERVAL_MS, (int)(MAX_WIFI_CONN_RETRIES - retry_count - 1));
-            vTaskDelay(pdMS_TO_TICKS(WIFI_CONN_RETRY_INTERVAL_MS));
-        }
+    /* Initialize Publisher post the reconnection. */
+    publisher_q_data.cmd = PUBLISHER_INIT;
+    xQueueSend(publisher_task_q, &publisher_q_data, portMAX_DELAY);
 
-        printf("\nExceeded maximum Wi-Fi connection attempts!\n");
-        printf("Wi-Fi connection failed after retrying for %d mins\n\n", 
-            (int)(WIFI_CONN_RETRY_INTERVAL_MS * MAX_WIFI_CONN_RETRIES) / 60000u);
-    }
     return result;
 }
 
@@ -497,13 +508,12 @@ static cy_rslt_t mqtt_connect(void)
 
     for (uint32_t retry_count = 0; retry_count < MAX_MQTT_CONN_RETRIES; retry_count++)
     {
-        if (cy_wcm_is_connected_to_ap() == 0)
+        if ((xEventGroupGetBits(wifi_service_events) & WIFI_SERVICE_CONNECTED) == 0u)
         {
-            printf("\nUnexpectedly disconnected from Wi-Fi network! \nInitiating Wi-Fi reconnection...\n");
-            status_flag &= ~(WIFI_CONNECTED);
+            printf("\nUnexpectedly disconnected from Wi-Fi network! \nWaiting for Wi-Fi reconnection...\n");
 
-            /* Initiate Wi-Fi reconnection. */
-            result = wifi_connect();
+            /* Wait for the Wi-Fi service to reconnect. */
+            result = wifi_service_connect(portMAX_DELAY);
             if (CY_RSLT_SUCCESS != result)
             {
                 return result;
@@ -535,6 +545,102 @@ static cy_rslt_t mqtt_connect(void)
     return result;
 }
 
+/******************************************************************************
+ * Function Name: mqtt_client_suspend
+ ******************************************************************************
+ * Summary:
+ *  Asks the MQTT client task to close its connection to the MQTT broker until
+ *  mqtt_client_resume() is called, so only the session of the OTA agent holds
+ *  TLS resources and keep-alive traffic during a download. Does nothing
+ *  before the MQTT client task is started, after it has exited, or if
+ *  SUSPEND_MQTT_DURING_OTA is 0. Does not wait if the queue of the task is
+ *  full.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void mqtt_client_suspend(void)
+{
+#if SUSPEND_MQTT_DURING_OTA
+    mqtt_task_cmd_t mqtt_task_cmd = HANDLE_CONNECTION_SUSPEND;
+    QueueHandle_t queue = mqtt_task_q;
+
+    /* Called from the OTA agent, which must not wait on a task that has exited */
+    if ((queue != NULL) && (pdTRUE != xQueueSend(queue, &mqtt_task_cmd, 0)))
+    {
+        printf("\nMQTT client task is not taking commands, suspend ignored.\n");
+    }
+#endif
+}
+
+/******************************************************************************
+ * Function Name: mqtt_client_wait_suspended
+ ******************************************************************************
+ * Summary:
+ *  Waits until the MQTT client task has closed its connection after
+ *  mqtt_client_suspend(), so the TLS resources of the session are freed.
+ *  mqtt_client_suspend() only queues the command to the task.
+ *
+ * Parameters:
+ *  TickType_t timeout : Longest time to wait
+ *
+ * Return:
+ *  bool : true if the connection is closed, false on timeout or if
+ *         SUSPEND_MQTT_DURING_OTA is 0
+ *
+ ******************************************************************************/
+bool mqtt_client_wait_suspended(TickType_t timeout)
+{
+#if SUSPEND_MQTT_DURING_OTA
+    EventGroupHandle_t events = mqtt_client_events;
+
+    if (events == NULL)
+    {
+        return false;
+    }
+
+    return (xEventGroupWaitBits(events, MQTT_CLIENT_SUSPENDED, pdFALSE, pdTRUE, timeout) &
+            MQTT_CLIENT_SUSPENDED) != 0u;
+#else
+    (void)timeout;
+    return false;
+#endif
+}
+
+/******************************************************************************
+ * Function Name: mqtt_client_resume
+ ******************************************************************************
+ * Summary:
+ *  Asks the MQTT client task to connect to the MQTT broker again after
+ *  mqtt_client_suspend(). Does nothing if the connection is not suspended
+ *  or the MQTT client task has exited. Does not wait if the queue of the
+ *  task is full.
+ *
+ * Parameters:
+ *  void
+ *
+ * Return:
+ *  void
+ *
+ ******************************************************************************/
+void mqtt_client_resume(void)
+{
+#if SUSPEND_MQTT_DURING_OTA
+    mqtt_task_cmd_t mqtt_task_cmd = HANDLE_CONNECTION_RESUME;
+    QueueHandle_t queue = mqtt_task_q;
+
+    /* Called from the OTA agent, which must not wait on a task that has exited */
+    if ((queue != NULL) && (pdTRUE != xQueueSend(queue, &mqtt_task_cmd, 0)))
+    {
+        printf("\nMQTT client task is not taking commands, resume ignored.\n");
+    }
+#endif
+}
+
 /******************************************************************************
  * Function Name: mqtt_event_callback
  ******************************************************************************
@@ -706,34 +812,6 @@ static void cleanup(void)
             printf("MQTT deinit API failed unexpectedly.\n");
         }
     }
-    /* Disconnect from Wi-Fi AP. */
-    if (status_flag & WIFI_CONNECTED)
-    {
-        status = cy_wcm_disconnect_ap();
-
-        if (status == CY_RSLT_SUCCESS)
-        {
-            printf("Disconnected from the Wi-Fi AP!\n");
-        }
-        else
-        {
-            printf("WCM disconnect AP failed unexpectedly.\n");
-        }
-    }
-    /* De-initialize the Wi-Fi Connection Manager. */
-    if (status_flag & WCM_INITIALIZED)
-    {
-        status = cy_wcm_deinit();
-
-        if (status == CY_RSLT_SUCCESS)
-        {
-            printf("Deinitialized Wifi connection...\n");
-        }
-        else
-        {
-            printf("WCM deinit API failed unexpectedly.\n");
-        }
-    }
 }
 
 /* [] END OF FILE */
@@ -44,6 +44,7 @@
 
 #include "FreeRTOS.h"
 #include "queue.h"
+#include "event_groups.h"
 #include "cy_mqtt_api.h"
 
 
@@ -54,6 +55,9 @@
 #define MQTT_CLIENT_TASK_PRIORITY       (2)
 #define MQTT_CLIENT_TASK_STACK_SIZE     (1024 * 2)
 
+/* Bits of mqtt_client_events */
+#define MQTT_CLIENT_SUSPENDED           (1lu << 0)  /* The session is closed, or the task has exited */
+
 /*******************************************************************************
 * Global Variables
 ********************************************************************************/
@@ -62,7 +66,9 @@ typedef enum
 {
     HANDLE_MQTT_SUBSCRIBE_FAILURE,
     HANDLE_MQTT_PUBLISH_FAILURE,
-    HANDLE_DISCONNECTION
+    HANDLE_DISCONNECTION,
+    HANDLE_CONNECTION_SUSPEND,
+    HANDLE_CONNECTION_RESUME
 } mqtt_task_cmd_t;
 
 /*******************************************************************************
@@ -70,11 +76,15 @@ typedef enum
  ******************************************************************************/
 extern cy_mqtt_t mqtt_connection;
 extern QueueHandle_t mqtt_task_q;
+extern EventGroupHandle_t mqtt_client_events;
 
 /*******************************************************************************
 * Function Prototypes
 ********************************************************************************/
 void mqtt_client_task(void *pvParameters);
+void mqtt_client_suspend(void);
+bool mqtt_client_wait_suspended(TickType_t timeout);
+void mqtt_client_resume(void);
 
 #endif /* MQTT_TASK_H_ */
 
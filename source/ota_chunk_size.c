@@ -0,0 +1,238 @@
+/******************************************************************************
+* File Name:   ota_chunk_size.c
+*
+* Description: This file contains the selection of the OTA chunk size the
+*              device asks the publisher for, from the free heap, the signal
+*              strength and the goodput of the previous downloads.
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "cyhal.h"
+#include "cybsp.h"
+#include "cy_wcm.h"
+
+/* FreeRTOS header files */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "ota_chunk_size.h"
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Chunk size to ask for, adapted after each download. 0 until the first one */
+static uint32_t chunk_size_current;
+
+/* Chunk size asked for by the download in progress, 0 if none */
+static uint32_t chunk_size_used;
+
+/* Best goodput so far, in bytes per second, and the chunk size it was seen with */
+static uint32_t goodput_best;
+static uint32_t chunk_size_best;
+
+/* Download in progress */
+static bool download_in_progress;
+static TickType_t download_start;
+static uint32_t download_bytes;
+
+/*******************************************************************************
+ * Function Name: ota_chunk_size_select
+ *******************************************************************************
+ * Summary:
+ *  Returns the chunk size to ask for: the size adapted to the previous
+ *  downloads, halved while it takes more than 1/OTA_CHUNK_HEAP_DIVISOR of
+ *  the free heap or while the signal is weak.
+ *
+ * Return:
+ *  uint32_t : Chunk size in bytes, a power of 2 between OTA_CHUNK_SIZE_MIN
+ *             and OTA_CHUNK_SIZE_MAX
+ *
+ *******************************************************************************/
+uint32_t ota_chunk_size_select(void)
+{
+    cy_wcm_associated_ap_info_t ap_info;
+    uint32_t heap_limit = (uint32_t)xPortGetFreeHeapSize() / OTA_CHUNK_HEAP_DIVISOR;
+    uint32_t size;
+
+    if (chunk_size_current == 0u)
+    {
+        chunk_size_current = OTA_CHUNK_SIZE_MAX;
+    }
+    size = chunk_size_current;
+
+    memset(&ap_info, 0x00, sizeof(ap_info));
+    if ((CY_RSLT_SUCCESS == cy_wcm_get_associated_ap_info(&ap_info)) &&
+        (ap_info.signal_strength < OTA_CHUNK_WEAK_RSSI_DBM) && (size >= OTA_CHUNK_SIZE_MAX))
+    {
+        size = OTA_CHUNK_SIZE_MAX / 2u;
+    }
+
+    while ((size > OTA_CHUNK_SIZE_MIN) && (size > heap_limit))
+    {
+        size /= 2u;
+    }
+
+    return (size < OTA_CHUNK_SIZE_MIN) ? OTA_CHUNK_SIZE_MIN : size;
+}
+
+/*******************************************************************************
+ * Function Name: ota_chunk_size_advertise
+ *******************************************************************************
+ * Summary:
+ *  Writes the chunk size to ask for over the placeholder of the request
+ *  document, which keeps its length. Called from the OTA callback before
+ *  the OTA agent sends the document.
+ *
+ * Parameters:
+ *  char *json_doc : Request document of the OTA agent
+ *
+ * Return:
+ *  bool : true if the document has the chunk size field
+ *
+ *******************************************************************************/
+bool ota_chunk_size_advertise(char *json_doc)
+{
+    char digits[OTA_CHUNK_SIZE_DIGITS + 1u];
+    char *value;
+    uint32_t i;
+
+    value = (json_doc != NULL) ? strstr(json_doc, OTA_CHUNK_SIZE_FIELD) : NULL;
+    if (value == NULL)
+    {
+        return false;
+    }
+    value += sizeof(OTA_CHUNK_SIZE_FIELD) - 1u;
+
+    for (i = 0; i < OTA_CHUNK_SIZE_DIGITS; i++)
+    {
+        if (!isdigit((unsigned char)value[i]))
+        {
+            return false;
+        }
+    }
+
+    chunk_size_used = ota_chunk_size_select();
+    snprintf(digits, sizeof(digits), "%05lu", (unsigned long)chunk_size_used);
+    memcpy(value, digits, OTA_CHUNK_SIZE_DIGITS);
+    printf("Asking for %lu-byte chunks\n", (unsigned long)chunk_size_used);
+
+    return true;
+}
+
+/*******************************************************************************
+ * Function Name: ota_chunk_size_start
+ *******************************************************************************
+ * Summary:
+ *  Starts measuring the goodput of a download.
+ *
+ *******************************************************************************/
+void ota_chunk_size_start(void)
+{
+    download_in_progress = true;
+    download_start = xTaskGetTickCount();
+    download_bytes = 0;
+}
+
+/*******************************************************************************
+ * Function Name: ota_chunk_size_received
+ *******************************************************************************
+ * Summary:
+ *  Counts the bytes of a chunk received.
+ *
+ *******************************************************************************/
+void ota_chunk_size_received(uint32_t len)
+{
+    download_bytes += len;
+}
+
+/*******************************************************************************
+ * Function Name: ota_chunk_size_done
+ *******************************************************************************
+ * Summary:
+ *  Adapts the chunk size to the result of the download. After a failure,
+ *  e.g. a chunk that did not arrive in time, the next attempt asks for half
+ *  the size. After a success the size is doubled as long as the goodput
+ *  grows, and goes back to the size of the best goodput once it drops.
+ *
+ * Parameters:
+ *  bool success : true if the image was received and verified
+ *
+ *******************************************************************************/
+void ota_chunk_size_done(bool success)
+{
+    uint32_t used = chunk_size_used;
+    uint32_t elapsed_ms;
+    uint32_t goodput;
+
+    /* The next attempt sends a new request */
+    chunk_size_used = 0;
+    if (!download_in_progress || (used == 0u))
+    {
+        download_in_progress = false;
+        return;
+    }
+    download_in_progress = false;
+
+    if (!success)
+    {
+        chunk_size_current = (used > OTA_CHUNK_SIZE_MIN) ? (used / 2u) : OTA_CHUNK_SIZE_MIN;
+        printf("Download failed, asking for %lu-byte chunks next\n", (unsigned long)chunk_size_current);
+        return;
+    }
+
+    elapsed_ms = (uint32_t)((xTaskGetTickCount() - download_start) * portTICK_PERIOD_MS);
+    goodput = (uint32_t)(((uint64_t)download_bytes * 1000u) / ((elapsed_ms > 0u) ? elapsed_ms : 1u));
+
+    if (goodput >= goodput_best)
+    {
+        goodput_best = goodput;
+        chunk_size_best = used;
+        chunk_size_current = (used < OTA_CHUNK_SIZE_MAX) ? (used * 2u) : OTA_CHUNK_SIZE_MAX;
+    }
+    else if (((uint64_t)goodput * 100u) < ((uint64_t)goodput_best * OTA_CHUNK_GOODPUT_MARGIN_PCT))
+    {
+        chunk_size_current = chunk_size_best;
+    }
+
+    printf("Goodput %lu bytes/s with %lu-byte chunks, asking for %lu-byte chunks next\n",
+           (unsigned long)goodput, (unsigned long)used, (unsigned long)chunk_size_current);
+}
+
+/* [] END OF FILE */
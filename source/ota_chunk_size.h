@@ -0,0 +1,100 @@
+/******************************************************************************
+* File Name:   ota_chunk_size.h
+*
+* Description: This file is the public interface of ota_chunk_size.c
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef OTA_CHUNK_SIZE_H_
+#define OTA_CHUNK_SIZE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_result.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Bounds of the chunk size the device asks the publisher for. A chunk and its
+ * 32-byte header must fit in the receive buffer of the OTA agent, raise
+ * OTA_CHUNK_SIZE_MAX only together with it.
+ */
+#ifndef OTA_CHUNK_SIZE_MIN
+#define OTA_CHUNK_SIZE_MIN                  (1024u)
+#endif
+#ifndef OTA_CHUNK_SIZE_MAX
+#define OTA_CHUNK_SIZE_MAX                  (4096u)
+#endif
+
+/* Largest part of the free heap a chunk may take, as a divisor */
+#ifndef OTA_CHUNK_HEAP_DIVISOR
+#define OTA_CHUNK_HEAP_DIVISOR              (8u)
+#endif
+
+/* Below this signal strength the chunk size starts at half the maximum, a
+ * chunk lost on a weak link takes less time to send again.
+ */
+#ifndef OTA_CHUNK_WEAK_RSSI_DBM
+#define OTA_CHUNK_WEAK_RSSI_DBM             (-75)
+#endif
+
+/* Goodput, in percent of the best one, below which a larger chunk size is
+ * given up for the size that gave the best one.
+ */
+#ifndef OTA_CHUNK_GOODPUT_MARGIN_PCT
+#define OTA_CHUNK_GOODPUT_MARGIN_PCT        (90u)
+#endif
+
+/* Field of the "Request Update" message with the chunk size. The value in
+ * CY_OTA_DOWNLOAD_REQUEST is a placeholder of OTA_CHUNK_SIZE_DIGITS digits,
+ * overwritten in place by ota_chunk_size_advertise().
+ */
+#define OTA_CHUNK_SIZE_FIELD                "\"MaxChunkSize\": \""
+#define OTA_CHUNK_SIZE_DIGITS               (5u)
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+uint32_t ota_chunk_size_select(void);
+bool ota_chunk_size_advertise(char *json_doc);
+void ota_chunk_size_start(void);
+void ota_chunk_size_received(uint32_t len);
+void ota_chunk_size_done(bool success);
+
+#endif /* OTA_CHUNK_SIZE_H_ */
+
+/* [] END OF FILE */
@@ -37,11 +37,10 @@
 *******************************************************************************/
 
 /* Header file includes */
+#include <string.h>
 #include "cyhal.h"
 #include "cybsp.h"
 #include "cy_retarget_io.h"
-/* Wi-Fi connection manager */
-#include "cy_wcm.h"
 /* IoT SDK, Secure Sockets, and MQTT initialization */
 #include "cy_tcpip_port_secure_sockets.h"
 /* FreeRTOS */
@@ -53,26 +52,48 @@
 #include "cy_ota_api.h"
 /* OTA storage api */
 #include "cy_ota_storage_api.h"
+/* OTA flash write statistics */
+#include "cy_ota_flash_ext.h"
 /* MQTT client task */
 #include "mqtt_task.h"
+#include "mqtt_client_config.h"
+#include "pre_erase_task.h"
+#include "image_digest.h"
+#include "flash_service.h"
+#include "wear_table.h"
+#include "download_resume.h"
+#include "ota_chunk_size.h"
+#include "wifi_service.h"
+
+/* MCUboot image trailer API */
+#include "bootutil/bootutil.h"
 
 /*******************************************************************************
 * Macros
 ********************************************************************************/
-/* MAX connection retries to join WI-FI AP */
-#define MAX_CONNECTION_RETRIES              (10)
-
-/* Wait between connection retries */
-#define WIFI_CONN_RETRY_DELAY_MS            (500)
-
 /* Application ID */
 #define APP_ID                              (0)
 
+/* Bytes of the upgrade slot read at startup to compare memory-mapped and
+ * command mode reads of the external flash, 0 disables the benchmark.
+ */
+#ifndef OTA_READ_BENCHMARK_SIZE
+#define OTA_READ_BENCHMARK_SIZE             (0)
+#endif
+
 /*******************************************************************************
 * Forward declaration
 ********************************************************************************/
-cy_rslt_t connect_to_wifi_ap(void);
 cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data);
+static cy_rslt_t app_storage_open(cy_ota_storage_context_t *storage_ptr);
+static cy_rslt_t app_storage_read(cy_ota_storage_context_t *storage_ptr, cy_ota_storage_read_info_t *chunk_info);
+static cy_rslt_t app_storage_write(cy_ota_storage_context_t *storage_ptr, cy_ota_storage_write_info_t *chunk_info);
+static cy_rslt_t app_storage_close(cy_ota_storage_context_t *storage_ptr);
+static cy_rslt_t app_storage_verify(cy_ota_storage_context_t *storage_ptr);
+static cy_rslt_t app_storage_image_validate(uint16_t app_id);
+static void print_flash_write_stats(void);
+static void print_read_benchmark(void);
+static void print_wear_table(void);
 void print_heap_usage(char *msg);
 
 /*******************************************************************************
@@ -81,6 +102,9 @@ void print_heap_usage(char *msg);
 /* OTA context */
 cy_ota_context_ptr ota_context;
 
+/* Tick count at which the OTA storage was opened, used for the download throughput */
+static TickType_t download_start_tick;
+
 /* Network parameters for OTA */
 cy_ota_network_params_t ota_network_params =
 {
@@ -125,12 +149,12 @@ cy_ota_agent_params_t ota_agent_params =
 /* OTA storage interface callbacks */
 cy_ota_storage_interface_t ota_interfaces =
 {
-   .ota_file_open            = cy_ota_storage_open,
-   .ota_file_read            = cy_ota_storage_read,
-   .ota_file_write           = cy_ota_storage_write,
-   .ota_file_close           = cy_ota_storage_close,
-   .ota_file_verify          = cy_ota_storage_verify,
-   .ota_file_validate        = cy_ota_storage_image_validate,
+   .ota_file_open            = app_storage_open,
+   .ota_file_read            = app_storage_read,
+   .ota_file_write           = app_storage_write,
+   .ota_file_close           = app_storage_close,
+   .ota_file_verify          = app_storage_verify,
+   .ota_file_validate        = app_storage_image_validate,
    .ota_file_get_app_info    = cy_ota_storage_get_app_info
 };
 
@@ -153,6 +177,13 @@ void ota_task(void *args)
     /* default for OTA logging to NOTICE */
     cy_ota_set_log_level(CY_LOG_NOTICE);
 
+    /* Associate to the Wi-Fi AP while the storage is initialized */
+    if (CY_RSLT_SUCCESS != wifi_service_start())
+    {
+        printf("\n Starting the Wi-Fi service failed.\n");
+        CY_ASSERT(0);
+    }
+
     /* initialize OTA storage */
     if (CY_RSLT_SUCCESS != cy_ota_storage_init())
     {
@@ -160,19 +191,42 @@ void ota_task(void *args)
         CY_ASSERT(0);
     }
 
+    print_read_benchmark();
+
+    /* Count the erases of each flash sector from here on */
+    if (CY_RSLT_SUCCESS == wear_table_init())
+    {
+        print_wear_table();
+    }
+
+    /* Keep the part of the slot written by an interrupted download */
+    (void)download_resume_init();
+
+    /* Program the downloaded chunks in the background */
+    if (CY_RSLT_SUCCESS != flash_service_start())
+    {
+        printf("\n Flash operations run in the OTA agent task.\n");
+    }
+
 #ifndef TEST_REVERT
     /* Validate the update so we do not revert */
-    if(CY_RSLT_SUCCESS != cy_ota_storage_image_validate(APP_ID))
+    if(CY_RSLT_SUCCESS != app_storage_image_validate(APP_ID))
     {
         printf("\n Failed to validate the update.\n");
         CY_ASSERT(0);
     }
+
+    /* The secondary slot is no longer needed for a revert, erase it while idle */
+    if (!download_resume_pending())
+    {
+        pre_erase_task_start();
+    }
 #endif
 
-    /* Connect to Wi-Fi AP */
-    if(CY_RSLT_SUCCESS != connect_to_wifi_ap())
+    /* The sockets only need the network stack, not the association */
+    if (CY_RSLT_SUCCESS != wifi_service_wait_ready(portMAX_DELAY))
     {
-        printf("\n Failed to connect to Wi-FI AP.\n");
+        printf("\n Initializing Wi-Fi failed.\n");
         CY_ASSERT(0);
     }
 
@@ -190,6 +244,13 @@ void ota_task(void *args)
         CY_ASSERT(0);
     }
 
+    /* Connect to Wi-Fi AP */
+    if (CY_RSLT_SUCCESS != wifi_service_connect(portMAX_DELAY))
+    {
+        printf("\n Failed to connect to Wi-FI AP.\n");
+        CY_ASSERT(0);
+    }
+
     /* Initialize and start the OTA agent */
     if(CY_RSLT_SUCCESS != cy_ota_agent_start(&ota_network_params, &ota_agent_params, &ota_interfaces, &ota_context))
     {
@@ -206,64 +267,6 @@ void ota_task(void *args)
     vTaskSuspend( NULL );
  }
 
-/*******************************************************************************
- * Function Name: connect_to_wifi_ap()
- *******************************************************************************
- * Summary:
- *  Connects to Wi-Fi AP using the user-configured credentials, retries up to a
- *  configured number of times until the connection succeeds.
- *
- *******************************************************************************/
-cy_rslt_t connect_to_wifi_ap(void)
-{
-    cy_wcm_config_t wifi_config = { .interface = CY_WCM_INTERFACE_TYPE_STA};
-    cy_wcm_connect_params_t wifi_conn_param;
-    cy_wcm_ip_address_t ip_address;
-    cy_rslt_t result = CY_RSLT_TYPE_ERROR;
-
-    /* Variable to track the number of connection retries to the Wi-Fi AP specified
-     * by WIFI_SSID macro. */
-    uint32_t conn_retries = 0;
-
-    /* Initialize Wi-Fi connection manager. */
-    result = cy_wcm_init(&wifi_config);
-
-    if (CY_RSLT_SUCCESS != result)
-    {
-        printf("\n Initializing WCM failed.\n");
-        CY_ASSERT(0);
-    }
-
-    printf("\n Successfully initialized WCM.\n");
-
-     /* Set the Wi-Fi SSID, password and security type. */
-    memset(&wifi_conn_param, 0, sizeof(cy_wcm_connect_params_t));
-    memcpy(wifi_conn_param.ap_credentials.SSID, WIFI_SSID, sizeof(WIFI_SSID));
-    memcpy(wifi_conn_param.ap_credentials.password, WIFI_PASSWORD, sizeof(WIFI_PASSWORD));
-    wifi_conn_param.ap_credentials.security = WIFI_SECURITY;
-
-    /* Connect to the Wi-Fi AP */
-    for(conn_retries = 0; conn_retries < MAX_CONNECTION_RETRIES; conn_retries++)
-    {
-        result = cy_wcm_connect_ap( &wifi_conn_param, &ip_address );
-
-        if (CY_RSLT_SUCCESS == result)
-        {
-            printf( "Successfully connected to Wi-Fi network '%s'.\n",
-                    wifi_conn_param.ap_credentials.SSID);
-            return result;
-        }
-
-        printf( "Connection to Wi-Fi network failed with error code %d."
-                "Retrying in %d ms...\n", (int) result, WIFI_CONN_RETRY_DELAY_MS );
-        vTaskDelay(pdMS_TO_TICKS(WIFI_CONN_RETRY_DELAY_MS));
-    }
-
-    printf( "Exceeded maximum Wi-Fi connection attempts\n" );
-
-    return result;
-}
-
 /*******************************************************************************
  * Function Name: ota_callback()
  *******************************************************************************
@@ -310,16 +313,23 @@ cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data)
         case CY_OTA_REASON_FAILURE:
             printf(">> APP CB OTA FAILURE state:%d %s last_error:%s\n\n",
                     cb_data->ota_agt_state, state_string, error_string);
+
+            /* The next attempt asks for smaller chunks */
+            ota_chunk_size_done(false);
             break;
 
         case CY_OTA_REASON_STATE_CHANGE:
             switch (cb_data->ota_agt_state)
             {
                 case CY_OTA_STATE_NOT_INITIALIZED:
-                case CY_OTA_STATE_EXITING:
                 case CY_OTA_STATE_INITIALIZING:
                 case CY_OTA_STATE_AGENT_STARTED:
+                    break;
+
+                case CY_OTA_STATE_EXITING:
                 case CY_OTA_STATE_AGENT_WAITING:
+                    /* The download is over, the application connects again */
+                    mqtt_client_resume();
                     break;
 
                 case CY_OTA_STATE_START_UPDATE:
@@ -372,6 +382,8 @@ cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data)
                     break;
 
                 case CY_OTA_STATE_DATA_CONNECT:
+                    /* Leave the broker to the session of the download */
+                    mqtt_client_suspend();
                     printf("APP CB OTA CONNECT FOR DATA using ");
                     printf("MQTT: %s:%d \n", cb_data->broker_server.host_name,
                             cb_data->broker_server.port);
@@ -382,6 +394,14 @@ cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data)
                     /* NOTE:
                      *  MQTT - json_doc holds the MQTT JSON request doc
                      */
+#if SUSPEND_MQTT_DURING_OTA
+                    /* The chunk size depends on the free heap, wait for the TLS session of the application to be freed */
+                    if (!mqtt_client_wait_suspended(pdMS_TO_TICKS(MQTT_SUSPEND_WAIT_MS)))
+                    {
+                        printf("MQTT connection of the application still open, ");
+                    }
+#endif
+                    (void)ota_chunk_size_advertise(cb_data->json_doc);
                     printf("MQTT: '%.*s' \n", strlen(cb_data->json_doc),
                             cb_data->json_doc);
                     printf("topic: '%s'\n\n", cb_data->unique_topic);
@@ -424,6 +444,10 @@ cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data)
 
                 case CY_OTA_STATE_STORAGE_OPEN:
                     printf("APP CB OTA STORAGE OPEN\n");
+                    cy_ota_mem_reset_write_stats();
+                    flash_service_reset_stats();
+                    download_start_tick = xTaskGetTickCount();
+                    ota_chunk_size_start();
                     break;
 
                 case CY_OTA_STATE_STORAGE_WRITE:
@@ -438,6 +462,7 @@ cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data)
 
                 case CY_OTA_STATE_STORAGE_CLOSE:
                     printf("APP CB OTA STORAGE CLOSE\n");
+                    print_flash_write_stats();
                     break;
 
                 case CY_OTA_STATE_VERIFY:
@@ -456,3 +481,420 @@ cy_ota_callback_results_t ota_callback(cy_ota_cb_struct_t *cb_data)
 
     return cb_result;
 }
+
+/*******************************************************************************
+ * Function Name: app_storage_open()
+ *******************************************************************************
+ * Summary:
+ *  Stops the background erase of the secondary slot before the OTA agent
+ *  opens the storage. The part of the slot already erased is not erased
+ *  again, the rest is erased on demand just ahead of the writes, except the
+ *  sectors written by an interrupted download. Starts the digest of the new
+ *  image.
+ *
+ * Parameters:
+ *  cy_ota_storage_context_t *storage_ptr : Pointer to the OTA storage context
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+static cy_rslt_t app_storage_open(cy_ota_storage_context_t *storage_ptr)
+{
+    cy_rslt_t result;
+
+    pre_erase_task_stop();
+
+    /* Erase the slot sector by sector as the image is written instead of all at once */
+    cy_ota_mem_set_erase_on_demand(true);
+
+    image_digest_start();
+
+    result = cy_ota_storage_open(storage_ptr);
+
+    if (CY_RSLT_SUCCESS == result)
+    {
+        result = download_resume_open();
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: app_storage_read()
+ *******************************************************************************
+ * Summary:
+ *  Reads the OTA storage once the chunks queued to the flash service are
+ *  programmed.
+ *
+ * Parameters:
+ *  cy_ota_storage_context_t *storage_ptr : Pointer to the OTA storage context
+ *  cy_ota_storage_read_info_t *chunk_info : Chunk to read
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+static cy_rslt_t app_storage_read(cy_ota_storage_context_t *storage_ptr, cy_ota_storage_read_info_t *chunk_info)
+{
+    cy_rslt_t result = flash_service_sync();
+
+    if (CY_RSLT_SUCCESS != result)
+    {
+        return result;
+    }
+
+    return cy_ota_storage_read(storage_ptr, chunk_info);
+}
+
+/*******************************************************************************
+ * Function Name: app_storage_write_job()
+ *******************************************************************************
+ * Summary:
+ *  Writes a chunk of the image from the flash service task. Chunks queued
+ *  back to back are merged, the request holds all of their data.
+ *
+ * Parameters:
+ *  flash_service_request_t *request : Request with the chunk offset and data
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+static cy_rslt_t app_storage_write_job(flash_service_request_t *request)
+{
+    cy_ota_storage_write_info_t chunk_info;
+
+    memset(&chunk_info, 0x00, sizeof(chunk_info));
+    chunk_info.total_size = request->param;
+    chunk_info.offset     = request->addr;
+    chunk_info.buffer     = request->data;
+    chunk_info.size       = request->len;
+
+    return cy_ota_storage_write((cy_ota_storage_context_t *)request->arg, &chunk_info);
+}
+
+/*******************************************************************************
+ * Function Name: app_storage_write()
+ *******************************************************************************
+ * Summary:
+ *  Queues a chunk of the image to the flash service and adds it to the image
+ *  digest, so the image can be verified without reading the upgrade slot
+ *  back. The next chunk is received while this one is programmed, an error
+ *  programming it is returned on closing or verifying the storage. The parts
+ *  of a chunk written by an interrupted download are not written again, the
+ *  digest restored with the download progress covers them.
+ *
+ * Parameters:
+ *  cy_ota_storage_context_t *storage_ptr  : Pointer to the OTA storage context
+ *  cy_ota_storage_write_info_t *chunk_info : Chunk to write
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+static cy_rslt_t app_storage_write(cy_ota_storage_context_t *storage_ptr, cy_ota_storage_write_info_t *chunk_info)
+{
+    flash_service_request_t request =
+    {
+        .op       = FLASH_SERVICE_OP_JOB,
+        .priority = FLASH_SERVICE_PRIORITY_NORMAL,
+        .addr     = chunk_info->offset,
+        .data     = chunk_info->buffer,
+        .len      = chunk_info->size,
+        .job      = app_storage_write_job,
+        .arg      = storage_ptr,
+        .param    = chunk_info->total_size,
+    };
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t write_len;
+    uint32_t skip_len = download_resume_skip(chunk_info->offset, chunk_info->buffer, chunk_info->size,
+                                             chunk_info->total_size, &write_len);
+
+    if (write_len > 0u)
+    {
+        request.addr += skip_len;
+        request.data += skip_len;
+        request.len = write_len;
+        result = flash_service_submit_buffered(&request);
+    }
+    if (CY_RSLT_SUCCESS == result)
+    {
+        /* The progress saved includes the digest of this chunk */
+        image_digest_update(chunk_info->offset, chunk_info->buffer, chunk_info->size);
+        result = download_resume_written(chunk_info->offset, chunk_info->size);
+    }
+
+    if (CY_RSLT_SUCCESS == result)
+    {
+        ota_chunk_size_received(chunk_info->size);
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: app_storage_close()
+ *******************************************************************************
+ * Summary:
+ *  Waits for the chunks queued to the flash service and programs the rows
+ *  still held in the flash write-combining buffer before closing the OTA
+ *  storage.
+ *
+ * Parameters:
+ *  cy_ota_storage_context_t *storage_ptr : Pointer to the OTA storage context
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+static cy_rslt_t app_storage_close(cy_ota_storage_context_t *storage_ptr)
+{
+    cy_rslt_t result = flash_service_sync();
+
+    if (CY_RSLT_SUCCESS != result)
+    {
+        printf("\n Failed to write the image to flash.\n");
+        return result;
+    }
+
+    return cy_ota_storage_close(storage_ptr);
+}
+
+/*******************************************************************************
+ * Function Name: app_storage_verify()
+ *******************************************************************************
+ * Summary:
+ *  Verifies the downloaded image. The SHA-256 of the data written is compared
+ *  with the digest in the image TLVs first, a corrupted image is rejected
+ *  before it is marked for the bootloader. When the digest matches only the
+ *  MCUboot pending trailer is written, as a test or permanent swap like the
+ *  library does, and the slot is not read back. Without a digest, as when the
+ *  digest of a resumed download could not be restored, the library
+ *  verification runs. The chunks queued to the flash
+ *  service are programmed first. The write-combining buffer is flushed after
+ *  the MCUboot image trailer is written. The erases
+ *  counted during the download are saved to the wear table. The progress of
+ *  the download is dropped, a failed image is downloaded again from the
+ *  beginning.
+ *
+ * Parameters:
+ *  cy_ota_storage_context_t *storage_ptr : Pointer to the OTA storage context
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+static cy_rslt_t app_storage_verify(cy_ota_storage_context_t *storage_ptr)
+{
+    cy_rslt_t result = flash_service_sync();
+    image_digest_result_t digest_result = image_digest_verify();
+
+    download_resume_finish();
+
+    if (IMAGE_DIGEST_MISMATCH == digest_result)
+    {
+        printf("\n Image digest does not match the data written.\n");
+        return CY_RSLT_TYPE_ERROR;
+    }
+    printf("Image digest %s\n", (IMAGE_DIGEST_MATCH == digest_result) ? "verified" : "not available");
+
+    if ((CY_RSLT_SUCCESS == result) && (IMAGE_DIGEST_MATCH == digest_result))
+    {
+        /* Every byte of the slot is covered by the digest, including the bytes
+         * kept from an interrupted download. The swap is permanent unless the
+         * application validates the image after the reboot.
+         */
+        if (0 != boot_set_pending((0u != storage_ptr->validate_after_reboot) ? 0 : 1))
+        {
+            printf("\n Failed to write the MCUboot image trailer.\n");
+            result = CY_RSLT_TYPE_ERROR;
+        }
+    }
+    else if (CY_RSLT_SUCCESS == result)
+    {
+        result = cy_ota_storage_verify(storage_ptr);
+    }
+
+    if (CY_RSLT_SUCCESS == result)
+    {
+        result = cy_ota_mem_flush();
+    }
+
+    /* Save the erases of the download in one batch */
+    (void)wear_table_save(CY_RSLT_SUCCESS == result);
+
+    ota_chunk_size_done(CY_RSLT_SUCCESS == result);
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: app_storage_image_validate()
+ *******************************************************************************
+ * Summary:
+ *  Marks the running image as valid and makes sure the image trailer written
+ *  for it is programmed to flash.
+ *
+ * Parameters:
+ *  uint16_t app_id : Application ID
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+static cy_rslt_t app_storage_image_validate(uint16_t app_id)
+{
+    cy_rslt_t result = cy_ota_storage_image_validate(app_id);
+
+    if (CY_RSLT_SUCCESS == result)
+    {
+        result = cy_ota_mem_flush();
+    }
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: print_flash_write_stats()
+ *******************************************************************************
+ * Summary:
+ *  Prints the flash write counters accumulated since the storage was opened.
+ *  Write amplification is printed in hundredths, 100 means every requested
+ *  byte was programmed exactly once. The download throughput includes the
+ *  time spent waiting for the flash, the flash busy times tell how much of
+ *  the download time the flash took.
+ *
+ *******************************************************************************/
+static void print_flash_write_stats(void)
+{
+    cy_ota_mem_write_stats_t stats;
+    cy_ota_mem_xip_blackout_t blackout;
+    flash_service_stats_t service;
+    cy_ota_mem_op_stats_table_t op_stats;
+    uint64_t op_us[CY_OTA_MEM_OP_COUNT] = { 0 };
+    uint32_t mem, op;
+    uint32_t elapsed_ms = (uint32_t)((xTaskGetTickCount() - download_start_tick) * portTICK_PERIOD_MS);
+
+    cy_ota_mem_get_write_stats(&stats);
+    cy_ota_mem_get_xip_blackout(&blackout);
+    flash_service_get_stats(&service);
+    cy_ota_mem_get_op_stats(&op_stats);
+
+    for (mem = 0; mem < CY_OTA_MEM_STATS_MEM_TYPES; mem++)
+    {
+        for (op = 0; op < CY_OTA_MEM_OP_COUNT; op++)
+        {
+            op_us[op] += op_stats.op[mem][op].total_us;
+        }
+    }
+
+    printf("Flash writes: %lu calls, %lu bytes requested, %lu bytes programmed\n",
+            (unsigned long)stats.total.write_calls,
+            (unsigned long)stats.total.bytes_requested,
+            (unsigned long)stats.total.bytes_programmed);
+    printf("Flash rows  : %lu programmed, %lu skipped, %lu read back\n",
+            (unsigned long)stats.total.rows_programmed,
+            (unsigned long)stats.total.rows_skipped,
+            (unsigned long)stats.total.rows_read);
+    printf("Flash pages : %lu programmed, %lu bytes read back\n",
+            (unsigned long)stats.total.pages_programmed,
+            (unsigned long)stats.total.bytes_read_back);
+    printf("Flash partial row writes combined: %lu\n",
+            (unsigned long)stats.total.partial_writes_combined);
+    printf("Flash sectors erased on demand: %lu, skipped as blank: %lu\n",
+            (unsigned long)stats.total.sectors_erased,
+            (unsigned long)stats.total.sectors_blank);
+    if (stats.total.bytes_requested != 0)
+    {
+        printf("Flash write amplification: %lu/100\n",
+                (unsigned long)(((uint64_t)stats.total.bytes_programmed * 100u) / stats.total.bytes_requested));
+    }
+    if (blackout.blackouts != 0)
+    {
+        printf("XIP blackouts: %lu in %lu flash sessions, longest %lu us, total %lu us\n",
+                (unsigned long)blackout.blackouts,
+                (unsigned long)blackout.sessions,
+                (unsigned long)blackout.max_us,
+                (unsigned long)blackout.total_us);
+    }
+    if (service.requests != 0)
+    {
+        printf("Flash service: %lu requests, %lu merged (%lu in place), %lu errors, queue depth max %lu, latency avg %lu ms max %lu ms\n",
+                (unsigned long)service.requests,
+                (unsigned long)service.merged,
+                (unsigned long)service.merged_in_place,
+                (unsigned long)service.errors,
+                (unsigned long)service.queue_depth_max,
+                (unsigned long)(service.latency_total_ms / service.requests),
+                (unsigned long)service.latency_max_ms);
+    }
+    printf("Flash busy: read %lu ms, program %lu ms, erase %lu ms, blank checks %lu ms\n",
+            (unsigned long)(op_us[CY_OTA_MEM_OP_READ] / 1000u),
+            (unsigned long)(op_us[CY_OTA_MEM_OP_PROGRAM] / 1000u),
+            (unsigned long)(op_us[CY_OTA_MEM_OP_ERASE] / 1000u),
+            (unsigned long)(op_us[CY_OTA_MEM_OP_BLANK_SKIP] / 1000u));
+    if (elapsed_ms != 0)
+    {
+        printf("Download: %lu bytes in %lu ms, %lu bytes/s\n",
+                (unsigned long)stats.total.bytes_requested,
+                (unsigned long)elapsed_ms,
+                (unsigned long)(((uint64_t)stats.total.bytes_requested * 1000u) / elapsed_ms));
+    }
+}
+
+/*******************************************************************************
+ * Function Name: print_read_benchmark()
+ *******************************************************************************
+ * Summary:
+ *  Reads the start of the upgrade slot through the memory-mapped window and
+ *  in command mode, and prints the time taken by each. Only for slots in the
+ *  external flash, and only if OTA_READ_BENCHMARK_SIZE is not 0.
+ *
+ *******************************************************************************/
+static void print_read_benchmark(void)
+{
+#if (OTA_READ_BENCHMARK_SIZE > 0)
+    cy_ota_mem_read_benchmark_t bench;
+
+    if ((OTA_UPGRADE_SLOT_MEM_TYPE == CY_OTA_MEM_TYPE_EXTERNAL_FLASH) &&
+        (CY_RSLT_SUCCESS == cy_ota_mem_read_benchmark(OTA_UPGRADE_SLOT_ADDR, OTA_READ_BENCHMARK_SIZE, &bench)))
+    {
+        printf("Flash read of %lu bytes: memory-mapped %lu us, command mode %lu us\n",
+                (unsigned long)bench.bytes,
+                (unsigned long)bench.mapped_us,
+                (unsigned long)bench.command_us);
+    }
+#endif
+}
+
+/*******************************************************************************
+ * Function Name: print_wear_table()
+ *******************************************************************************
+ * Summary:
+ *  Prints the number of flash sectors erased so far and the most erased one.
+ *
+ *******************************************************************************/
+static void print_wear_table(void)
+{
+    static wear_table_t table;
+    uint32_t i, max_index = 0;
+
+    wear_table_get(&table);
+    for (i = 1; i < table.entries; i++)
+    {
+        if (table.entry[i].erases > table.entry[max_index].erases)
+        {
+            max_index = i;
+        }
+    }
+
+    printf("Wear table: %lu updates, %lu sectors erased",
+            (unsigned long)table.updates, (unsigned long)table.entries);
+    if (table.entries != 0)
+    {
+        printf(", most erased 0x%08lx %lu times",
+                (unsigned long)table.entry[max_index].addr, (unsigned long)table.entry[max_index].erases);
+    }
+    printf("\n");
+}
@@ -0,0 +1,171 @@
+/******************************************************************************
+* File Name:   pre_erase_task.c
+*
+* Description: This file contains the task that erases the secondary slot
+*              in the background once the running image is validated, so the
+*              next OTA download does not have to wait for the erase.
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#include <stdio.h>
+#include "cyhal.h"
+#include "cybsp.h"
+
+/* FreeRTOS header files */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Task header files */
+#include "pre_erase_task.h"
+#include "wear_table.h"
+
+/* Flash API extensions */
+#include "cy_ota_flash_ext.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Time the stopping task waits between two checks of the pre-erase task */
+#define PRE_ERASE_STOP_POLL_MS              (1u)
+
+/*******************************************************************************
+* Forward declaration
+********************************************************************************/
+static void pre_erase_task(void *args);
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* FreeRTOS task handle for this task, NULL while it is not running */
+static TaskHandle_t volatile pre_erase_task_handle;
+
+/* Set to make the task exit after the sector it is erasing */
+static volatile bool pre_erase_stop_requested;
+
+/*******************************************************************************
+ * Function Name: pre_erase_task_start
+ *******************************************************************************
+ * Summary:
+ *  Starts erasing the secondary slot in the background. Must only be called
+ *  once the running image is validated, the secondary slot then holds nothing
+ *  the bootloader needs.
+ *
+ *******************************************************************************/
+void pre_erase_task_start(void)
+{
+    TaskHandle_t handle;
+
+    if ((PRE_ERASE_SLOT_SIZE == 0u) || (pre_erase_task_handle != NULL))
+    {
+        return;
+    }
+
+    pre_erase_stop_requested = false;
+    if (pdPASS == xTaskCreate(pre_erase_task, "Pre-erase", PRE_ERASE_TASK_STACK_SIZE, NULL,
+                              PRE_ERASE_TASK_PRIORITY, &handle))
+    {
+        pre_erase_task_handle = handle;
+    }
+    else
+    {
+        printf("\n Failed to create the pre-erase task.\n");
+    }
+}
+
+/*******************************************************************************
+ * Function Name: pre_erase_task_stop
+ *******************************************************************************
+ * Summary:
+ *  Stops the pre-erase task and waits until it no longer accesses the flash.
+ *  The task finishes the sector it is erasing, the part of the slot erased so
+ *  far is skipped by the next erase of the slot.
+ *
+ *******************************************************************************/
+void pre_erase_task_stop(void)
+{
+    pre_erase_stop_requested = true;
+
+    while (pre_erase_task_handle != NULL)
+    {
+        vTaskDelay(pdMS_TO_TICKS(PRE_ERASE_STOP_POLL_MS));
+    }
+}
+
+/*******************************************************************************
+ * Function Name: pre_erase_task
+ *******************************************************************************
+ * Summary:
+ *  Task that erases the secondary slot one sector at a time until it is blank
+ *  or it is asked to stop.
+ *
+ * Parameters:
+ *  void *args : Task parameter defined during task creation (unused)
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+static void pre_erase_task(void *args)
+{
+    uint32_t blank_len = 0;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    (void)args;
+
+    while (!pre_erase_stop_requested && (blank_len < PRE_ERASE_SLOT_SIZE) && (result == CY_RSLT_SUCCESS))
+    {
+        result = cy_ota_mem_pre_erase_step(OTA_UPGRADE_SLOT_MEM_TYPE, OTA_UPGRADE_SLOT_ADDR,
+                                           PRE_ERASE_SLOT_SIZE, &blank_len);
+    }
+
+    if (result != CY_RSLT_SUCCESS)
+    {
+        printf("\n Pre-erase of the secondary slot failed at offset 0x%08lx\n", (unsigned long)blank_len);
+    }
+    else if (blank_len >= PRE_ERASE_SLOT_SIZE)
+    {
+        printf("\n Secondary slot pre-erased (%lu bytes)\n", (unsigned long)blank_len);
+    }
+
+    /* Save the erases of the slot in one batch */
+    (void)wear_table_save(false);
+
+    pre_erase_task_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+/* [] END OF FILE */
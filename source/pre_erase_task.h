@@ -0,0 +1,71 @@
+/******************************************************************************
+* File Name:   pre_erase_task.h
+*
+* Description: This file is the public interface of pre_erase_task.c
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef PRE_ERASE_TASK_H_
+#define PRE_ERASE_TASK_H_
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cy_ota_flash_ext.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Task parameters for the pre-erase task, lowest priority above the idle task */
+#define PRE_ERASE_TASK_PRIORITY             (tskIDLE_PRIORITY + 1)
+#define PRE_ERASE_TASK_STACK_SIZE           (1024 * 1)
+
+/* Size of the secondary (upgrade) slot erased ahead of time, set it to 0 to
+ * disable the pre-erase.
+ */
+#ifndef PRE_ERASE_SLOT_SIZE
+#define PRE_ERASE_SLOT_SIZE                 (OTA_UPGRADE_SLOT_SIZE)
+#endif
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+void pre_erase_task_start(void);
+void pre_erase_task_stop(void);
+
+#endif /* PRE_ERASE_TASK_H_ */
+
+/* [] END OF FILE */
@@ -43,6 +43,7 @@
 * so agrees to indemnify Cypress against all liability.
 *******************************************************************************/
 
+#include <stdio.h>
 #include "cyhal.h"
 #include "cybsp.h"
 #include "FreeRTOS.h"
@@ -59,6 +60,10 @@
 #include "cy_mqtt_api.h"
 #include "cy_retarget_io.h"
 
+/* Flash operation statistics and wear table */
+#include "cy_ota_flash_ext.h"
+#include "wear_table.h"
+
 /******************************************************************************
 * Macros
 ******************************************************************************/
@@ -78,12 +83,19 @@
  */
 #define PUBLISHER_TASK_QUEUE_LENGTH     (3u)
 
+/* Size of the buffer the flash statistics and the wear table are formatted
+ * in, longer ones are truncated.
+ */
+#define FLASH_STATS_BUFFER_SIZE         (2048u)
+
 /******************************************************************************
 * Function Prototypes
 *******************************************************************************/
 static void publisher_init(void);
 static void publisher_deinit(void);
 static void isr_button_press(void *callback_arg, cyhal_gpio_event_t event);
+static size_t format_flash_stats(char *buf, size_t size);
+static size_t format_flash_wear(char *buf, size_t size);
 void print_heap_usage(char *msg);
 
 /******************************************************************************
@@ -105,6 +117,31 @@ cy_mqtt_publish_info_t publish_info =
     .dup = false
 };
 
+/* Structure to store the publish information of the flash statistics. */
+static cy_mqtt_publish_info_t flash_stats_publish_info =
+{
+    .qos = (cy_mqtt_qos_t) MQTT_MESSAGES_QOS,
+    .topic = MQTT_FLASH_STATS_TOPIC,
+    .topic_len = (sizeof(MQTT_FLASH_STATS_TOPIC) - 1),
+    .retain = false,
+    .dup = false
+};
+
+/* Structure to store the publish information of the wear table. */
+static cy_mqtt_publish_info_t flash_wear_publish_info =
+{
+    .qos = (cy_mqtt_qos_t) MQTT_MESSAGES_QOS,
+    .topic = MQTT_FLASH_WEAR_TOPIC,
+    .topic_len = (sizeof(MQTT_FLASH_WEAR_TOPIC) - 1),
+    .retain = false,
+    .dup = false
+};
+
+/* Flash statistics and wear table, "static" so they are not on the stack. */
+static cy_ota_mem_op_stats_table_t flash_stats;
+static wear_table_t flash_wear;
+static char flash_stats_buffer[FLASH_STATS_BUFFER_SIZE];
+
 /* Structure that stores the callback data for the GPIO interrupt event. */
 cyhal_gpio_callback_data_t cb_data =
 {
@@ -193,6 +230,50 @@ void publisher_task(void *pvParameters)
                     print_heap_usage("publisher_task: After publishing an MQTT message");
                     break;
                 }
+
+                case PUBLISH_FLASH_STATS:
+                {
+                    /* Publish the flash operation statistics. */
+                    flash_stats_publish_info.payload = flash_stats_buffer;
+                    flash_stats_publish_info.payload_len = format_flash_stats(flash_stats_buffer,
+                                                                              sizeof(flash_stats_buffer));
+
+                    printf("\nPublisher: Publishing the flash statistics on the topic '%s'\n",
+                           flash_stats_publish_info.topic);
+
+                    result = cy_mqtt_publish(mqtt_connection, &flash_stats_publish_info);
+
+                    if (result != CY_RSLT_SUCCESS)
+                    {
+                        printf("  Publisher: MQTT Publish failed with error 0x%0X.\n\n", (int)result);
+
+                        mqtt_task_cmd = HANDLE_MQTT_PUBLISH_FAILURE;
+                        xQueueSend(mqtt_task_q, &mqtt_task_cmd, portMAX_DELAY);
+                    }
+                    break;
+                }
+
+                case PUBLISH_FLASH_WEAR:
+                {
+                    /* Publish the erase count of each flash sector. */
+                    flash_wear_publish_info.payload = flash_stats_buffer;
+                    flash_wear_publish_info.payload_len = format_flash_wear(flash_stats_buffer,
+                                                                            sizeof(flash_stats_buffer));
+
+                    printf("\nPublisher: Publishing the wear table on the topic '%s'\n",
+                           flash_wear_publish_info.topic);
+
+                    result = cy_mqtt_publish(mqtt_connection, &flash_wear_publish_info);
+
+                    if (result != CY_RSLT_SUCCESS)
+                    {
+                        printf("  Publisher: MQTT Publish failed with error 0x%0X.\n\n", (int)result);
+
+                        mqtt_task_cmd = HANDLE_MQTT_PUBLISH_FAILURE;
+                        xQueueSend(mqtt_task_q, &mqtt_task_cmd, portMAX_DELAY);
+                    }
+                    break;
+                }
             }
         }
     }
@@ -248,6 +329,104 @@ static void publisher_deinit(void)
     cyhal_gpio_free(CYBSP_USER_BTN);
 }
 
+/******************************************************************************
+ * Function Name: format_flash_stats
+ ******************************************************************************
+ * Summary:
+ *  Formats the flash operation statistics in the compact text format
+ *  described with MQTT_FLASH_STATS_TOPIC, one line per memory type and
+ *  operation that was done at least once.
+ *
+ * Parameters:
+ *  char *buf   : Buffer to format the statistics in
+ *  size_t size : Size of the buffer
+ *
+ * Return:
+ *  size_t : Length of the formatted statistics
+ *
+ ******************************************************************************/
+static size_t format_flash_stats(char *buf, size_t size)
+{
+    static const char * const mem_names[CY_OTA_MEM_STATS_MEM_TYPES] = { "int", "ext" };
+    static const char * const op_names[CY_OTA_MEM_OP_COUNT] = { "read", "prog", "erase", "blank" };
+    size_t len = 0;
+    uint32_t mem, op, bucket;
+
+    cy_ota_mem_get_op_stats(&flash_stats);
+
+    for (mem = 0; mem < CY_OTA_MEM_STATS_MEM_TYPES; mem++)
+    {
+        for (op = 0; op < CY_OTA_MEM_OP_COUNT; op++)
+        {
+            const cy_ota_mem_op_stats_t *stats = &flash_stats.op[mem][op];
+
+            if (stats->count == 0)
+            {
+                continue;
+            }
+
+            len += snprintf(&buf[len], size - len, "%s %s %lu %lu %lu %lu",
+                            mem_names[mem], op_names[op],
+                            (unsigned long)stats->count, (unsigned long)stats->bytes,
+                            (unsigned long)(stats->total_us / 1000u), (unsigned long)stats->max_us);
+            for (bucket = 0; (bucket < OTA_MEM_LATENCY_BUCKETS) && (len < size); bucket++)
+            {
+                if (stats->histogram[bucket] != 0)
+                {
+                    len += snprintf(&buf[len], size - len, " %lu:%lu",
+                                    (unsigned long)bucket, (unsigned long)stats->histogram[bucket]);
+                }
+            }
+            if (len < size)
+            {
+                len += snprintf(&buf[len], size - len, "\n");
+            }
+            if (len >= size)
+            {
+                /* Truncated, snprintf() returns the length it needed */
+                return size - 1;
+            }
+        }
+    }
+
+    return len;
+}
+
+/******************************************************************************
+ * Function Name: format_flash_wear
+ ******************************************************************************
+ * Summary:
+ *  Formats the wear table in the text format described with
+ *  MQTT_FLASH_WEAR_TOPIC.
+ *
+ * Parameters:
+ *  char *buf   : Buffer to format the wear table in
+ *  size_t size : Size of the buffer
+ *
+ * Return:
+ *  size_t : Length of the formatted wear table
+ *
+ ******************************************************************************/
+static size_t format_flash_wear(char *buf, size_t size)
+{
+    size_t len;
+    uint32_t i;
+
+    wear_table_get(&flash_wear);
+
+    len = snprintf(buf, size, "%lu %lu %lu %lu\n",
+                   (unsigned long)flash_wear.updates, (unsigned long)flash_wear.sequence,
+                   (unsigned long)flash_wear.area_erases, (unsigned long)flash_wear.untracked);
+    for (i = 0; (i < flash_wear.entries) && (len < size); i++)
+    {
+        len += snprintf(&buf[len], size - len, "%08lx %lu\n",
+                        (unsigned long)flash_wear.entry[i].addr, (unsigned long)flash_wear.entry[i].erases);
+    }
+
+    /* Truncated, snprintf() returns the length it needed */
+    return (len < size) ? len : (size - 1);
+}
+
 /******************************************************************************
  * Function Name: isr_button_press
  ******************************************************************************
@@ -61,7 +61,9 @@ typedef enum
 {
     PUBLISHER_INIT,
     PUBLISHER_DEINIT,
-    PUBLISH_MQTT_MSG
+    PUBLISH_MQTT_MSG,
+    PUBLISH_FLASH_STATS,
+    PUBLISH_FLASH_WEAR
 } publisher_cmd_t;
 
 /* Struct to be passed via the publisher task queue */
@@ -49,6 +49,7 @@
 
 /* Task header files */
 #include "subscriber_task.h"
+#include "publisher_task.h"
 #include "mqtt_task.h"
 
 /* Configuration file for MQTT client */
@@ -228,7 +229,8 @@ static void subscribe_to_topic(void)
  *  Callback to handle incoming MQTT messages. This callback prints the
  *  contents of the incoming message and informs the subscriber task, via a
  *  message queue, to turn on / turn off the device based on the received
- *  message.
+ *  message. Requests for the flash statistics and the wear table are passed
+ *  on to the publisher task.
  *
  * Parameters:
  *  cy_mqtt_publish_info_t *received_msg_info : Information structure of the
@@ -247,6 +249,9 @@ void mqtt_subscription_callback(cy_mqtt_publish_info_t *received_msg_info)
     /* Data to be sent to the subscriber task queue. */
     subscriber_data_t subscriber_q_data;
 
+    /* Data to be sent to the publisher task queue. */
+    publisher_data_t publisher_q_data;
+
     printf("  \nSubsciber: Incoming MQTT message received:\n"
            "    Publish topic name: %.*s\n"
            "    Publish QoS: %d\n"
@@ -269,6 +274,23 @@ void mqtt_subscription_callback(cy_mqtt_publish_info_t *received_msg_info)
     {
         subscriber_q_data.data = DEVICE_OFF_STATE;
     }
+    else if ((strlen(MQTT_FLASH_STATS_REQUEST_MESSAGE) == received_msg_len) &&
+             (strncmp(MQTT_FLASH_STATS_REQUEST_MESSAGE, received_msg, received_msg_len) == 0))
+    {
+        /* The publisher task publishes the flash statistics, the LED state is unchanged. */
+        publisher_q_data.cmd = PUBLISH_FLASH_STATS;
+        publisher_q_data.data = NULL;
+        xQueueSend(publisher_task_q, &publisher_q_data, portMAX_DELAY);
+        return;
+    }
+    else if ((strlen(MQTT_FLASH_WEAR_REQUEST_MESSAGE) == received_msg_len) &&
+             (strncmp(MQTT_FLASH_WEAR_REQUEST_MESSAGE, received_msg, received_msg_len) == 0))
+    {
+        publisher_q_data.cmd = PUBLISH_FLASH_WEAR;
+        publisher_q_data.data = NULL;
+        xQueueSend(publisher_task_q, &publisher_q_data, portMAX_DELAY);
+        return;
+    }
     else
     {
         printf("  Subscriber: Received MQTT message not in valid format!\n");
@@ -0,0 +1,258 @@
+/******************************************************************************
+* File Name:   wear_table.c
+*
+* Description: This file contains the table of the erases of each flash sector,
+*              kept in RAM and saved in batches to a reserved flash area
+*              so it survives resets and power failures.
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "cyhal.h"
+#include "cybsp.h"
+
+/* FreeRTOS header files */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "wear_table.h"
+#include "flash_record.h"
+
+/* Flash API extensions */
+#include "cy_ota_flash_ext.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Marks a record of the table */
+#define WEAR_TABLE_MAGIC                    (0x57454152u)
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* Table counting the erases since the first boot with it */
+static wear_table_t wear_table;
+
+/* Set when the table holds erases that are not saved yet */
+static volatile bool wear_table_dirty;
+
+static bool wear_table_ready;
+
+/* Records of the table in the flash. A reset or power failure while saving
+ * loses at most the erases counted since the last save.
+ */
+static flash_record_area_t wear_table_area =
+{
+    .mem_type     = WEAR_TABLE_MEM_TYPE,
+    .addr         = WEAR_TABLE_ADDR,
+    .size         = WEAR_TABLE_SIZE,
+    .magic        = WEAR_TABLE_MAGIC,
+    .payload_size = sizeof(wear_table_t),
+};
+
+/*******************************************************************************
+* Forward declaration
+********************************************************************************/
+static void wear_table_erase_hook(cy_ota_mem_type_t mem_type, uint32_t sector_addr, uint32_t sector_size);
+
+/*******************************************************************************
+ * Function Name: wear_table_init
+ *******************************************************************************
+ * Summary:
+ *  Loads the wear table from the flash and starts counting the erases of the
+ *  flash sectors. Must be called after the OTA storage is initialized and
+ *  before the flash is erased.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+cy_rslt_t wear_table_init(void)
+{
+    bool found;
+
+    if (CY_RSLT_SUCCESS != cy_ota_mem_session_begin())
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    if (CY_RSLT_SUCCESS != flash_record_load(&wear_table_area, &wear_table, &found))
+    {
+        cy_ota_mem_session_end();
+        printf("\n Wear table area does not fit the table.\n");
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    /* Without a record the table starts empty */
+    if (!found || (wear_table.entries > WEAR_TABLE_ENTRIES))
+    {
+        memset(&wear_table, 0x00, sizeof(wear_table));
+    }
+    cy_ota_mem_set_erase_hook(wear_table_erase_hook);
+    wear_table_ready = true;
+    cy_ota_mem_session_end();
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: wear_table_save
+ *******************************************************************************
+ * Summary:
+ *  Saves the table to the flash if it changed since it was last saved. It is
+ *  called once per download and after the secondary slot was erased ahead of
+ *  time, so it adds one program of a record per batch of erases, and an
+ *  erase of a half of the area every few hundred records.
+ *
+ * Parameters:
+ *  bool update_done : true to count a download that was written and verified
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS on success, error code otherwise
+ *
+ *******************************************************************************/
+cy_rslt_t wear_table_save(bool update_done)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if (!wear_table_ready || (CY_RSLT_SUCCESS != cy_ota_mem_session_begin()))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    if (update_done)
+    {
+        wear_table.updates++;
+        wear_table_dirty = true;
+    }
+
+    if (wear_table_dirty)
+    {
+        /* Erases counted while the record is written are saved with the next one */
+        wear_table_dirty = false;
+        wear_table.sequence++;
+
+        result = flash_record_save(&wear_table_area, &wear_table);
+        if (CY_RSLT_SUCCESS != result)
+        {
+            wear_table_dirty = true;
+            printf("\n Failed to save the wear table.\n");
+        }
+    }
+
+    cy_ota_mem_session_end();
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: wear_table_get
+ *******************************************************************************
+ * Summary:
+ *  Copies the wear table, including the erases not saved yet.
+ *
+ * Parameters:
+ *  wear_table_t *table : Pointer to the structure to store the table in
+ *
+ *******************************************************************************/
+void wear_table_get(wear_table_t *table)
+{
+    if (table == NULL)
+    {
+        return;
+    }
+
+    if (CY_RSLT_SUCCESS == cy_ota_mem_session_begin())
+    {
+        *table = wear_table;
+        cy_ota_mem_session_end();
+    }
+    else
+    {
+        memset(table, 0x00, sizeof(*table));
+    }
+}
+
+/*******************************************************************************
+ * Function Name: wear_table_erase_hook
+ *******************************************************************************
+ * Summary:
+ *  Counts the erase of a sector. Called by the flash layer with the flash
+ *  lock held, only updates the table in RAM.
+ *
+ * Parameters:
+ *  cy_ota_mem_type_t mem_type : Memory type of the sector
+ *  uint32_t sector_addr       : Address of the sector
+ *  uint32_t sector_size       : Size of the sector
+ *
+ *******************************************************************************/
+static void wear_table_erase_hook(cy_ota_mem_type_t mem_type, uint32_t sector_addr, uint32_t sector_size)
+{
+    uint32_t i;
+
+    (void)sector_size;
+    wear_table_dirty = true;
+
+    if ((mem_type == WEAR_TABLE_MEM_TYPE) && (sector_addr >= WEAR_TABLE_ADDR) &&
+        (sector_addr < (WEAR_TABLE_ADDR + WEAR_TABLE_SIZE)))
+    {
+        wear_table.area_erases++;
+        return;
+    }
+
+    for (i = 0; i < wear_table.entries; i++)
+    {
+        if (wear_table.entry[i].addr == sector_addr)
+        {
+            wear_table.entry[i].erases++;
+            return;
+        }
+    }
+
+    if (wear_table.entries < WEAR_TABLE_ENTRIES)
+    {
+        wear_table.entry[wear_table.entries].addr = sector_addr;
+        wear_table.entry[wear_table.entries].erases = 1u;
+        wear_table.entries++;
+    }
+    else
+    {
+        wear_table.untracked++;
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,105 @@
+/******************************************************************************
+* File Name:   wear_table.h
+*
+* Description: This file is the public interface of wear_table.c
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef WEAR_TABLE_H_
+#define WEAR_TABLE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cy_result.h"
+#include "cy_ota_flash_ext.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Flash area reserved for the wear table, split in two halves that are used
+ * in turn. Each half must be a whole number of erase sectors and must not be
+ * used by the bootloader or the application. Internal flash is addressed by
+ * the offset from CY_FLASH_BASE.
+ */
+#ifndef WEAR_TABLE_ADDR
+#if defined (XMC7200)
+#define WEAR_TABLE_ADDR                     (0x007F0000u)   /* Code flash small sectors 0x107F0000 */
+#define WEAR_TABLE_SIZE                     (0x00010000u)   /* 2 x 32 KB of 8 KB sectors */
+#define WEAR_TABLE_MEM_TYPE                 (CY_OTA_MEM_TYPE_INTERNAL_FLASH)
+#else
+#define WEAR_TABLE_ADDR                     (0x18500000u)   /* After the scratch area of the swap layouts */
+#define WEAR_TABLE_SIZE                     (0x00080000u)   /* 2 x 256 KB sectors of the S25HS256T */
+#define WEAR_TABLE_MEM_TYPE                 (CY_OTA_MEM_TYPE_EXTERNAL_FLASH)
+#endif
+#endif /* WEAR_TABLE_ADDR */
+
+/* Number of erase sectors the erases are counted for. Erases of further
+ * sectors are only counted in wear_table_t::untracked.
+ */
+#ifndef WEAR_TABLE_ENTRIES
+#define WEAR_TABLE_ENTRIES                  (128u)
+#endif
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+typedef struct
+{
+    uint32_t addr;                  /* Sector address, as passed to the erase hook */
+    uint32_t erases;                /* Times the sector was erased                 */
+} wear_table_entry_t;
+
+typedef struct
+{
+    uint32_t sequence;              /* Number of times the table was saved              */
+    uint32_t updates;               /* Downloads written and verified                   */
+    uint32_t area_erases;           /* Erased sectors of the wear table area itself     */
+    uint32_t untracked;             /* Sector erases not counted, the table was full    */
+    uint32_t entries;               /* Entries in use                                   */
+    wear_table_entry_t entry[WEAR_TABLE_ENTRIES];
+} wear_table_t;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+cy_rslt_t wear_table_init(void);
+cy_rslt_t wear_table_save(bool update_done);
+void wear_table_get(wear_table_t *table);
+
+#endif /* WEAR_TABLE_H_ */
+
+/* [] END OF FILE */
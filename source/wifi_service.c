@@ -0,0 +1,360 @@
+/******************************************************************************
+* File Name:   wifi_service.c
+*
+* Description: This file contains the Wi-Fi service that initializes the Wi-Fi
+*              Connection Manager and connects to the AP once for all the
+*              tasks, and publishes the state of the link in an event group.
+*              It runs in its own task so the rest of the startup proceeds
+*              while the device associates.
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "cyhal.h"
+#include "cybsp.h"
+
+/* FreeRTOS header files */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "event_groups.h"
+
+#include "wifi_service.h"
+
+/* Configuration file for Wi-Fi */
+#include "wifi_config.h"
+
+/* Middleware libraries */
+#include "cy_wcm.h"
+
+/* LwIP header files */
+#include "lwip/netif.h"
+
+/*******************************************************************************
+* Forward declaration
+********************************************************************************/
+static void wifi_service_task(void *args);
+static cy_rslt_t wifi_service_associate(uint32_t *attempts);
+static void wifi_service_event_callback(cy_wcm_event_t event, cy_wcm_event_data_t *event_data);
+
+/*******************************************************************************
+* Global Variables
+********************************************************************************/
+/* State of the Wi-Fi link, NULL until the service is started */
+EventGroupHandle_t wifi_service_events;
+
+static TaskHandle_t wifi_service_task_handle;
+
+/*******************************************************************************
+ * Function Name: wifi_service_start
+ *******************************************************************************
+ * Summary:
+ *  Creates the event group of the link state and starts the Wi-Fi service
+ *  task, which initializes the Wi-Fi Connection Manager and connects to the
+ *  AP right away. Returns without waiting for the connection.
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS if the service is started
+ *
+ *******************************************************************************/
+cy_rslt_t wifi_service_start(void)
+{
+    if (wifi_service_events != NULL)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    wifi_service_events = xEventGroupCreate();
+    if (wifi_service_events == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    if (pdPASS != xTaskCreate(wifi_service_task, "Wi-Fi service", WIFI_SERVICE_TASK_STACK_SIZE, NULL,
+                              WIFI_SERVICE_TASK_PRIORITY, &wifi_service_task_handle))
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/*******************************************************************************
+ * Function Name: wifi_service_wait_ready
+ *******************************************************************************
+ * Summary:
+ *  Waits until the Wi-Fi Connection Manager and the network stack are
+ *  initialized, so the sockets can be initialized before the device is
+ *  associated.
+ *
+ * Parameters:
+ *  TickType_t timeout : Longest time to wait
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS once initialized, error code otherwise
+ *
+ *******************************************************************************/
+cy_rslt_t wifi_service_wait_ready(TickType_t timeout)
+{
+    EventBits_t bits;
+
+    if (wifi_service_events == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    bits = xEventGroupWaitBits(wifi_service_events, WIFI_SERVICE_READY | WIFI_SERVICE_FAILED,
+                               pdFALSE, pdFALSE, timeout);
+
+    return ((bits & WIFI_SERVICE_READY) != 0u) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+}
+
+/*******************************************************************************
+ * Function Name: wifi_service_connect
+ *******************************************************************************
+ * Summary:
+ *  Waits until the device is connected to the AP. If the link is down, the
+ *  service task is asked to connect again, with the retries configured in
+ *  wifi_config.h.
+ *
+ * Parameters:
+ *  TickType_t timeout : Longest time to wait
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS once connected, error code if all the
+ *              attempts failed or the timeout elapsed
+ *
+ *******************************************************************************/
+cy_rslt_t wifi_service_connect(TickType_t timeout)
+{
+    EventBits_t bits;
+
+    if (wifi_service_events == NULL)
+    {
+        return CY_RSLT_TYPE_ERROR;
+    }
+
+    if ((xEventGroupGetBits(wifi_service_events) & WIFI_SERVICE_CONNECTED) != 0u)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    (void)xEventGroupClearBits(wifi_service_events, WIFI_SERVICE_FAILED);
+    (void)xTaskNotifyGive(wifi_service_task_handle);
+
+    bits = xEventGroupWaitBits(wifi_service_events, WIFI_SERVICE_CONNECTED | WIFI_SERVICE_FAILED,
+                               pdFALSE, pdFALSE, timeout);
+
+    return ((bits & WIFI_SERVICE_CONNECTED) != 0u) ? CY_RSLT_SUCCESS : CY_RSLT_TYPE_ERROR;
+}
+
+/*******************************************************************************
+ * Function Name: wifi_service_task
+ *******************************************************************************
+ * Summary:
+ *  Initializes the Wi-Fi Connection Manager and connects to the AP, then
+ *  connects again each time it is asked to. Reports the time from the start
+ *  of the scheduler to the first connection.
+ *
+ * Parameters:
+ *  void *args : Task parameter defined during task creation (unused)
+ *
+ * Return:
+ *  void
+ *
+ *******************************************************************************/
+static void wifi_service_task(void *args)
+{
+    cy_wcm_config_t config = { .interface = CY_WCM_INTERFACE_TYPE_STA };
+    TickType_t init_tick = xTaskGetTickCount();
+    TickType_t ready_tick;
+    uint32_t attempts;
+    bool first_connection = true;
+
+    (void)args;
+
+    if (CY_RSLT_SUCCESS != cy_wcm_init(&config))
+    {
+        printf("\nWi-Fi Connection Manager initialization failed!\n");
+        for (;;)
+        {
+            (void)xEventGroupSetBits(wifi_service_events, WIFI_SERVICE_FAILED);
+            (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+
+    (void)cy_wcm_register_event_callback(wifi_service_event_callback);
+    ready_tick = xTaskGetTickCount();
+    printf("\nWi-Fi Connection Manager initialized in %lu ms.\n",
+            (unsigned long)((ready_tick - init_tick) * portTICK_PERIOD_MS));
+    (void)xEventGroupSetBits(wifi_service_events, WIFI_SERVICE_READY);
+
+    for (;;)
+    {
+        if (CY_RSLT_SUCCESS == wifi_service_associate(&attempts))
+        {
+            (void)xEventGroupClearBits(wifi_service_events, WIFI_SERVICE_FAILED);
+            (void)xEventGroupSetBits(wifi_service_events, WIFI_SERVICE_CONNECTED);
+
+            if (first_connection)
+            {
+                first_connection = false;
+                printf("Wi-Fi connected %lu ms after boot: WCM initialization %lu ms, association %lu ms in %lu attempts\n\n",
+                        (unsigned long)(xTaskGetTickCount() * portTICK_PERIOD_MS),
+                        (unsigned long)((ready_tick - init_tick) * portTICK_PERIOD_MS),
+                        (unsigned long)((xTaskGetTickCount() - ready_tick) * portTICK_PERIOD_MS),
+                        (unsigned long)attempts);
+            }
+        }
+        else
+        {
+            (void)xEventGroupSetBits(wifi_service_events, WIFI_SERVICE_FAILED);
+        }
+
+        /* Wait until a task asks to connect again */
+        (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+/*******************************************************************************
+ * Function Name: wifi_service_associate
+ *******************************************************************************
+ * Summary:
+ *  Connects to the AP unless already connected. The connection is retried up
+ *  to 'MAX_WIFI_CONN_RETRIES' times, the wait between the attempts starts at
+ *  'WIFI_CONN_RETRY_MIN_INTERVAL_MS' and doubles up to
+ *  'WIFI_CONN_RETRY_INTERVAL_MS', so a transient failure at boot costs little
+ *  and an absent AP is not polled too often.
+ *
+ * Parameters:
+ *  uint32_t *attempts : Pointer to store the number of attempts made in
+ *
+ * Return:
+ *  cy_rslt_t : CY_RSLT_SUCCESS once connected, error code otherwise
+ *
+ *******************************************************************************/
+static cy_rslt_t wifi_service_associate(uint32_t *attempts)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    cy_wcm_connect_params_t connect_param;
+    cy_wcm_ip_address_t ip_address;
+    uint32_t delay_ms = WIFI_CONN_RETRY_MIN_INTERVAL_MS;
+
+    *attempts = 0;
+
+    if (cy_wcm_is_connected_to_ap() != 0)
+    {
+        return CY_RSLT_SUCCESS;
+    }
+
+    /* Configure the connection parameters for the Wi-Fi interface. */
+    memset(&connect_param, 0, sizeof(cy_wcm_connect_params_t));
+    memcpy(connect_param.ap_credentials.SSID, WIFI_SSID, sizeof(WIFI_SSID));
+    memcpy(connect_param.ap_credentials.password, WIFI_PASSWORD, sizeof(WIFI_PASSWORD));
+    connect_param.ap_credentials.security = WIFI_SECURITY;
+
+    printf("\nWi-Fi Connecting to '%s'\n", connect_param.ap_credentials.SSID);
+
+    for (uint32_t retry_count = 0; retry_count < MAX_WIFI_CONN_RETRIES; retry_count++)
+    {
+        (*attempts)++;
+        result = cy_wcm_connect_ap(&connect_param, &ip_address);
+
+        if (result == CY_RSLT_SUCCESS)
+        {
+            printf("\nSuccessfully connected to Wi-Fi network '%s'.\n", connect_param.ap_credentials.SSID);
+            if (ip_address.version == CY_WCM_IP_VER_V4)
+            {
+                printf("IPv4 Address Assigned: %s\n", ip4addr_ntoa((const ip4_addr_t *) &ip_address.ip.v4));
+            }
+            else if (ip_address.version == CY_WCM_IP_VER_V6)
+            {
+                printf("IPv6 Address Assigned: %s\n", ip6addr_ntoa((const ip6_addr_t *) &ip_address.ip.v6));
+            }
+            return result;
+        }
+
+        printf("Wi-Fi Connection failed. Error code:0x%0X. Retrying in %lu ms. Retries left: %d\n",
+            (int)result, (unsigned long)delay_ms, (int)(MAX_WIFI_CONN_RETRIES - retry_count - 1));
+        vTaskDelay(pdMS_TO_TICKS(delay_ms));
+
+        delay_ms *= 2u;
+        if (delay_ms > WIFI_CONN_RETRY_INTERVAL_MS)
+        {
+            delay_ms = WIFI_CONN_RETRY_INTERVAL_MS;
+        }
+    }
+
+    printf("\nExceeded maximum Wi-Fi connection attempts!\n");
+
+    return result;
+}
+
+/*******************************************************************************
+ * Function Name: wifi_service_event_callback
+ *******************************************************************************
+ * Summary:
+ *  Keeps the link state up to date when the Wi-Fi Connection Manager loses
+ *  the AP or reconnects to it on its own.
+ *
+ * Parameters:
+ *  cy_wcm_event_t event             : Event of the Wi-Fi Connection Manager
+ *  cy_wcm_event_data_t *event_data  : Data of the event (unused)
+ *
+ *******************************************************************************/
+static void wifi_service_event_callback(cy_wcm_event_t event, cy_wcm_event_data_t *event_data)
+{
+    (void)event_data;
+
+    switch (event)
+    {
+        case CY_WCM_EVENT_DISCONNECTED:
+            (void)xEventGroupClearBits(wifi_service_events, WIFI_SERVICE_CONNECTED);
+            printf("\nWi-Fi disconnected from the AP.\n");
+            break;
+
+        case CY_WCM_EVENT_RECONNECTED:
+            (void)xEventGroupSetBits(wifi_service_events, WIFI_SERVICE_CONNECTED);
+            printf("\nWi-Fi reconnected to the AP.\n");
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,77 @@
+/******************************************************************************
+* File Name:   wifi_service.h
+*
+* Description: This file is the public interface of wifi_service.c
+*
+* Related Document: See README.md
+*
+*
+*******************************************************************************
+* Copyright 2024, Cypress Semiconductor Corporation (an Infineon company) or
+* an affiliate of Cypress Semiconductor Corporation.  All rights reserved.
+*
+* This software, including source code, documentation and related
+* materials ("Software") is owned by Cypress Semiconductor Corporation
+* or one of its affiliates ("Cypress") and is protected by and subject to
+* worldwide patent protection (United States and foreign),
+* United States copyright laws and international treaty provisions.
+* Therefore, you may use this Software only as provided in the license
+* agreement accompanying the software package from which you
+* obtained this Software ("EULA").
+* If no EULA applies, Cypress hereby grants you a personal, non-exclusive,
+* non-transferable license to copy, modify, and compile the Software
+* source code solely for use in connection with Cypress's
+* integrated circuit products.  Any reproduction, modification, translation,
+* compilation, or representation of this Software except as specified
+* above is prohibited without the express written permission of Cypress.
+*
+* Disclaimer: THIS SOFTWARE IS PROVIDED AS-IS, WITH NO WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING, BUT NOT LIMITED TO, NONINFRINGEMENT, IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. Cypress
+* reserves the right to make changes to the Software without notice. Cypress
+* does not assume any liability arising out of the application or use of the
+* Software or any product or circuit described in the Software. Cypress does
+* not authorize its products for use in any products where a malfunction or
+* failure of the Cypress product may reasonably be expected to result in
+* significant property damage, injury or death ("High Risk Product"). By
+* including Cypress's product in a High Risk Product, the manufacturer
+* of such system or application assumes all risk of such use and in doing
+* so agrees to indemnify Cypress against all liability.
+*******************************************************************************/
+
+#ifndef WIFI_SERVICE_H_
+#define WIFI_SERVICE_H_
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "event_groups.h"
+#include "cy_result.h"
+
+/*******************************************************************************
+* Macros
+********************************************************************************/
+/* Task parameters for the Wi-Fi service task */
+#define WIFI_SERVICE_TASK_PRIORITY          (configMAX_PRIORITIES - 3)
+#define WIFI_SERVICE_TASK_STACK_SIZE        (1024 * 2)
+
+/* Bits of wifi_service_events */
+#define WIFI_SERVICE_READY                  (1lu << 0)  /* WCM and the network stack are initialized */
+#define WIFI_SERVICE_CONNECTED              (1lu << 1)  /* Associated to the AP with an IP address    */
+#define WIFI_SERVICE_FAILED                 (1lu << 2)  /* Last connection attempts all failed        */
+
+/*******************************************************************************
+* Extern Variables
+********************************************************************************/
+/* State of the Wi-Fi link, any task may wait on its bits */
+extern EventGroupHandle_t wifi_service_events;
+
+/*******************************************************************************
+* Function Prototypes
+********************************************************************************/
+cy_rslt_t wifi_service_start(void);
+cy_rslt_t wifi_service_wait_ready(TickType_t timeout);
+cy_rslt_t wifi_service_connect(TickType_t timeout);
+
+#endif /* WIFI_SERVICE_H_ */
+
+/* [] END OF FILE */